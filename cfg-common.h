@@ -189,6 +189,7 @@ const m_option_t mfopts_conf[]={
 const m_option_t audio_filter_conf[]={
     {"list", &af_cfg.list, CONF_TYPE_STRING_LIST, 0, 0, 0, NULL},
     {"force", &af_cfg.force, CONF_TYPE_INT, CONF_RANGE, 0, 7, NULL},
+    {"threads", &af_cfg.threads, CONF_TYPE_STRING_LIST, 0, 0, 0, NULL},
     {NULL, NULL, 0, 0, 0, 0, NULL}
 };
 
@@ -638,6 +639,14 @@ const m_option_t common_opts[] = {
     {"ass-force-style", &ass_force_style_list, CONF_TYPE_STRING_LIST, 0, 0, 0, NULL},
     {"ass-color", &ass_color, CONF_TYPE_STRING, 0, 0, 0, NULL},
     {"ass-border-color", &ass_border_color, CONF_TYPE_STRING, 0, 0, 0, NULL},
+#ifdef CONFIG_ASS_INTERNAL
+    {"ass-fast-blur", &ass_fast_blur, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+    {"noass-fast-blur", &ass_fast_blur, CONF_TYPE_FLAG, 0, 1, 0, NULL},
+#endif
+    {"ass-cache-size", &ass_cache_size, CONF_TYPE_INT, CONF_RANGE, 0, 2048, NULL},
+#ifdef CONFIG_ASS_INTERNAL
+    {"ass-threads", &ass_threads, CONF_TYPE_INT, CONF_RANGE, 1, 16, NULL},
+#endif
     {"ass-styles", &ass_styles_file, CONF_TYPE_STRING, 0, 0, 0, NULL},
     {"ass-hinting", &ass_hinting, CONF_TYPE_INT, CONF_RANGE, 0, 7, NULL},
 #endif
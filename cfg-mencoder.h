@@ -182,6 +182,15 @@ const m_option_t mencoder_opts[]={
     {"audio-density", &audio_density, CONF_TYPE_INT, CONF_RANGE|CONF_GLOBAL, 1, 50, NULL},
     {"audio-preload", &audio_preload, CONF_TYPE_FLOAT, CONF_RANGE|CONF_GLOBAL, 0, 2, NULL},
     {"audio-delay",   &audio_delay_fix, CONF_TYPE_FLOAT, CONF_GLOBAL, 0, 0, NULL},
+#if HAVE_PTHREADS
+    {"audio-thread", &audio_thread, CONF_TYPE_FLAG, CONF_GLOBAL, 0, 1, NULL},
+    {"noaudio-thread", &audio_thread, CONF_TYPE_FLAG, CONF_GLOBAL, 1, 0, NULL},
+    {"audio-threads", &audio_threads, CONF_TYPE_INT, CONF_RANGE|CONF_GLOBAL, 1, 16, NULL},
+    {"video-thread", &video_thread, CONF_TYPE_FLAG, CONF_GLOBAL, 0, 1, NULL},
+    {"novideo-thread", &video_thread, CONF_TYPE_FLAG, CONF_GLOBAL, 1, 0, NULL},
+#endif
+    {"segments", &segments, CONF_TYPE_INT, CONF_RANGE|CONF_GLOBAL, 0, 64, NULL},
+    {"statsfile", &stats_file, CONF_TYPE_STRING, CONF_GLOBAL, 0, 0, NULL},
 
     {"x", "-x has been removed, use -vf scale=w:h for scaling.\n", CONF_TYPE_PRINT, CONF_NOCFG, 0, 0, NULL},
     {"xsize", "-xsize has been removed, use -vf crop=w:h:x:y for cropping.\n", CONF_TYPE_PRINT, CONF_NOCFG, 0, 0, NULL},
@@ -555,6 +555,90 @@ static codecs_t *audio_codecs=NULL;
 static int nr_vcodecs = 0;
 static int nr_acodecs = 0;
 
+#define INDEX_BUCKETS 256
+
+typedef struct {
+    unsigned int fourcc;
+    int codec;  // position in the codec list
+    int slot;   // first slot of fourcc in the codec, for fourccmap
+} codec_ref_t;
+
+/* Hash index from fourcc to the codecs supporting it, in the order of the
+   codec list, so find_codec() does not have to go through every fourcc of
+   every codec. The codecs of the null driver match any fourcc and are kept
+   apart. */
+typedef struct {
+    codec_ref_t *refs;
+    int bucket[INDEX_BUCKETS + 1]; // refs of bucket b start at bucket[b]
+    int *null_codecs;
+    int nr_null;
+} codec_index_t;
+
+static codec_index_t video_index;
+static codec_index_t audio_index;
+
+static unsigned int index_hash(unsigned int fourcc)
+{
+    return (fourcc * 2654435761U) >> 24;
+}
+
+static void index_free(codec_index_t *index)
+{
+    free(index->refs);
+    free(index->null_codecs);
+    memset(index, 0, sizeof(*index));
+}
+
+static int index_build(codec_index_t *index, const codecs_t *c, int nr_codecs)
+{
+    int pos[INDEX_BUCKETS];
+    int i, j, b;
+
+    index_free(index);
+    index->null_codecs = malloc(nr_codecs * sizeof(int) + 1);
+    if (!index->null_codecs)
+        return 0;
+    // count the refs per bucket, a run of the same fourcc is one ref
+    for (i = 0; i < nr_codecs; i++) {
+        if (!strcmp(c[i].drv, "null")) {
+            index->null_codecs[index->nr_null++] = i;
+            continue;
+        }
+        for (j = 0; j < CODECS_MAX_FOURCC; j++)
+            if (!j || c[i].fourcc[j] != c[i].fourcc[j - 1])
+                index->bucket[index_hash(c[i].fourcc[j]) + 1]++;
+    }
+    for (b = 0; b < INDEX_BUCKETS; b++) {
+        index->bucket[b + 1] += index->bucket[b];
+        pos[b] = index->bucket[b];
+    }
+    index->refs = malloc(index->bucket[INDEX_BUCKETS] * sizeof(codec_ref_t) + 1);
+    if (!index->refs) {
+        index_free(index);
+        return 0;
+    }
+    for (i = 0; i < nr_codecs; i++) {
+        if (!strcmp(c[i].drv, "null"))
+            continue;
+        for (j = 0; j < CODECS_MAX_FOURCC; j++)
+            if (!j || c[i].fourcc[j] != c[i].fourcc[j - 1]) {
+                codec_ref_t *ref = &index->refs[pos[index_hash(c[i].fourcc[j])]++];
+                ref->fourcc = c[i].fourcc[j];
+                ref->codec  = i;
+                ref->slot   = j;
+            }
+    }
+    return 1;
+}
+
+/// Build the lookup indexes once the codec lists are complete.
+static void codecs_index(void)
+{
+    if (!index_build(&video_index, video_codecs, nr_vcodecs) ||
+        !index_build(&audio_index, audio_codecs, nr_acodecs))
+        mp_msg(MSGT_CODECCFG, MSGL_WARN, "Cannot index the codecs, looking them up one by one.\n");
+}
+
 int parse_codec_cfg(const char *cfgfile)
 {
     codecs_t *codec = NULL; // current codec
@@ -578,6 +662,7 @@ int parse_codec_cfg(const char *cfgfile)
         audio_codecs = builtin_audio_codecs;
         nr_vcodecs = sizeof(builtin_video_codecs)/sizeof(codecs_t);
         nr_acodecs = sizeof(builtin_audio_codecs)/sizeof(codecs_t);
+        codecs_index();
         return 1;
 #endif
     }
@@ -779,6 +864,7 @@ int parse_codec_cfg(const char *cfgfile)
     mp_msg(MSGT_CODECCFG,MSGL_INFO,MSGTR_AudioVideoCodecTotals, nr_acodecs, nr_vcodecs);
     if(video_codecs) video_codecs[nr_vcodecs].name = NULL;
     if(audio_codecs) audio_codecs[nr_acodecs].name = NULL;
+    codecs_index();
 out:
     free(line);
     line=NULL;
@@ -819,6 +905,8 @@ static void codecs_free(codecs_t* codecs,int count) {
 }
 
 void codecs_uninit_free(void) {
+    index_free(&video_index);
+    index_free(&audio_index);
     if (video_codecs)
     codecs_free(video_codecs,nr_vcodecs);
     video_codecs=NULL;
@@ -859,14 +947,42 @@ codecs_t* find_codec(unsigned int fourcc,unsigned int *fourccmap,
     } else
 #endif
     {
+        codec_index_t *index;
         if (audioflag) {
             i = nr_acodecs;
             c = audio_codecs;
+            index = &audio_index;
         } else {
             i = nr_vcodecs;
             c = video_codecs;
+            index = &video_index;
         }
         if(!i) return NULL;
+        if (index->refs && !force) {
+            int first = start ? start - c + 1 : 0;
+            int b = index_hash(fourcc);
+            codec_ref_t *ref = NULL;
+            // refs and null codecs are both in list order
+            for (j = index->bucket[b]; j < index->bucket[b + 1]; j++)
+                if (index->refs[j].fourcc == fourcc && index->refs[j].codec >= first) {
+                    ref = &index->refs[j];
+                    break;
+                }
+            for (j = 0; j < index->nr_null; j++)
+                if (index->null_codecs[j] >= first) {
+                    if (!ref || index->null_codecs[j] < ref->codec) {
+                        if (fourccmap)
+                            *fourccmap = c[index->null_codecs[j]].fourccmap[0];
+                        return c + index->null_codecs[j];
+                    }
+                    break;
+                }
+            if (!ref)
+                return NULL;
+            if (fourccmap)
+                *fourccmap = c[ref->codec].fourccmap[ref->slot];
+            return c + ref->codec;
+        }
         for (/* NOTHING */; i--; c++) {
             if(start && c<=start) continue;
             for (j = 0; j < CODECS_MAX_FOURCC; j++) {
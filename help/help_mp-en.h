@@ -302,6 +302,10 @@ static const char help_text[]=
 #define MSGTR_LimitingAudioPreload "Limiting audio preload to 0.4s.\n"
 #define MSGTR_IncreasingAudioDensity "Increasing audio density to 4.\n"
 #define MSGTR_ZeroingAudioPreloadAndMaxPtsCorrection "Forcing audio preload to 0, max pts correction to 0.\n"
+#define MSGTR_CannotEncodeSegments "-segments needs a single input file and cannot be combined with -ss, -sb, -endpos, -frames, -frameno-file or -vobsubout.\n"
+#define MSGTR_CannotSplitInput "Cannot split the input into segments, encoding it as a whole.\n"
+#define MSGTR_EncodingSegment "Encoding segment %d/%d starting at %.2fs.\n"
+#define MSGTR_SegmentEncodingFailed "Encoding of a segment failed."
 #define MSGTR_LameVersion "LAME version %s (%s)\n\n"
 #define MSGTR_InvalidBitrateForLamePreset "Error: The bitrate specified is out of the valid range for this preset.\n"\
 "\n"\
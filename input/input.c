@@ -612,6 +612,9 @@ static char* ar_dev = NULL;
 static char* in_file = NULL;
 static int in_file_fd = -1;
 
+// Parts of mp_input_init() left for later
+static int bindings_pending = 0, devices_pending = 0;
+
 static int mp_input_print_key_list(m_option_t* cfg);
 static int mp_input_print_cmd_list(m_option_t* cfg);
 
@@ -1086,11 +1089,14 @@ mp_input_get_bind_section(char *section) {
   return bind_section;
 }
 
+static void mp_input_load_bindings(void);
+
 static mp_cmd_t*
 mp_input_get_cmd_from_keys(int n,int* keys, int paused) {
   char* cmd = NULL;
   mp_cmd_t* ret;
 
+  mp_input_load_bindings();
   if(cmd_binds)
     cmd = mp_input_find_bind_for_key(cmd_binds,n,keys);
   if(cmd_binds_default && cmd == NULL)
@@ -1752,13 +1758,19 @@ mp_input_get_section(void) {
   return section;
 }
 
-void
-mp_input_init(void) {
+static void
+mp_input_load_bindings(void) {
   char* file;
+  char* current;
+
+  if(!bindings_pending)
+    return;
+  bindings_pending = 0;
+  current = section ? strdup(section) : NULL;
 
   file = config_file[0] != '/' ? get_path(config_file) : config_file;
   if(!file)
-    return;
+    goto out;
 
   if( !mp_input_parse_config(file)) {
     // free file if it was allocated by get_path(),
@@ -1779,6 +1791,18 @@ mp_input_init(void) {
       free(file);
   }
 
+out:
+  // the section may have been changed before the bindings were loaded
+  mp_input_set_section(current);
+  free(current);
+}
+
+void
+mp_input_init_devices(void) {
+  if(!devices_pending)
+    return;
+  devices_pending = 0;
+
 #ifdef CONFIG_JOYSTICK
   if(use_joystick) {
     int fd = mp_input_joystick_init(js_dev);
@@ -1823,6 +1847,15 @@ mp_input_init(void) {
       mp_input_add_key_fd(fd,1,mp_input_appleir_read,(mp_close_func_t)close);
   }
 #endif
+}
+
+void
+mp_input_init(int lazy) {
+  bindings_pending = devices_pending = 1;
+  if(!lazy) {
+    mp_input_load_bindings();
+    mp_input_init_devices();
+  }
 
   if(in_file) {
     struct stat st;
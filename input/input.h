@@ -323,9 +323,15 @@ mp_input_set_section(char *name);
 char*
 mp_input_get_section(void);
 
-// When you create a new driver you should add it in these 2 functions.
+// With lazy set input.conf is only loaded when the first key is looked up
+// and the devices are left to mp_input_init_devices().
 void
-mp_input_init(void);
+mp_input_init(int lazy);
+
+// When you create a new driver you should add it in this function and
+// mp_input_uninit(). Does nothing if the devices are open already.
+void
+mp_input_init_devices(void);
 
 void
 mp_input_uninit(void);
@@ -123,6 +123,19 @@ af_instance_t* af_get(af_stream_t* s, char* name)
   return NULL;
 }
 
+#if HAVE_PTHREADS
+// Check if name is in the NULL terminated list
+static int af_in_list(char** list, const char* name)
+{
+  while(list && *list){
+    if(!strcmp(*list, name))
+      return 1;
+    list++;
+  }
+  return 0;
+}
+#endif
+
 /*/ Function for creating a new filter of type name. The name may
   contain the commandline parameters for the filter */
 static af_instance_t* af_create(af_stream_t* s, const char* name_with_cmd)
@@ -164,6 +177,11 @@ static af_instance_t* af_create(af_stream_t* s, const char* name_with_cmd)
       if(AF_ERROR>=new->control(new,AF_CONTROL_COMMAND_LINE,cmdline))
         goto err_out;
     }
+#if HAVE_PTHREADS
+    if(af_in_list(s->cfg.threads, name) && AF_OK != af_thread_init(new))
+      mp_msg(MSGT_AFILTER, MSGL_WARN, "[libaf] Couldn't start worker thread"
+	     " for audio filter '%s'\n", name);
+#endif
     free(name);
     return new;
   }
@@ -577,6 +595,37 @@ af_data_t* af_play(af_stream_t* s, af_data_t* data)
   return data;
 }
 
+af_data_t* af_play_final(af_stream_t* s, af_data_t* data)
+{
+  af_instance_t* af=s->first;
+  // Iterate through all filters, an empty chunk only reaches the threaded ones
+  do{
+#if HAVE_PTHREADS
+    if (af->thread) {
+      data=af_thread_drain(af,data);
+      af=af->next;
+      continue;
+    }
+#endif
+    if (data->len > 0)
+      data=af->play(af,data);
+    af=af->next;
+  }while(af && data);
+  return data;
+}
+
+void af_reset(af_stream_t* s)
+{
+#if HAVE_PTHREADS
+  af_instance_t* af=s->first;
+  while(af){
+    if(af->thread)
+      af_thread_reset(af);
+    af=af->next;
+  }
+#endif
+}
+
 /* Calculate the minimum output buffer size for given input data d
  * when using the RESIZE_LOCAL_BUFFER macro. The +t+1 part ensures the
  * value is >= len*mul rounded upwards to whole samples even if the
@@ -609,6 +658,9 @@ double af_calc_delay(af_stream_t* s)
   // Iterate through all filters
   while(af){
     delay += af->delay;
+#if HAVE_PTHREADS
+    delay += af_thread_delay(af);
+#endif
     delay *= af->mul;
     af=af->next;
   }
@@ -77,6 +77,7 @@ typedef struct af_instance_s
 		 * corresponding output */
   double mul; /* length multiplier: how much does this instance change
 		 the length of the buffer. */
+  struct af_thread_s* thread; // worker thread running play, see af_thread.c
 }af_instance_t;
 
 // Initialization flags
@@ -102,6 +103,7 @@ typedef struct af_cfg_s{
   int force;	// Initialization type
   char** list;	/* list of names of filters that are added to filter
 		   list during first initialization of stream */
+  char** threads; // names of filters that run on their own thread
 }af_cfg_t;
 
 // Current audio stream
@@ -202,6 +204,23 @@ af_instance_t* af_get(af_stream_t* s, char* name);
  */
 af_data_t* af_play(af_stream_t* s, af_data_t* data);
 
+/**
+ * \brief filter the last data chunk before the end of the input
+ * \param data data to play, may be empty
+ * \return resulting data
+ * \ingroup af_chain
+ *
+ * Like af_play(), but filters running on a worker thread also return the
+ * output they still hold back.
+ */
+af_data_t* af_play_final(af_stream_t* s, af_data_t* data);
+
+/**
+ * \brief drop the audio held back by the filters, e.g. after a seek
+ * \ingroup af_chain
+ */
+void af_reset(af_stream_t* s);
+
 /**
  * \brief send control to all filters, starting with the last until
  *        one accepts the command with AF_OK.
@@ -303,6 +322,36 @@ int af_test_output(struct af_instance_s* af, af_data_t* out);
  */
 float af_softclip(float a);
 
+/**
+ * \brief run the play function of a filter on a worker thread
+ * \param af audio filter, after it has been opened
+ * \return AF_OK on success, AF_ERROR otherwise
+ *
+ * The output lags the input by one chunk, see af_thread_delay().
+ */
+int af_thread_init(af_instance_t* af);
+
+/**
+ * \brief input bytes queued on the worker thread of a filter
+ * \param af audio filter
+ * \return delay in bytes, 0 if the filter does not use a thread
+ */
+double af_thread_delay(af_instance_t* af);
+
+/**
+ * \brief filter data and return it together with the queued output
+ * \param af audio filter that uses a thread
+ * \param data data to play, may be empty
+ * \return everything the filter has output for its input so far
+ */
+af_data_t* af_thread_drain(af_instance_t* af, af_data_t* data);
+
+/**
+ * \brief discard the chunk queued on the worker thread of a filter
+ * \param af audio filter that uses a thread
+ */
+void af_thread_reset(af_instance_t* af);
+
 /** \} */ // end of af_filter group, but more functions of this group below
 
 /** Print a list of all available audio filters */
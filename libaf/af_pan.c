@@ -33,8 +33,44 @@ typedef struct af_pan_s
 {
   int nch; // Number of output channels; zero means same as input
   float level[AF_NCH][AF_NCH];	// Gain level for each channel
+  int nchi; // Number of input channels the taps below were built for
+  int ntaps[AF_NCH];		// Number of non-zero gains per output channel
+  int tap[AF_NCH][AF_NCH];	// Input channel of each non-zero gain
+  float gain[AF_NCH][AF_NCH];	// Non-zero gains, in the same order as tap
+  int sse;			// Use the SSE downmix to stereo
+  float row[2][8];		// Zero padded level rows for the SSE downmix
 }af_pan_t;
 
+// Rebuild the list of non-zero gains after the levels or format changed
+static void update_taps(struct af_instance_s* af)
+{
+  af_pan_t* s = af->setup;
+  int nchi = s->nchi;
+  int ncho = af->data->nch;
+  int j,k;
+
+  for(j=0;j<ncho;j++){
+    s->ntaps[j] = 0;
+    for(k=0;k<nchi;k++){
+      if(s->level[j][k] != 0.0){
+        s->tap[j][s->ntaps[j]]  = k;
+        s->gain[j][s->ntaps[j]] = s->level[j][k];
+        s->ntaps[j]++;
+      }
+    }
+  }
+
+  s->sse = 0;
+#if HAVE_SSE
+  if(gCpuCaps.hasSSE && ncho == 2 && (nchi == 6 || nchi == 8)){
+    for(j=0;j<2;j++)
+      for(k=0;k<8;k++)
+        s->row[j][k] = k < nchi ? s->level[j][k] : 0.0;
+    s->sse = 1;
+  }
+#endif
+}
+
 // Initialization and runtime control
 static int control(struct af_instance_s* af, int cmd, void* arg)
 {
@@ -50,6 +86,8 @@ static int control(struct af_instance_s* af, int cmd, void* arg)
     af->data->bps    = 4;
     af->data->nch    = s->nch ? s->nch: ((af_data_t*)arg)->nch;
     af->mul          = (double)af->data->nch / ((af_data_t*)arg)->nch;
+    s->nchi          = ((af_data_t*)arg)->nch;
+    update_taps(af);
 
     if((af->data->format != ((af_data_t*)arg)->format) ||
        (af->data->bps != ((af_data_t*)arg)->bps)){
@@ -82,6 +120,7 @@ static int control(struct af_instance_s* af, int cmd, void* arg)
 	k++;
       }
     }
+    update_taps(af);
     return AF_OK;
   }
   case AF_CONTROL_PAN_LEVEL | AF_CONTROL_SET:{
@@ -92,6 +131,7 @@ static int control(struct af_instance_s* af, int cmd, void* arg)
       return AF_FALSE;
     for(i=0;i<AF_NCH;i++)
       s->level[ch][i] = level[i];
+    update_taps(af);
     return AF_OK;
   }
   case AF_CONTROL_PAN_LEVEL | AF_CONTROL_GET:{
@@ -128,6 +168,7 @@ static int control(struct af_instance_s* af, int cmd, void* arg)
       s->level[1][0] = max(0.f, -val);
       s->level[1][1] = min(1.f, 1.f + val);
     }
+    update_taps(af);
     return AF_OK;
   }
   case AF_CONTROL_PAN_BALANCE | AF_CONTROL_GET:
@@ -148,6 +189,61 @@ static void uninit(struct af_instance_s* af)
   free(af->setup);
 }
 
+#if HAVE_SSE
+/**
+ * Downmix 6 or 8 interleaved channels to stereo. Each frame is multiplied
+ * with both level rows and the two products are summed horizontally.
+ */
+static void downmix_stereo_sse(af_pan_t* s, float* in, float* out,
+                               int nchi, int frames)
+{
+  float* end = out + 2*frames;
+  if(!frames)
+    return;
+  __asm__ volatile(
+    "movups    %4, %%xmm4           \n\t"
+    "movups    %5, %%xmm5           \n\t"
+    "movups    %6, %%xmm6           \n\t"
+    "movups    %7, %%xmm7           \n\t"
+    "1:                             \n\t"
+    "movups     (%0), %%xmm0        \n\t"
+    "cmp       $8, %3               \n\t"
+    "je 2f                          \n\t"
+    "xorps     %%xmm1, %%xmm1       \n\t"
+    "movlps   16(%0), %%xmm1        \n\t"
+    "jmp 3f                         \n\t"
+    "2:                             \n\t"
+    "movups   16(%0), %%xmm1        \n\t"
+    "3:                             \n\t"
+    "movaps    %%xmm0, %%xmm2       \n\t"
+    "movaps    %%xmm1, %%xmm3       \n\t"
+    "mulps     %%xmm4, %%xmm0       \n\t"
+    "mulps     %%xmm5, %%xmm1       \n\t"
+    "mulps     %%xmm6, %%xmm2       \n\t"
+    "mulps     %%xmm7, %%xmm3       \n\t"
+    "addps     %%xmm1, %%xmm0       \n\t"
+    "addps     %%xmm3, %%xmm2       \n\t"
+    "movaps    %%xmm0, %%xmm1       \n\t"
+    "unpcklps  %%xmm2, %%xmm0       \n\t"
+    "unpckhps  %%xmm2, %%xmm1       \n\t"
+    "addps     %%xmm1, %%xmm0       \n\t"
+    "movhlps   %%xmm0, %%xmm1       \n\t"
+    "addps     %%xmm1, %%xmm0       \n\t"
+    "movlps    %%xmm0, (%1)         \n\t"
+    "lea      (%0,%3,4), %0         \n\t"
+    "add       $8, %1               \n\t"
+    "cmp       %2, %1               \n\t"
+    "jb 1b                          \n\t"
+    : "+&r"(in), "+&r"(out)
+    : "r"(end), "r"((intptr_t)nchi),
+      "m"(s->row[0][0]), "m"(s->row[0][4]),
+      "m"(s->row[1][0]), "m"(s->row[1][4])
+    : "memory", "xmm0", "xmm1", "xmm2", "xmm3",
+                "xmm4", "xmm5", "xmm6", "xmm7"
+  );
+}
+#endif
+
 // Filter data through filter
 static af_data_t* play(struct af_instance_s* af, af_data_t* data)
 {
@@ -165,14 +261,22 @@ static af_data_t* play(struct af_instance_s* af, af_data_t* data)
     return NULL;
 
   out = l->audio;
-  // Execute panning
-  // FIXME: Too slow
+  if(nchi != s->nchi){
+    s->nchi = nchi;
+    update_taps(af);
+  }
+#if HAVE_SSE
+  if(s->sse){
+    downmix_stereo_sse(s, in, out, nchi, (end - in) / nchi);
+    in = end;
+  }
+#endif
+  // Execute panning, skipping the channels with zero gain
   while(in < end){
     for(j=0;j<ncho;j++){
       register float  x   = 0.0;
-      register float* tin = in;
-      for(k=0;k<nchi;k++)
-	x += tin[k] * s->level[j][k];
+      for(k=0;k<s->ntaps[j];k++)
+	x += in[s->tap[j][k]] * s->gain[j][k];
       out[j] = x;
     }
     out+= ncho;
@@ -0,0 +1,242 @@
+/*
+ * Run the play function of an audio filter on a worker thread
+ *
+ * This file is part of MPlayer.
+ *
+ * MPlayer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with MPlayer; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* The filter is double buffered: every call to play() hands the new chunk
+   to the worker and returns the output of the chunk handed over by the
+   previous call. The output therefore lags one chunk behind the input,
+   which is reported by af_thread_delay(). At the end of the input
+   af_thread_drain() returns that chunk as well, af_thread_reset() drops it
+   after a seek. Control calls wait until the worker is idle, so the filter
+   never sees them while it is running. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mp_msg.h"
+#include "af.h"
+
+typedef struct af_thread_s
+{
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  int             busy;   // Worker is processing in
+  int             quit;   // Worker should exit
+  int             queued; // Input bytes handed over but not returned yet
+  af_data_t       in;     // Chunk processed by the worker
+  af_data_t*      result; // Output of the worker for in
+  af_data_t       out;    // Output returned to the filter chain
+  void*           inbuf;
+  void*           outbuf;
+  int             insize;
+  int             outsize;
+  // Original functions of the filter
+  int (*control)(struct af_instance_s* af, int cmd, void* arg);
+  void (*uninit)(struct af_instance_s* af);
+  af_data_t* (*play)(struct af_instance_s* af, af_data_t* data);
+}af_thread_t;
+
+static void* worker(void* arg)
+{
+  af_instance_t* af = arg;
+  af_thread_t*   t  = af->thread;
+  af_data_t*     result;
+
+  pthread_mutex_lock(&t->lock);
+  while(1){
+    while(!t->busy && !t->quit)
+      pthread_cond_wait(&t->cond, &t->lock);
+    if(t->quit)
+      break;
+    pthread_mutex_unlock(&t->lock);
+    result = t->play(af, &t->in);
+    pthread_mutex_lock(&t->lock);
+    t->result = result;
+    t->busy   = 0;
+    pthread_cond_broadcast(&t->cond);
+  }
+  pthread_mutex_unlock(&t->lock);
+  return NULL;
+}
+
+static void wait_idle(af_thread_t* t)
+{
+  pthread_mutex_lock(&t->lock);
+  while(t->busy)
+    pthread_cond_wait(&t->cond, &t->lock);
+  pthread_mutex_unlock(&t->lock);
+}
+
+// Make sure *buf can hold len bytes
+static int grow(void** buf, int* size, int len)
+{
+  if(*size < len){
+    void* p = realloc(*buf, len);
+    if(!p)
+      return AF_ERROR;
+    *buf  = p;
+    *size = len;
+  }
+  return AF_OK;
+}
+
+static int control(struct af_instance_s* af, int cmd, void* arg)
+{
+  af_thread_t* t = af->thread;
+  wait_idle(t);
+  // The format changes, whatever is still queued is of no use anymore
+  switch(cmd){
+  case AF_CONTROL_REINIT:
+    t->result = NULL;
+    t->queued = 0;
+    break;
+  }
+  return t->control(af, cmd, arg);
+}
+
+static void uninit(struct af_instance_s* af)
+{
+  af_thread_t* t = af->thread;
+  pthread_mutex_lock(&t->lock);
+  t->quit = 1;
+  pthread_cond_broadcast(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+  pthread_join(t->thread, NULL);
+  pthread_cond_destroy(&t->cond);
+  pthread_mutex_destroy(&t->lock);
+
+  t->uninit(af);
+  free(t->inbuf);
+  free(t->outbuf);
+  free(t);
+  af->thread = NULL;
+}
+
+// Wait for the worker and copy the output of the chunk it was given to out
+static int collect(struct af_instance_s* af)
+{
+  af_thread_t* t = af->thread;
+
+  wait_idle(t);
+  if(t->result){
+    if(AF_OK != grow(&t->outbuf, &t->outsize, t->result->len))
+      return AF_ERROR;
+    t->out = *t->result;
+    memcpy(t->outbuf, t->result->audio, t->result->len);
+    t->result = NULL;
+  }else{
+    t->out     = *af->data;
+    t->out.len = 0;
+  }
+  t->out.audio = t->outbuf;
+  t->queued    = 0;
+  return AF_OK;
+}
+
+static af_data_t* play(struct af_instance_s* af, af_data_t* data)
+{
+  af_thread_t* t = af->thread;
+
+  if(AF_OK != collect(af))
+    return NULL;
+
+  // Hand the new one to the worker
+  if(AF_OK != grow(&t->inbuf, &t->insize, data->len))
+    return NULL;
+  t->in       = *data;
+  t->in.audio = t->inbuf;
+  memcpy(t->inbuf, data->audio, data->len);
+  t->queued   = data->len;
+
+  pthread_mutex_lock(&t->lock);
+  t->busy = 1;
+  pthread_cond_broadcast(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+
+  return &t->out;
+}
+
+int af_thread_init(af_instance_t* af)
+{
+  af_thread_t* t = calloc(1, sizeof(af_thread_t));
+  if(!t)
+    return AF_ERROR;
+
+  t->control = af->control;
+  t->uninit  = af->uninit;
+  t->play    = af->play;
+  pthread_mutex_init(&t->lock, NULL);
+  pthread_cond_init(&t->cond, NULL);
+  af->thread = t;
+
+  if(pthread_create(&t->thread, NULL, worker, af)){
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+    af->thread = NULL;
+    return AF_ERROR;
+  }
+
+  af->control = control;
+  af->uninit  = uninit;
+  af->play    = play;
+  mp_msg(MSGT_AFILTER, MSGL_V, "[libaf] Running filter %s on a worker thread\n",
+	 af->info->name);
+  return AF_OK;
+}
+
+double af_thread_delay(af_instance_t* af)
+{
+  return af->thread ? af->thread->queued : 0.0;
+}
+
+af_data_t* af_thread_drain(af_instance_t* af, af_data_t* data)
+{
+  af_thread_t* t = af->thread;
+  af_data_t*   result;
+  int          len;
+
+  if(AF_OK != collect(af))
+    return NULL;
+  if(data->len <= 0)
+    return &t->out;
+
+  // The worker is idle, so the filter can run right here
+  result = t->play(af, data);
+  if(!result)
+    return NULL;
+  len = t->out.len;
+  if(AF_OK != grow(&t->outbuf, &t->outsize, len + result->len))
+    return NULL;
+  t->out       = *result;
+  t->out.audio = t->outbuf;
+  memcpy((char*)t->outbuf + len, result->audio, result->len);
+  t->out.len   = len + result->len;
+  return &t->out;
+}
+
+void af_thread_reset(af_instance_t* af)
+{
+  af_thread_t* t = af->thread;
+  wait_idle(t);
+  t->result = NULL;
+  t->queued = 0;
+}
@@ -75,6 +75,8 @@ typedef struct af_volume_s
     // "Ideal" level
     float mid_s16;
     float mid_float;
+    // Never scale a block above full scale
+    int limit;
 }af_volnorm_t;
 
 // Initialization and runtime control
@@ -101,7 +103,7 @@ static int control(struct af_instance_s* af, int cmd, void* arg)
   case AF_CONTROL_COMMAND_LINE:{
     int   i = 0;
     float target = DEFAULT_TARGET;
-    sscanf((char*)arg,"%d:%f", &i, &target);
+    sscanf((char*)arg,"%d:%f:%d", &i, &target, &s->limit);
     if (i != 1 && i != 2)
 	return AF_ERROR;
     s->method = i-1;
@@ -120,20 +122,229 @@ static void uninit(struct af_instance_s* af)
     free(af->setup);
 }
 
-static void method1_int16(af_volnorm_t *s, af_data_t *c)
+static const uint32_t __attribute__((aligned(16))) abs_mask[4] = {
+    0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff
+};
+
+/* Block helpers: return the sum of squares of a block and its peak
+   amplitude, and apply a gain to a block. The SIMD versions handle
+   multiples of 8 samples, the rest is done in C. */
+
+static float measure_int16(int16_t *data, int len, float *peak)
 {
   register int i = 0;
-  int16_t *data = (int16_t*)c->audio;	// Audio data
-  int len = c->len/2;		// Number of samples
-  float curavg = 0.0, newavg, neededmul;
-  int tmp;
+  float sum = 0.0;
+  int tmp, max = 0;
 
-  for (i = 0; i < len; i++)
+#if HAVE_SSE2
+  if (gCpuCaps.hasSSE2 && len >= 8)
+  {
+    // partial sums, maximum and minimum words
+    float tmpbuf[12];
+    int16_t *ext = (int16_t*)(tmpbuf + 4);
+    intptr_t n = len & ~7, j = 0;
+    __asm__ volatile(
+      "pxor      %%xmm4, %%xmm4         \n\t"
+      "pxor      %%xmm5, %%xmm5         \n\t"
+      "xorps     %%xmm6, %%xmm6         \n\t"
+      "xorps     %%xmm7, %%xmm7         \n\t"
+      "1:                               \n\t"
+      "movdqu    (%1,%0,2), %%xmm0      \n\t"
+      "pmaxsw    %%xmm0, %%xmm4         \n\t"
+      "pminsw    %%xmm0, %%xmm5         \n\t"
+      "punpcklwd %%xmm0, %%xmm1         \n\t"
+      "punpckhwd %%xmm0, %%xmm2         \n\t"
+      "psrad     $16, %%xmm1            \n\t"
+      "psrad     $16, %%xmm2            \n\t"
+      "cvtdq2ps  %%xmm1, %%xmm1         \n\t"
+      "cvtdq2ps  %%xmm2, %%xmm2         \n\t"
+      "mulps     %%xmm1, %%xmm1         \n\t"
+      "mulps     %%xmm2, %%xmm2         \n\t"
+      "addps     %%xmm1, %%xmm6         \n\t"
+      "addps     %%xmm2, %%xmm7         \n\t"
+      "add       $8, %0                 \n\t"
+      "cmp       %2, %0                 \n\t"
+      "jb 1b                            \n\t"
+      "addps     %%xmm7, %%xmm6         \n\t"
+      "movups    %%xmm6,   (%3)         \n\t"
+      "movdqu    %%xmm4, 16(%3)         \n\t"
+      "movdqu    %%xmm5, 32(%3)         \n\t"
+      : "+&r"(j)
+      : "r"(data), "r"(n), "r"(tmpbuf)
+      : "memory", "xmm0", "xmm1", "xmm2",
+                  "xmm4", "xmm5", "xmm6", "xmm7"
+    );
+    sum = tmpbuf[0] + tmpbuf[1] + tmpbuf[2] + tmpbuf[3];
+    for (j = 0; j < 8; j++)
+    {
+      max = max(max,  ext[j]);
+      max = max(max, -ext[j + 8]);
+    }
+    i = n;
+  }
+#endif
+  for (; i < len; i++)
   {
     tmp = data[i];
-    curavg += tmp * tmp;
+    sum += tmp * tmp;
+    max = max(max, abs(tmp));
   }
-  curavg = sqrt(curavg / (float) len);
+  *peak = max;
+  return sum;
+}
+
+static float measure_float(float *data, int len, float *peak)
+{
+  register int i = 0;
+  float sum = 0.0, max = 0.0, tmp;
+
+#if HAVE_SSE
+  if (gCpuCaps.hasSSE && len >= 8)
+  {
+    // partial sums and maximum magnitudes
+    float tmpbuf[8];
+    intptr_t n = len & ~7, j = 0;
+    __asm__ volatile(
+      "movups    %4, %%xmm3             \n\t"
+      "xorps     %%xmm4, %%xmm4         \n\t"
+      "xorps     %%xmm5, %%xmm5         \n\t"
+      "xorps     %%xmm6, %%xmm6         \n\t"
+      "xorps     %%xmm7, %%xmm7         \n\t"
+      "1:                               \n\t"
+      "movups      (%1,%0,4), %%xmm0    \n\t"
+      "movups    16(%1,%0,4), %%xmm1    \n\t"
+      "movaps    %%xmm0, %%xmm2         \n\t"
+      "andps     %%xmm3, %%xmm2         \n\t"
+      "maxps     %%xmm2, %%xmm4         \n\t"
+      "movaps    %%xmm1, %%xmm2         \n\t"
+      "andps     %%xmm3, %%xmm2         \n\t"
+      "maxps     %%xmm2, %%xmm5         \n\t"
+      "mulps     %%xmm0, %%xmm0         \n\t"
+      "mulps     %%xmm1, %%xmm1         \n\t"
+      "addps     %%xmm0, %%xmm6         \n\t"
+      "addps     %%xmm1, %%xmm7         \n\t"
+      "add       $8, %0                 \n\t"
+      "cmp       %2, %0                 \n\t"
+      "jb 1b                            \n\t"
+      "addps     %%xmm7, %%xmm6         \n\t"
+      "maxps     %%xmm5, %%xmm4         \n\t"
+      "movups    %%xmm6,   (%3)         \n\t"
+      "movups    %%xmm4, 16(%3)         \n\t"
+      : "+&r"(j)
+      : "r"(data), "r"(n), "r"(tmpbuf), "m"(*abs_mask)
+      : "memory", "xmm0", "xmm1", "xmm2", "xmm3",
+                  "xmm4", "xmm5", "xmm6", "xmm7"
+    );
+    sum = tmpbuf[0] + tmpbuf[1] + tmpbuf[2] + tmpbuf[3];
+    for (j = 4; j < 8; j++)
+      max = max(max, tmpbuf[j]);
+    i = n;
+  }
+#endif
+  for (; i < len; i++)
+  {
+    tmp = data[i];
+    sum += tmp * tmp;
+    max = max(max, fabsf(tmp));
+  }
+  *peak = max;
+  return sum;
+}
+
+static void scale_int16(int16_t *data, int len, float mul)
+{
+  register int i = 0;
+  int tmp;
+
+#if HAVE_SSE2
+  if (gCpuCaps.hasSSE2 && len >= 8)
+  {
+    intptr_t n = len & ~7, j = 0;
+    // packssdw does the clamping
+    __asm__ volatile(
+      "movss     %3, %%xmm3             \n\t"
+      "shufps    $0, %%xmm3, %%xmm3     \n\t"
+      "1:                               \n\t"
+      "movdqu    (%1,%0,2), %%xmm0      \n\t"
+      "punpcklwd %%xmm0, %%xmm1         \n\t"
+      "punpckhwd %%xmm0, %%xmm2         \n\t"
+      "psrad     $16, %%xmm1            \n\t"
+      "psrad     $16, %%xmm2            \n\t"
+      "cvtdq2ps  %%xmm1, %%xmm1         \n\t"
+      "cvtdq2ps  %%xmm2, %%xmm2         \n\t"
+      "mulps     %%xmm3, %%xmm1         \n\t"
+      "mulps     %%xmm3, %%xmm2         \n\t"
+      "cvttps2dq %%xmm1, %%xmm1         \n\t"
+      "cvttps2dq %%xmm2, %%xmm2         \n\t"
+      "packssdw  %%xmm2, %%xmm1         \n\t"
+      "movdqu    %%xmm1, (%1,%0,2)      \n\t"
+      "add       $8, %0                 \n\t"
+      "cmp       %2, %0                 \n\t"
+      "jb 1b                            \n\t"
+      : "+&r"(j)
+      : "r"(data), "r"(n), "m"(mul)
+      : "memory", "xmm0", "xmm1", "xmm2", "xmm3"
+    );
+    i = n;
+  }
+#endif
+  for (; i < len; i++)
+  {
+    tmp = mul * data[i];
+    tmp = clamp(tmp, SHRT_MIN, SHRT_MAX);
+    data[i] = tmp;
+  }
+}
+
+static void scale_float(float *data, int len, float mul)
+{
+  register int i = 0;
+
+#if HAVE_SSE
+  if (gCpuCaps.hasSSE && len >= 8)
+  {
+    intptr_t n = len & ~7, j = 0;
+    __asm__ volatile(
+      "movss     %3, %%xmm3             \n\t"
+      "shufps    $0, %%xmm3, %%xmm3     \n\t"
+      "1:                               \n\t"
+      "movups      (%1,%0,4), %%xmm0    \n\t"
+      "movups    16(%1,%0,4), %%xmm1    \n\t"
+      "mulps     %%xmm3, %%xmm0         \n\t"
+      "mulps     %%xmm3, %%xmm1         \n\t"
+      "movups    %%xmm0,   (%1,%0,4)    \n\t"
+      "movups    %%xmm1, 16(%1,%0,4)    \n\t"
+      "add       $8, %0                 \n\t"
+      "cmp       %2, %0                 \n\t"
+      "jb 1b                            \n\t"
+      : "+&r"(j)
+      : "r"(data), "r"(n), "m"(mul)
+      : "memory", "xmm0", "xmm1", "xmm3"
+    );
+    i = n;
+  }
+#endif
+  for (; i < len; i++)
+    data[i] *= mul;
+}
+
+/* Gain actually applied to a block: with the limiter enabled the block
+   peak must not go above full scale. The block is measured before it is
+   scaled, so this acts as a limiter with one block of lookahead. */
+static float block_gain(af_volnorm_t *s, float peak, float full)
+{
+  if (s->limit && peak * s->mul > full)
+    return full / peak;
+  return s->mul;
+}
+
+static void method1_int16(af_volnorm_t *s, af_data_t *c)
+{
+  int16_t *data = (int16_t*)c->audio;	// Audio data
+  int len = c->len/2;		// Number of samples
+  float curavg, newavg, neededmul, peak;
+
+  curavg = sqrt(measure_int16(data, len, &peak) / (float) len);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -148,12 +359,7 @@ static void method1_int16(af_volnorm_t *s, af_data_t *c)
   }
 
   // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-  {
-    tmp = s->mul * data[i];
-    tmp = clamp(tmp, SHRT_MIN, SHRT_MAX);
-    data[i] = tmp;
-  }
+  scale_int16(data, len, block_gain(s, peak, SHRT_MAX));
 
   // Evaulation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
@@ -164,17 +370,11 @@ static void method1_int16(af_volnorm_t *s, af_data_t *c)
 
 static void method1_float(af_volnorm_t *s, af_data_t *c)
 {
-  register int i = 0;
   float *data = (float*)c->audio;	// Audio data
   int len = c->len/4;		// Number of samples
-  float curavg = 0.0, newavg, neededmul, tmp;
+  float curavg, newavg, neededmul, peak;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = sqrt(measure_float(data, len, &peak) / (float) len);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -189,8 +389,7 @@ static void method1_float(af_volnorm_t *s, af_data_t *c)
   }
 
   // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-    data[i] *= s->mul;
+  scale_float(data, len, block_gain(s, peak, 1.0));
 
   // Evaulation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
@@ -204,15 +403,10 @@ static void method2_int16(af_volnorm_t *s, af_data_t *c)
   register int i = 0;
   int16_t *data = (int16_t*)c->audio;	// Audio data
   int len = c->len/2;		// Number of samples
-  float curavg = 0.0, newavg, avg = 0.0;
-  int tmp, totallen = 0;
+  float curavg, newavg, avg = 0.0, peak;
+  int totallen = 0;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = sqrt(measure_int16(data, len, &peak) / (float) len);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -233,12 +427,7 @@ static void method2_int16(af_volnorm_t *s, af_data_t *c)
   }
 
   // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-  {
-    tmp = s->mul * data[i];
-    tmp = clamp(tmp, SHRT_MIN, SHRT_MAX);
-    data[i] = tmp;
-  }
+  scale_int16(data, len, block_gain(s, peak, SHRT_MAX));
 
   // Evaulation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
@@ -254,15 +443,10 @@ static void method2_float(af_volnorm_t *s, af_data_t *c)
   register int i = 0;
   float *data = (float*)c->audio;	// Audio data
   int len = c->len/4;		// Number of samples
-  float curavg = 0.0, newavg, avg = 0.0, tmp;
+  float curavg, newavg, avg = 0.0, peak;
   int totallen = 0;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  curavg = sqrt(measure_float(data, len, &peak) / (float) len);
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
@@ -283,8 +467,7 @@ static void method2_float(af_volnorm_t *s, af_data_t *c)
   }
 
   // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-    data[i] *= s->mul;
+  scale_float(data, len, block_gain(s, peak, 1.0));
 
   // Evaulation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
+#include "config.h"
+#include "cpudetect.h"
 #include "libvo/fastmemcpy.h"
 
 #include "reorder_ch.h"
@@ -35,6 +37,132 @@
 #endif
 
 
+#if HAVE_SSE2
+/**
+ * Exchange the C LFE and Ls Rs channel pairs, which is the conversion
+ * between AF_CHANNEL_LAYOUT_5_1_A/B and AF_CHANNEL_LAYOUT_7_1_A/B.
+ * dest may equal src. Only whole blocks are processed, the number of
+ * samples done is returned and the rest is left to the C code.
+ */
+static int reorder_swap_pairs_sse2(void *dest, const void *src, int chnum,
+                                   int samples, int samplesize)
+{
+    const uint8_t *s = src;
+    uint8_t *d = dest;
+    intptr_t i = 0;
+    intptr_t len;
+
+    switch (chnum << 4 | samplesize) {
+    case 6 << 4 | 2:
+        // 4 frames of 3 dwords: 0 2 1 3 | 5 4 6 8 | 7 9 11 10
+        len = samples * 2 / 48 * 48;
+        if (!len)
+            return 0;
+        __asm__ volatile(
+            "1:                              \n\t"
+            "movdqu    (%1,%0), %%xmm0       \n\t"
+            "movdqu  16(%1,%0), %%xmm1       \n\t"
+            "movdqu  32(%1,%0), %%xmm2       \n\t"
+            "pshufd  $0xD8, %%xmm0, %%xmm0   \n\t"
+            "movaps  %%xmm1, %%xmm3          \n\t"
+            "shufps  $0x4E, %%xmm2, %%xmm3   \n\t"
+            "shufps  $0x81, %%xmm3, %%xmm1   \n\t"
+            "shufps  $0xBD, %%xmm2, %%xmm3   \n\t"
+            "movdqu  %%xmm0,   (%2,%0)       \n\t"
+            "movdqu  %%xmm1, 16(%2,%0)       \n\t"
+            "movdqu  %%xmm3, 32(%2,%0)       \n\t"
+            "add        $48, %0              \n\t"
+            "cmp         %3, %0              \n\t"
+            "jb 1b                           \n\t"
+            : "+&r"(i)
+            : "r"(s), "r"(d), "r"(len)
+            : "memory", "xmm0", "xmm1", "xmm2", "xmm3"
+        );
+        return len / 2;
+    case 6 << 4 | 4:
+        // 2 frames of 3 qwords: 0 2 | 1 3 | 5 4
+        len = samples * 4 / 48 * 48;
+        if (!len)
+            return 0;
+        __asm__ volatile(
+            "1:                              \n\t"
+            "movdqu    (%1,%0), %%xmm0       \n\t"
+            "movdqu  16(%1,%0), %%xmm1       \n\t"
+            "movdqu  32(%1,%0), %%xmm2       \n\t"
+            "movdqa  %%xmm0, %%xmm3          \n\t"
+            "punpcklqdq %%xmm1, %%xmm0       \n\t"
+            "shufpd  $3, %%xmm1, %%xmm3      \n\t"
+            "pshufd  $0x4E, %%xmm2, %%xmm2   \n\t"
+            "movdqu  %%xmm0,   (%2,%0)       \n\t"
+            "movdqu  %%xmm3, 16(%2,%0)       \n\t"
+            "movdqu  %%xmm2, 32(%2,%0)       \n\t"
+            "add        $48, %0              \n\t"
+            "cmp         %3, %0              \n\t"
+            "jb 1b                           \n\t"
+            : "+&r"(i)
+            : "r"(s), "r"(d), "r"(len)
+            : "memory", "xmm0", "xmm1", "xmm2", "xmm3"
+        );
+        return len / 4;
+    case 8 << 4 | 2:
+        // 1 frame of 4 dwords: 0 2 1 3
+        len = samples * 2 / 16 * 16;
+        if (!len)
+            return 0;
+        __asm__ volatile(
+            "1:                              \n\t"
+            "movdqu    (%1,%0), %%xmm0       \n\t"
+            "pshufd  $0xD8, %%xmm0, %%xmm0   \n\t"
+            "movdqu  %%xmm0,   (%2,%0)       \n\t"
+            "add        $16, %0              \n\t"
+            "cmp         %3, %0              \n\t"
+            "jb 1b                           \n\t"
+            : "+&r"(i)
+            : "r"(s), "r"(d), "r"(len)
+            : "memory", "xmm0"
+        );
+        return len / 2;
+    case 8 << 4 | 4:
+        // 1 frame of 4 qwords: 0 2 | 1 3
+        len = samples * 4 / 32 * 32;
+        if (!len)
+            return 0;
+        __asm__ volatile(
+            "1:                              \n\t"
+            "movdqu    (%1,%0), %%xmm0       \n\t"
+            "movdqu  16(%1,%0), %%xmm1       \n\t"
+            "movdqa  %%xmm0, %%xmm2          \n\t"
+            "punpcklqdq %%xmm1, %%xmm0       \n\t"
+            "punpckhqdq %%xmm1, %%xmm2       \n\t"
+            "movdqu  %%xmm0,   (%2,%0)       \n\t"
+            "movdqu  %%xmm2, 16(%2,%0)       \n\t"
+            "add        $32, %0              \n\t"
+            "cmp         %3, %0              \n\t"
+            "jb 1b                           \n\t"
+            : "+&r"(i)
+            : "r"(s), "r"(d), "r"(len)
+            : "memory", "xmm0", "xmm1", "xmm2"
+        );
+        return len / 4;
+    }
+    return 0;
+}
+#endif
+
+/**
+ * Vectorized part of the 5.1/7.1 A<->B reorder, returns the number of
+ * samples already converted.
+ */
+static int reorder_swap_pairs(void *dest, const void *src, int chnum,
+                              int samples, int samplesize)
+{
+#if HAVE_SSE2
+    if (gCpuCaps.hasSSE2)
+        return reorder_swap_pairs_sse2(dest, src, chnum, samples, samplesize);
+#endif
+    return 0;
+}
+
 #define REORDER_COPY_5(DEST,SRC,SAMPLES,S0,S1,S2,S3,S4) \
 for (i = 0; i < SAMPLES; i += 5) {\
     DEST[i]   = SRC[i+S0];\
@@ -284,6 +412,7 @@ void reorder_channel_copy(void *src,
                           int samples,
                           int samplesize)
 {
+    int done;
     if (dest_layout==src_layout) {
         fast_memcpy(dest, src, samples*samplesize);
         return;
@@ -342,7 +471,11 @@ void reorder_channel_copy(void *src,
     // AF_CHANNEL_LAYOUT_5_1_D   C L R Ls Rs LFE
     // AF_CHANNEL_LAYOUT_5_1_E   LFE L C R Ls Rs
     case AF_CHANNEL_LAYOUT_5_1_A << 16 | AF_CHANNEL_LAYOUT_5_1_B:
-        reorder_copy_6ch(dest, src, samples, samplesize, 0, 1, 4, 5, 2, 3);
+    case AF_CHANNEL_LAYOUT_5_1_B << 16 | AF_CHANNEL_LAYOUT_5_1_A:
+        done = reorder_swap_pairs(dest, src, 6, samples, samplesize);
+        reorder_copy_6ch((uint8_t *)dest + done * samplesize,
+                         (uint8_t *)src + done * samplesize,
+                         samples - done, samplesize, 0, 1, 4, 5, 2, 3);
         break;
     case AF_CHANNEL_LAYOUT_5_1_A << 16 | AF_CHANNEL_LAYOUT_5_1_C:
         reorder_copy_6ch(dest, src, samples, samplesize, 0, 2, 1, 4, 5, 3);
@@ -350,9 +483,6 @@ void reorder_channel_copy(void *src,
     case AF_CHANNEL_LAYOUT_5_1_A << 16 | AF_CHANNEL_LAYOUT_5_1_D:
         reorder_copy_6ch(dest, src, samples, samplesize, 2, 0, 1, 4, 5, 3);
         break;
-    case AF_CHANNEL_LAYOUT_5_1_B << 16 | AF_CHANNEL_LAYOUT_5_1_A:
-        reorder_copy_6ch(dest, src, samples, samplesize, 0, 1, 4, 5, 2, 3);
-        break;
     case AF_CHANNEL_LAYOUT_5_1_B << 16 | AF_CHANNEL_LAYOUT_5_1_C:
         reorder_copy_6ch(dest, src, samples, samplesize, 0, 4, 1, 2, 3, 5);
         break;
@@ -391,7 +521,10 @@ void reorder_channel_copy(void *src,
     // AF_CHANNEL_LAYOUT_7_1_D   C L R Ls Rs Rls Rrs LFE
     case AF_CHANNEL_LAYOUT_7_1_A << 16 | AF_CHANNEL_LAYOUT_7_1_B:
     case AF_CHANNEL_LAYOUT_7_1_B << 16 | AF_CHANNEL_LAYOUT_7_1_A:
-        reorder_copy_8ch(dest, src, samples, samplesize, 0, 1, 4, 5, 2, 3, 6, 7);
+        done = reorder_swap_pairs(dest, src, 8, samples, samplesize);
+        reorder_copy_8ch((uint8_t *)dest + done * samplesize,
+                         (uint8_t *)src + done * samplesize,
+                         samples - done, samplesize, 0, 1, 4, 5, 2, 3, 6, 7);
         break;
     case AF_CHANNEL_LAYOUT_7_1_D << 16 | AF_CHANNEL_LAYOUT_7_1_B:
         reorder_copy_8ch(dest, src, samples, samplesize, 1, 2, 3, 4, 0, 7, 5, 6);
@@ -1152,6 +1285,7 @@ void reorder_channel(void *src,
                      int samples,
                      int samplesize)
 {
+    int done;
     if (dest_layout==src_layout)
         return;
     if (!AF_IS_SAME_CH_NUM(dest_layout,src_layout)) {
@@ -1209,6 +1343,10 @@ void reorder_channel(void *src,
     // AF_CHANNEL_LAYOUT_5_1_D   C L R Ls Rs LFE
     // AF_CHANNEL_LAYOUT_5_1_E   LFE L C R Ls Rs
     case AF_CHANNEL_LAYOUT_5_1_A << 16 | AF_CHANNEL_LAYOUT_5_1_B:
+    case AF_CHANNEL_LAYOUT_5_1_B << 16 | AF_CHANNEL_LAYOUT_5_1_A:
+        done = reorder_swap_pairs(src, src, 6, samples, samplesize);
+        src = (uint8_t *)src + done * samplesize;
+        samples -= done;
         if (samplesize != 3)
             reorder_self_2(src, samples/2, samplesize*2, 3, 1, 2);
         else
@@ -1220,12 +1358,6 @@ void reorder_channel(void *src,
     case AF_CHANNEL_LAYOUT_5_1_A << 16 | AF_CHANNEL_LAYOUT_5_1_D:
         reorder_self_3_3(src, samples, samplesize, 2, 1, 0, 3, 4, 5);
         break;
-    case AF_CHANNEL_LAYOUT_5_1_B << 16 | AF_CHANNEL_LAYOUT_5_1_A:
-        if (samplesize != 3)
-            reorder_self_2(src, samples/2, samplesize*2, 3, 1, 2);
-        else
-            reorder_self_4_step_2(src, samples, samplesize, 6, 2, 3, 4, 5);
-        break;
     case AF_CHANNEL_LAYOUT_5_1_B << 16 | AF_CHANNEL_LAYOUT_5_1_C:
         reorder_self_4_step_1(src, samples, samplesize, 6, 4, 3, 2, 1);
         break;
@@ -1266,6 +1398,9 @@ void reorder_channel(void *src,
     // AF_CHANNEL_LAYOUT_7_1_F   C L R LFE Ls Rs Rls Rrs
     case AF_CHANNEL_LAYOUT_7_1_A << 16 | AF_CHANNEL_LAYOUT_7_1_B:
     case AF_CHANNEL_LAYOUT_7_1_B << 16 | AF_CHANNEL_LAYOUT_7_1_A:
+        done = reorder_swap_pairs(src, src, 8, samples, samplesize);
+        src = (uint8_t *)src + done * samplesize;
+        samples -= done;
         if (samplesize != 3)
             reorder_self_2(src, samples/2, samplesize*2, 4, 1, 2);
         else
@@ -192,6 +192,14 @@ void ass_set_use_margins(ASS_Renderer *priv, int use);
  */
 void ass_set_aspect_ratio(ASS_Renderer *priv, double dar, double sar);
 
+/**
+ * \brief Approximate the gaussian blur (\\blur) with three box blurs.
+ * Much faster for large radii, but not exactly the same look.
+ * \param priv renderer handle
+ * \param fast 1 to enable, 0 to disable (default)
+ */
+void ass_set_fast_blur(ASS_Renderer *priv, int fast);
+
 /**
  * \brief Set a fixed font scaling factor.
  * \param priv renderer handle
@@ -245,11 +253,24 @@ int ass_fonts_update(ASS_Renderer *priv);
  *
  * \param priv renderer handle
  * \param glyph_max maximum number of cached glyphs
- * \param bitmap_max_size maximum bitmap cache size (in MB)
+ * \param bitmap_max_size maximum bitmap cache size (in MB), the cache of
+ * composited bitmaps may use another quarter of this
+ * When a limit is exceeded, the least recently used entries are evicted.
  */
 void ass_set_cache_limits(ASS_Renderer *priv, int glyph_max,
                           int bitmap_max_size);
 
+/**
+ * \brief Set the number of threads used to blur rendered glyphs.
+ * Glyphs of an event are still rasterized and composed by the calling
+ * thread. Has no effect if libass was built without thread support.
+ *
+ * \param priv renderer handle
+ * \param threads number of threads including the calling one, 0 or 1 to
+ * blur serially (default)
+ */
+void ass_set_threads(ASS_Renderer *priv, int threads);
+
 /**
  * \brief Render a frame, producing a list of ASS_Image.
  * \param priv renderer handle
@@ -25,8 +25,12 @@
 #include FT_GLYPH_H
 #include FT_OUTLINE_H
 
+#include "config.h"
 #include "ass_utils.h"
 #include "ass_bitmap.h"
+#if HAVE_SSE2
+#include "cpudetect.h"
+#endif
 
 struct ass_synth_priv {
     int tmp_w, tmp_h;
@@ -37,8 +41,12 @@ struct ass_synth_priv {
 
     unsigned *g;
     unsigned *gt2;
+    unsigned short *gw;         // g with every value repeated 8 times
 
     double radius;
+
+    unsigned char *buf;         // scratch space of the SIMD and box blurs
+    int buf_size;
 };
 
 static const unsigned int maxcolor = 255;
@@ -96,6 +104,17 @@ static int generate_tables(ASS_SynthPriv *priv, double radius)
                 priv->gt2[mx + i * priv->g_w] = i * priv->g[mx];
             }
         }
+
+#if HAVE_SSE2
+        priv->gw = realloc(priv->gw, 8 * priv->g_w * sizeof(unsigned short));
+        if (priv->gw == NULL)
+            return -1;
+        for (mx = 0; mx < priv->g_w; mx++) {
+            for (i = 0; i < 8; i++) {
+                priv->gw[8 * mx + i] = priv->g[mx];
+            }
+        }
+#endif
     }
 
     return 0;
@@ -129,6 +148,8 @@ void ass_synth_done(ASS_SynthPriv *priv)
     free(priv->tmp);
     free(priv->g);
     free(priv->gt2);
+    free(priv->gw);
+    free(priv->buf);
     free(priv);
 }
 
@@ -152,15 +173,6 @@ void ass_free_bitmap(Bitmap *bm)
     free(bm);
 }
 
-static Bitmap *copy_bitmap(const Bitmap *src)
-{
-    Bitmap *dst = alloc_bitmap(src->w, src->h);
-    dst->left = src->left;
-    dst->top = src->top;
-    memcpy(dst->buffer, src->buffer, src->stride * src->h);
-    return dst;
-}
-
 Bitmap *outline_to_bitmap(ASS_Library *library, FT_Library ftlib,
                           FT_Outline *outline, int bord)
 {
@@ -301,10 +313,12 @@ static void shift_bitmap(Bitmap *bm, int shift_x, int shift_y)
 
 /*
  * Gaussian blur.  An fast pure C implementation from MPlayer.
+ * The horizontal pass writes to tmp2, the vertical one works in place on
+ * it; output column x ends up one word left of input column x.
  */
-static void ass_gauss_blur(unsigned char *buffer, unsigned short *tmp2,
-                           int width, int height, int stride, int *m2,
-                           int r, int mwidth)
+static void gauss_blur_rows(unsigned char *buffer, unsigned short *tmp2,
+                            int width, int height, int stride, int *m2,
+                            int r, int mwidth)
 {
 
     int x, y;
@@ -354,9 +368,15 @@ static void ass_gauss_blur(unsigned char *buffer, unsigned short *tmp2,
         s += stride;
         t += width + 1;
     }
+}
 
-    t = tmp2;
-    for (x = 0; x < width; x++) {
+static void gauss_blur_columns(unsigned short *tmp2, int x0, int width,
+                               int height, int *m2, int r, int mwidth)
+{
+    int x, y;
+    unsigned short *t = tmp2 + x0;
+
+    for (x = x0; x < width; x++) {
         for (y = 0; y < r; y++) {
             unsigned short *srcp = t + y * (width + 1) + 1;
             int src = *srcp;
@@ -408,9 +428,15 @@ static void ass_gauss_blur(unsigned char *buffer, unsigned short *tmp2,
         }
         t++;
     }
+}
+
+static void gauss_blur_store(unsigned char *buffer, unsigned short *tmp2,
+                             int width, int height, int stride)
+{
+    int x, y;
+    unsigned char *s = buffer;
+    unsigned short *t = tmp2;
 
-    t = tmp2;
-    s = buffer;
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
             s[x] = t[x] >> 8;
@@ -420,11 +446,370 @@ static void ass_gauss_blur(unsigned char *buffer, unsigned short *tmp2,
     }
 }
 
+static void ass_gauss_blur(unsigned char *buffer, unsigned short *tmp2,
+                           int width, int height, int stride, int *m2,
+                           int r, int mwidth)
+{
+    gauss_blur_rows(buffer, tmp2, width, height, stride, m2, r, mwidth);
+    gauss_blur_columns(tmp2, 0, width, height, m2, r, mwidth);
+    gauss_blur_store(buffer, tmp2, width, height, stride);
+}
+
+// Make sure the scratch buffer holds at least size bytes
+static unsigned char *get_buf(ASS_SynthPriv *priv, int size)
+{
+    if (priv->buf_size < size) {
+        free(priv->buf);
+        priv->buf = malloc(size);
+        priv->buf_size = priv->buf ? size : 0;
+    }
+    return priv->buf;
+}
+
+#if HAVE_SSE2
+/*
+ * SSE2 versions of the blurs, bit exact to the C ones.
+ */
+
+// dst[i] = (a[i] + 2 * b[i] + c[i]) >> 2 for n bytes, n a multiple of 16
+static void be_blur_line_sse2(unsigned char *dst, const unsigned char *a,
+                              const unsigned char *b, const unsigned char *c,
+                              int n)
+{
+    intptr_t i = -n;
+
+    if (n <= 0)
+        return;
+    __asm__ volatile(
+        "pxor          %%xmm7, %%xmm7 \n\t"
+        "1:                           \n\t"
+        "movdqu     (%2,%0), %%xmm0   \n\t"
+        "movdqu     (%3,%0), %%xmm2   \n\t"
+        "movdqu     (%4,%0), %%xmm4   \n\t"
+        "movdqa        %%xmm0, %%xmm1 \n\t"
+        "movdqa        %%xmm2, %%xmm3 \n\t"
+        "movdqa        %%xmm4, %%xmm5 \n\t"
+        "punpcklbw     %%xmm7, %%xmm0 \n\t"
+        "punpckhbw     %%xmm7, %%xmm1 \n\t"
+        "punpcklbw     %%xmm7, %%xmm2 \n\t"
+        "punpckhbw     %%xmm7, %%xmm3 \n\t"
+        "punpcklbw     %%xmm7, %%xmm4 \n\t"
+        "punpckhbw     %%xmm7, %%xmm5 \n\t"
+        "psllw             $1, %%xmm2 \n\t"
+        "psllw             $1, %%xmm3 \n\t"
+        "paddw         %%xmm2, %%xmm0 \n\t"
+        "paddw         %%xmm3, %%xmm1 \n\t"
+        "paddw         %%xmm4, %%xmm0 \n\t"
+        "paddw         %%xmm5, %%xmm1 \n\t"
+        "psrlw             $2, %%xmm0 \n\t"
+        "psrlw             $2, %%xmm1 \n\t"
+        "packuswb      %%xmm1, %%xmm0 \n\t"
+        "movdqu        %%xmm0, (%1,%0)\n\t"
+        "add              $16, %0     \n\t"
+        "jl 1b                        \n\t"
+        : "+&r"(i)
+        : "r"(dst + n), "r"(a + n), "r"(b + n), "r"(c + n)
+        : "memory", "xmm0", "xmm1", "xmm2", "xmm3",
+                    "xmm4", "xmm5", "xmm7");
+}
+
+/*
+ * Rows are blurred from a copy padded with the first pixel, columns with
+ * copies of the unmodified previous and current row. lines holds 2 * w
+ * bytes.
+ */
+static void be_blur_sse2(Bitmap *bm, unsigned char *lines)
+{
+    int w = bm->w;
+    int h = bm->h;
+    int s = bm->stride;
+    unsigned char *buf = bm->buffer;
+    unsigned char *prev = lines, *cur = lines + w;
+    int n = (w - 1) & ~15;
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        unsigned char *row = buf + y * s;
+        lines[0] = row[0];
+        memcpy(lines + 1, row, w);
+        be_blur_line_sse2(row, lines, lines + 1, lines + 2, n);
+        for (x = n; x < w - 1; x++)
+            row[x] = (lines[x] + 2 * lines[x + 1] + lines[x + 2]) >> 2;
+    }
+
+    n = w & ~15;
+    memcpy(prev, buf, w);
+    for (y = 0; y < h - 1; y++) {
+        unsigned char *row = buf + y * s;
+        unsigned char *tmp;
+        memcpy(cur, row, w);
+        be_blur_line_sse2(row, prev, cur, row + s, n);
+        for (x = n; x < w; x++)
+            row[x] = (prev[x] + 2 * cur[x] + row[s + x]) >> 2;
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+}
+
+/*
+ * Horizontal gaussian pass. It gathers instead of scattering, the kernel
+ * is symmetric. line holds the row with r zeros on either side.
+ */
+static void gauss_blur_rows_sse2(ASS_SynthPriv *priv, unsigned char *buffer,
+                                 unsigned char *line, int width, int height,
+                                 int stride)
+{
+    int r = priv->g_r;
+    int mwidth = priv->g_w;
+    int n = width & ~7;
+    unsigned short *t = priv->tmp;
+    int x, y, k;
+
+    memset(line, 0, r);
+    memset(line + r + width, 0, r);
+    for (y = 0; y < height; y++) {
+        memcpy(line + r, buffer + y * stride, width);
+        t[0] = 0;
+        for (x = 0; x < n; x += 8) {
+            const unsigned char *src = line + x;
+            const unsigned short *g = priv->gw;
+            int cnt = mwidth;
+            __asm__ volatile(
+                "pxor          %%xmm7, %%xmm7 \n\t"
+                "pxor          %%xmm0, %%xmm0 \n\t"
+                "1:                           \n\t"
+                "movq          (%0), %%xmm1   \n\t"
+                "movdqu        (%1), %%xmm2   \n\t"
+                "punpcklbw     %%xmm7, %%xmm1 \n\t"
+                "pmullw        %%xmm2, %%xmm1 \n\t"
+                "paddw         %%xmm1, %%xmm0 \n\t"
+                "add               $1, %0     \n\t"
+                "add              $16, %1     \n\t"
+                "dec               %2         \n\t"
+                "jnz 1b                       \n\t"
+                "movdqu        %%xmm0, (%3)   \n\t"
+                : "+r"(src), "+r"(g), "+r"(cnt)
+                : "r"(t + 1 + x)
+                : "memory", "xmm0", "xmm1", "xmm2", "xmm7");
+        }
+        for (; x < width; x++) {
+            unsigned sum = 0;
+            for (k = 0; k < mwidth; k++)
+                sum += line[x + k] * priv->g[k];
+            t[x + 1] = sum;
+        }
+        t += width + 1;
+    }
+}
+
+/*
+ * Vertical gaussian pass, 8 columns at a time. The input columns are
+ * copied to col (16 * height bytes) first, as the output overlaps them.
+ * Returns the first column left for gauss_blur_columns.
+ */
+static int gauss_blur_columns_sse2(ASS_SynthPriv *priv, unsigned short *col,
+                                   int width, int height)
+{
+    int r = priv->g_r;
+    int mwidth = priv->g_w;
+    intptr_t stride = 2 * (width + 1);
+    int x, y;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        unsigned short *t = priv->tmp + x;
+        unsigned short *src = t + 1;
+        unsigned short *dst = col;
+        int cnt = height;
+
+        // like the C version, leave the rounding bias of 128 where the
+        // input is not 0
+        __asm__ volatile(
+            "pxor          %%xmm7, %%xmm7 \n\t"
+            "pcmpeqw       %%xmm6, %%xmm6 \n\t"
+            "psrlw            $15, %%xmm6 \n\t"
+            "psllw             $7, %%xmm6 \n\t"
+            "1:                           \n\t"
+            "movdqu        (%0), %%xmm0   \n\t"
+            "movdqu        %%xmm0, (%1)   \n\t"
+            "pcmpeqw       %%xmm7, %%xmm0 \n\t"
+            "pandn         %%xmm6, %%xmm0 \n\t"
+            "movdqu        %%xmm0, (%0)   \n\t"
+            "add               %3, %0     \n\t"
+            "add              $16, %1     \n\t"
+            "dec               %2         \n\t"
+            "jnz 1b                       \n\t"
+            : "+r"(src), "+r"(dst), "+r"(cnt)
+            : "rm"(stride)
+            : "memory", "xmm0", "xmm6", "xmm7");
+
+        for (y = 0; y < height; y++) {
+            unsigned short *in = col + 8 * y;
+            const unsigned short *g;
+            if (!(in[0] | in[1] | in[2] | in[3] | in[4] | in[5] | in[6] | in[7]))
+                continue;
+            if (y < r) {
+                // the C version starts one row below for these
+                dst = t + (y + 1) * (width + 1);
+                g = priv->gw + 8 * (r - 1);
+                cnt = FFMIN(r + 2, height - y - 1);
+            } else {
+                dst = t + (y - r) * (width + 1);
+                g = priv->gw;
+                cnt = FFMIN(mwidth, height - y + r);
+            }
+            if (cnt <= 0)
+                continue;
+            __asm__ volatile(
+                "pcmpeqw       %%xmm6, %%xmm6 \n\t"
+                "psrlw            $15, %%xmm6 \n\t"
+                "psllw             $7, %%xmm6 \n\t"
+                "movdqu        (%3), %%xmm0   \n\t"
+                "paddw         %%xmm6, %%xmm0 \n\t"
+                "psrlw             $8, %%xmm0 \n\t"
+                "1:                           \n\t"
+                "movdqu        (%1), %%xmm1   \n\t"
+                "movdqu        (%0), %%xmm2   \n\t"
+                "pmullw        %%xmm0, %%xmm1 \n\t"
+                "paddw         %%xmm1, %%xmm2 \n\t"
+                "movdqu        %%xmm2, (%0)   \n\t"
+                "add               %4, %0     \n\t"
+                "add              $16, %1     \n\t"
+                "dec               %2         \n\t"
+                "jnz 1b                       \n\t"
+                : "+r"(dst), "+r"(g), "+r"(cnt)
+                : "r"(in), "rm"(stride)
+                : "memory", "xmm0", "xmm1", "xmm2", "xmm6");
+        }
+    }
+    return x;
+}
+
+static void gauss_blur_store_sse2(unsigned char *buffer, unsigned short *tmp2,
+                                  int width, int height, int stride)
+{
+    int n = width & ~15;
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        unsigned short *t = tmp2 + y * (width + 1);
+        unsigned char *s = buffer + y * stride;
+        if (n) {
+            intptr_t i = -n;
+            __asm__ volatile(
+                "1:                           \n\t"
+                "movdqu    (%1,%0,2), %%xmm0  \n\t"
+                "movdqu  16(%1,%0,2), %%xmm1  \n\t"
+                "psrlw             $8, %%xmm0 \n\t"
+                "psrlw             $8, %%xmm1 \n\t"
+                "packuswb      %%xmm1, %%xmm0 \n\t"
+                "movdqu        %%xmm0, (%2,%0)\n\t"
+                "add              $16, %0     \n\t"
+                "jl 1b                        \n\t"
+                : "+&r"(i)
+                : "r"(t + n), "r"(s + n)
+                : "memory", "xmm0", "xmm1");
+        }
+        for (x = n; x < width; x++)
+            s[x] = t[x] >> 8;
+    }
+}
+#endif /* HAVE_SSE2 */
+
+/*
+ * Fast approximation of the gaussian blur with three box blurs in each
+ * direction, the cost does not depend on the radius. The box sizes are
+ * chosen to match the variance of the gaussian made by generate_tables.
+ */
+static void box_blur_sizes(double radius, int *b)
+{
+    double sigma2 = radius * radius / log(base);
+    int wl = sqrt(4 * sigma2 + 1);
+    int m, i;
+
+    if (!(wl & 1))
+        wl--;
+    m = floor((12 * sigma2 - 3 * wl * wl - 12 * wl - 9) / (-4 * wl - 4) + 0.5);
+    for (i = 0; i < 3; i++)
+        b[i] = (i < m ? wl : wl + 2) / 2;
+}
+
+// line holds w + 2 * b bytes
+static void box_blur_rows(unsigned char *buf, int w, int h, int stride, int b,
+                          unsigned char *line)
+{
+    unsigned mul = (65536 + b) / (2 * b + 1);
+    int x, y, i;
+
+    memset(line, 0, b);
+    memset(line + b + w, 0, b);
+    for (y = 0; y < h; y++) {
+        unsigned char *row = buf + y * stride;
+        unsigned sum = 0;
+        memcpy(line + b, row, w);
+        for (i = 0; i < 2 * b; i++)
+            sum += line[i];
+        for (x = 0; x < w; x++) {
+            sum += line[x + 2 * b];
+            row[x] = FFMIN((sum * mul + 32768) >> 16, maxcolor);
+            sum -= line[x];
+        }
+    }
+}
+
+// copy holds w * h bytes, sums w values
+static void box_blur_columns(unsigned char *buf, int w, int h, int stride,
+                             int b, unsigned char *copy, unsigned *sums)
+{
+    unsigned mul = (65536 + b) / (2 * b + 1);
+    int x, y;
+
+    for (y = 0; y < h; y++)
+        memcpy(copy + y * w, buf + y * stride, w);
+    memset(sums, 0, w * sizeof(unsigned));
+    for (y = 0; y < b && y < h; y++)
+        for (x = 0; x < w; x++)
+            sums[x] += copy[y * w + x];
+    for (y = 0; y < h; y++) {
+        unsigned char *row = buf + y * stride;
+        if (y + b < h)
+            for (x = 0; x < w; x++)
+                sums[x] += copy[(y + b) * w + x];
+        for (x = 0; x < w; x++)
+            row[x] = FFMIN((sums[x] * mul + 32768) >> 16, maxcolor);
+        if (y - b >= 0)
+            for (x = 0; x < w; x++)
+                sums[x] -= copy[(y - b) * w + x];
+    }
+}
+
+static void box_blur(ASS_SynthPriv *priv, Bitmap *bm, double radius)
+{
+    int b[3], i;
+    unsigned *sums;
+    unsigned char *copy;
+
+    box_blur_sizes(radius, b);
+    sums = (unsigned *) get_buf(priv, bm->w * sizeof(unsigned) +
+                                FFMAX(bm->w * bm->h, bm->w + 2 * b[2]));
+    if (!sums)
+        return;
+    copy = (unsigned char *) (sums + bm->w);
+
+    for (i = 0; i < 3; i++)
+        if (b[i])
+            box_blur_rows(bm->buffer, bm->w, bm->h, bm->stride, b[i], copy);
+    for (i = 0; i < 3; i++)
+        if (b[i])
+            box_blur_columns(bm->buffer, bm->w, bm->h, bm->stride, b[i],
+                             copy, sums);
+}
+
 /**
  * \brief Blur with [[1,2,1]. [2,4,2], [1,2,1]] kernel
  * This blur is the same as the one employed by vsfilter.
  */
-static void be_blur(Bitmap *bm)
+static void be_blur(ASS_SynthPriv *priv, Bitmap *bm)
 {
     int w = bm->w;
     int h = bm->h;
@@ -433,6 +818,16 @@ static void be_blur(Bitmap *bm)
     unsigned int x, y;
     unsigned int old_sum, new_sum;
 
+#if HAVE_SSE2
+    if (gCpuCaps.hasSSE2) {
+        unsigned char *lines = get_buf(priv, 2 * w);
+        if (lines) {
+            be_blur_sse2(bm, lines);
+            return;
+        }
+    }
+#endif
+
     for (y = 0; y < h; y++) {
         old_sum = 2 * buf[y * s];
         for (x = 0; x < w - 1; x++) {
@@ -452,11 +847,34 @@ static void be_blur(Bitmap *bm)
     }
 }
 
-int outline_to_bitmap3(ASS_Library *library, ASS_SynthPriv *priv_blur,
-                       FT_Library ftlib, FT_Outline *outline, FT_Outline *border,
+static void gauss_blur(ASS_SynthPriv *priv, Bitmap *bm)
+{
+#if HAVE_SSE2
+    if (gCpuCaps.hasSSE2 && priv->gw) {
+        unsigned char *buf = get_buf(priv, FFMAX(bm->w + 2 * priv->g_r,
+                                                 16 * bm->h));
+        if (buf) {
+            int x0;
+            gauss_blur_rows_sse2(priv, bm->buffer, buf, bm->w, bm->h,
+                                 bm->stride);
+            x0 = gauss_blur_columns_sse2(priv, (unsigned short *) buf,
+                                         bm->w, bm->h);
+            gauss_blur_columns(priv->tmp, x0, bm->w, bm->h,
+                               (int *) priv->gt2, priv->g_r, priv->g_w);
+            gauss_blur_store_sse2(bm->buffer, priv->tmp, bm->w, bm->h,
+                                  bm->stride);
+            return;
+        }
+    }
+#endif
+    ass_gauss_blur(bm->buffer, priv->tmp, bm->w, bm->h, bm->stride,
+                   (int *) priv->gt2, priv->g_r, priv->g_w);
+}
+
+int outline_to_bitmap2(ASS_Library *library, FT_Library ftlib,
+                       FT_Outline *outline, FT_Outline *border,
                        Bitmap **bm_g, Bitmap **bm_o, Bitmap **bm_s,
-                       int be, double blur_radius, FT_Vector shadow_offset,
-                       int border_style)
+                       int be, double blur_radius, FT_Vector shadow_offset)
 {
     blur_radius *= 2;
     int bbord = be > 0 ? sqrt(2 * be) : 0;
@@ -481,45 +899,45 @@ int outline_to_bitmap3(ASS_Library *library, ASS_SynthPriv *priv_blur,
         }
     }
 
-    // Apply box blur (multiple passes, if requested)
-    while (be--) {
-        if (*bm_o)
-            be_blur(*bm_o);
-        else
-            be_blur(*bm_g);
+    // The shadow is filled in by blur_bitmaps
+    if (*bm_o) {
+        *bm_s = alloc_bitmap((*bm_o)->w, (*bm_o)->h);
+        (*bm_s)->left = (*bm_o)->left;
+        (*bm_s)->top = (*bm_o)->top;
+    } else {
+        *bm_s = alloc_bitmap((*bm_g)->w, (*bm_g)->h);
+        (*bm_s)->left = (*bm_g)->left;
+        (*bm_s)->top = (*bm_g)->top;
     }
 
+    return 0;
+}
+
+void blur_bitmaps(ASS_SynthPriv *priv_blur, Bitmap *bm_g, Bitmap *bm_o,
+                  Bitmap *bm_s, int be, double blur_radius,
+                  FT_Vector shadow_offset, int border_style, int fast_blur)
+{
+    Bitmap *bm = bm_o ? bm_o : bm_g;
+
+    blur_radius *= 2;
+
+    // Apply box blur (multiple passes, if requested)
+    while (be--)
+        be_blur(priv_blur, bm);
+
     // Apply gaussian blur
-    if (blur_radius > 0.0) {
-        if (*bm_o)
-            resize_tmp(priv_blur, (*bm_o)->w, (*bm_o)->h);
-        else
-            resize_tmp(priv_blur, (*bm_g)->w, (*bm_g)->h);
+    if (blur_radius > 0.0 && fast_blur) {
+        box_blur(priv_blur, bm, blur_radius);
+    } else if (blur_radius > 0.0) {
+        resize_tmp(priv_blur, bm->w, bm->h);
         generate_tables(priv_blur, blur_radius);
-        if (*bm_o)
-            ass_gauss_blur((*bm_o)->buffer, priv_blur->tmp,
-                           (*bm_o)->w, (*bm_o)->h, (*bm_o)->stride,
-                           (int *) priv_blur->gt2, priv_blur->g_r,
-                           priv_blur->g_w);
-        else
-            ass_gauss_blur((*bm_g)->buffer, priv_blur->tmp,
-                           (*bm_g)->w, (*bm_g)->h, (*bm_g)->stride,
-                           (int *) priv_blur->gt2, priv_blur->g_r,
-                           priv_blur->g_w);
+        gauss_blur(priv_blur, bm);
     }
 
     // Create shadow and fix outline as needed
-    if (*bm_o && border_style != 3) {
-        *bm_s = copy_bitmap(*bm_o);
-        fix_outline(*bm_g, *bm_o);
-    } else if (*bm_o) {
-        *bm_s = copy_bitmap(*bm_o);
-    } else
-        *bm_s = copy_bitmap(*bm_g);
-
-    assert(bm_s);
+    memcpy(bm_s->buffer, bm->buffer, bm->stride * bm->h);
+    if (bm_o && border_style != 3)
+        fix_outline(bm_g, bm_o);
 
-    shift_bitmap(*bm_s, shadow_offset.x, shadow_offset.y);
-
-    return 0;
+    shift_bitmap(bm_s, shadow_offset.x, shadow_offset.y);
 }
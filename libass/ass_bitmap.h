@@ -39,19 +39,27 @@ typedef struct {
 Bitmap *outline_to_bitmap(ASS_Library *library, FT_Library ftlib,
                           FT_Outline *outline, int bord);
 /**
- * \brief perform glyph rendering
- * \param glyph original glyph
- * \param outline_glyph "border" glyph, produced from original by FreeType's glyph stroker
+ * \brief Rasterize glyph and border without blurring them
+ * \param outline original glyph
+ * \param border "border" glyph, produced from original by FreeType's glyph stroker
  * \param bm_g out: pointer to the bitmap of original glyph is returned here
  * \param bm_o out: pointer to the bitmap of outline (border) glyph is returned here
- * \param bm_g out: pointer to the bitmap of glyph shadow is returned here
- * \param be 1 = produces blurred bitmaps, 0 = normal bitmaps
+ * \param bm_s out: pointer to the bitmap of glyph shadow is returned here
+ * The FreeType part must run on the thread owning ftlib, blur_bitmaps can
+ * run on any thread with a synthesizer of its own. bm_s is allocated but
+ * left empty.
  */
-int outline_to_bitmap3(ASS_Library *library, ASS_SynthPriv *priv_blur,
-                       FT_Library ftlib, FT_Outline *outline, FT_Outline *border,
+int outline_to_bitmap2(ASS_Library *library, FT_Library ftlib,
+                       FT_Outline *outline, FT_Outline *border,
                        Bitmap **bm_g, Bitmap **bm_o, Bitmap **bm_s,
-                       int be, double blur_radius, FT_Vector shadow_offset,
-                       int border_style);
+                       int be, double blur_radius, FT_Vector shadow_offset);
+/**
+ * \brief Blur the bitmaps made by outline_to_bitmap2 and fill the shadow
+ * \param fast_blur approximate the gaussian blur with box blurs
+ */
+void blur_bitmaps(ASS_SynthPriv *priv_blur, Bitmap *bm_g, Bitmap *bm_o,
+                  Bitmap *bm_s, int be, double blur_radius,
+                  FT_Vector shadow_offset, int border_style, int fast_blur);
 
 void ass_free_bitmap(Bitmap *bm);
 
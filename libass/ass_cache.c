@@ -89,14 +89,16 @@ static void bitmap_destruct(void *key, void *value)
     free(value);
 }
 
-static size_t bitmap_size(void *value, size_t value_size)
+static size_t single_bitmap_size(Bitmap *bm)
+{
+    return bm ? sizeof(Bitmap) + bm->stride * bm->h : 0;
+}
+
+static size_t bitmap_size(void *key, void *value, size_t value_size)
 {
     BitmapHashValue *val = value;
-    if (val->bm_o)
-        return val->bm_o->w * val->bm_o->h * 3;
-    else if (val->bm)
-        return val->bm->w * val->bm->h * 3;
-    return 0;
+    return single_bitmap_size(val->bm) + single_bitmap_size(val->bm_o) +
+           single_bitmap_size(val->bm_s);
 }
 
 static unsigned bitmap_hash(void *key, size_t key_size)
@@ -131,6 +133,12 @@ static void composite_destruct(void *key, void *value)
     free(value);
 }
 
+static size_t composite_size(void *key, void *value, size_t value_size)
+{
+    CompositeHashKey *k = key;
+    return k->as * k->ah + k->bs * k->bh;
+}
+
 // outline cache
 
 static unsigned outline_hash(void *key, size_t key_size)
@@ -175,12 +183,16 @@ static void outline_destruct(void *key, void *value)
 typedef struct cache_item {
     void *key;
     void *value;
+    size_t size;
+    unsigned bucket;
     struct cache_item *next;
+    struct cache_item *newer, *older;   // usage order
 } CacheItem;
 
 struct cache {
     unsigned buckets;
     CacheItem **map;
+    CacheItem *newest, *oldest;
 
     HashFunction hash_func;
     ItemSize size_func;
@@ -239,6 +251,31 @@ Cache *ass_cache_create(HashFunction hash_func, HashCompare compare_func,
     return cache;
 }
 
+// Usage order list, the newest item is the most recently used one
+static void lru_unlink(Cache *cache, CacheItem *item)
+{
+    if (item->newer)
+        item->newer->older = item->older;
+    else
+        cache->newest = item->older;
+    if (item->older)
+        item->older->newer = item->newer;
+    else
+        cache->oldest = item->newer;
+    item->newer = item->older = NULL;
+}
+
+static void lru_push(Cache *cache, CacheItem *item)
+{
+    item->newer = NULL;
+    item->older = cache->newest;
+    if (cache->newest)
+        cache->newest->newer = item;
+    else
+        cache->oldest = item;
+    cache->newest = item;
+}
+
 void *ass_cache_put(Cache *cache, void *key, void *value)
 {
     unsigned bucket = cache->hash_func(key, cache->key_size) % cache->buckets;
@@ -248,14 +285,19 @@ void *ass_cache_put(Cache *cache, void *key, void *value)
     (*item) = calloc(1, sizeof(CacheItem));
     (*item)->key = malloc(cache->key_size);
     (*item)->value = malloc(cache->value_size);
+    (*item)->bucket = bucket;
     memcpy((*item)->key, key, cache->key_size);
     memcpy((*item)->value, value, cache->value_size);
 
-    cache->items++;
+    // size in bytes including bookkeeping, or item count without size_func
     if (cache->size_func)
-        cache->cache_size += cache->size_func(value, cache->value_size);
+        (*item)->size = cache->size_func(key, value, cache->value_size) +
+                        sizeof(CacheItem) + cache->key_size + cache->value_size;
     else
-        cache->cache_size++;
+        (*item)->size = 1;
+    cache->items++;
+    cache->cache_size += (*item)->size;
+    lru_push(cache, *item);
 
     return (*item)->value;
 }
@@ -267,6 +309,10 @@ void *ass_cache_get(Cache *cache, void *key)
     while (item) {
         if (cache->compare_func(key, item->key, cache->key_size)) {
             cache->hits++;
+            if (item != cache->newest) {
+                lru_unlink(cache, item);
+                lru_push(cache, item);
+            }
             return item->value;
         }
         item = item->next;
@@ -275,6 +321,38 @@ void *ass_cache_get(Cache *cache, void *key)
     return NULL;
 }
 
+/**
+ * \brief Evict least recently used items if the cache exceeds max_size
+ * To avoid evicting a few items on every frame once the limit is reached,
+ * the cache is cut down to 3/4 of max_size.
+ * Values returned by ass_cache_get/put become invalid if they are evicted.
+ * \return number of evicted items
+ */
+int ass_cache_cut(Cache *cache, size_t max_size)
+{
+    size_t target = max_size - max_size / 4;
+    int evicted = 0;
+
+    if (cache->cache_size <= max_size)
+        return 0;
+
+    while (cache->oldest && cache->cache_size > target) {
+        CacheItem *item = cache->oldest;
+        CacheItem **prev = &cache->map[item->bucket];
+        while (*prev != item)
+            prev = &(*prev)->next;
+        *prev = item->next;
+        lru_unlink(cache, item);
+        cache->cache_size -= item->size;
+        cache->items--;
+        cache->destruct_func(item->key, item->value);
+        free(item);
+        evicted++;
+    }
+
+    return evicted;
+}
+
 int ass_cache_empty(Cache *cache, size_t max_size)
 {
     int i;
@@ -292,6 +370,7 @@ int ass_cache_empty(Cache *cache, size_t max_size)
         }
         cache->map[i] = NULL;
     }
+    cache->newest = cache->oldest = NULL;
 
     cache->items = cache->hits = cache->misses = cache->cache_size = 0;
 
@@ -347,6 +426,6 @@ Cache *ass_bitmap_cache_create(void)
 Cache *ass_composite_cache_create(void)
 {
     return ass_cache_create(composite_hash, composite_compare,
-            composite_destruct, (ItemSize)NULL, sizeof(CompositeHashKey),
+            composite_destruct, composite_size, sizeof(CompositeHashKey),
             sizeof(CompositeHashValue));
 }
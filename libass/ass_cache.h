@@ -58,7 +58,7 @@ typedef struct {
 
 // Type-specific function pointers
 typedef unsigned(*HashFunction)(void *key, size_t key_size);
-typedef size_t(*ItemSize)(void *value, size_t value_size);
+typedef size_t(*ItemSize)(void *key, void *value, size_t value_size);
 typedef unsigned(*HashCompare)(void *a, void *b, size_t key_size);
 typedef void(*CacheItemDestructor)(void *key, void *value);
 
@@ -92,6 +92,7 @@ Cache *ass_cache_create(HashFunction hash_func, HashCompare compare_func,
 void *ass_cache_put(Cache *cache, void *key, void *value);
 void *ass_cache_get(Cache *cache, void *key);
 int ass_cache_empty(Cache *cache, size_t max_size);
+int ass_cache_cut(Cache *cache, size_t max_size);
 void ass_cache_stats(Cache *cache, size_t *size, unsigned *hits,
                      unsigned *misses, unsigned *count);
 void ass_cache_done(Cache *cache);
@@ -20,6 +20,9 @@
 
 #include <assert.h>
 #include <math.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #include "ass_render.h"
 #include "ass_parse.h"
@@ -65,6 +68,7 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
     priv->cache.outline_cache = ass_outline_cache_create();
     priv->cache.glyph_max = GLYPH_CACHE_MAX;
     priv->cache.bitmap_max_size = BITMAP_CACHE_MAX_SIZE;
+    priv->cache.composite_max_size = COMPOSITE_CACHE_MAX_SIZE;
 
     priv->text_info.max_glyphs = MAX_GLYPHS_INITIAL;
     priv->text_info.max_lines = MAX_LINES_INITIAL;
@@ -90,6 +94,178 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
     return priv;
 }
 
+#if HAVE_PTHREADS
+/*
+ * Glyphs missing from the bitmap cache are rasterized while the event is
+ * laid out, FreeType is not thread-safe. The blur passes, which dominate
+ * the cost with \blur and \be, are queued as BlurJobs and run by a pool
+ * of workers together with the rendering thread before the event is
+ * composed. Every worker has a blur synthesizer of its own.
+ */
+typedef struct {
+    RenderPool *pool;
+    pthread_t thread;
+    ASS_SynthPriv *synth;
+} RenderWorker;
+
+struct render_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // jobs were queued or quit was set
+    pthread_cond_t done_cond;   // the last job finished
+    BlurJob *jobs;
+    int n_jobs;
+    int next;                   // next job to be taken
+    int pending;                // jobs taken or not, which did not finish
+    int quit;
+    int n_workers;
+    RenderWorker *workers;
+};
+
+static void blur_job(ASS_SynthPriv *synth, BlurJob *job)
+{
+    blur_bitmaps(synth, job->bm, job->bm_o, job->bm_s, job->be,
+                 job->blur_radius, job->shadow_offset, job->border_style,
+                 job->fast_blur);
+}
+
+// Run queued jobs until there are none left, called with the lock held
+static void pool_run_jobs(RenderPool *pool, ASS_SynthPriv *synth)
+{
+    while (pool->next < pool->n_jobs) {
+        BlurJob *job = pool->jobs + pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        blur_job(synth, job);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+}
+
+static void *pool_worker(void *arg)
+{
+    RenderWorker *worker = arg;
+    RenderPool *pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quit) {
+        pool_run_jobs(pool, worker->synth);
+        if (!pool->quit)
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void ass_render_pool_done(ASS_Renderer *render_priv)
+{
+    RenderPool *pool = render_priv->pool;
+    int i;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->n_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        ass_synth_done(pool->workers[i].synth);
+    }
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+    render_priv->pool = 0;
+}
+
+void ass_render_pool_init(ASS_Renderer *render_priv, int threads)
+{
+    RenderPool *pool;
+
+    ass_render_pool_done(render_priv);
+    // the rendering thread is one of them
+    if (threads <= 1)
+        return;
+
+    pool = calloc(1, sizeof(RenderPool));
+    if (!pool)
+        return;
+    pool->workers = calloc(threads - 1, sizeof(RenderWorker));
+    if (!pool->workers) {
+        free(pool);
+        return;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    render_priv->pool = pool;
+
+    while (pool->n_workers < threads - 1) {
+        RenderWorker *worker = pool->workers + pool->n_workers;
+        worker->pool = pool;
+        worker->synth = ass_synth_init(BLUR_MAX_RADIUS);
+        if (!worker->synth)
+            break;
+        if (pthread_create(&worker->thread, NULL, pool_worker, worker)) {
+            ass_synth_done(worker->synth);
+            break;
+        }
+        pool->n_workers++;
+    }
+    if (!pool->n_workers) {
+        ass_render_pool_done(render_priv);
+        return;
+    }
+    ass_msg(render_priv->library, MSGL_V, "Blurring glyphs with %d threads",
+            pool->n_workers + 1);
+}
+#else
+void ass_render_pool_init(ASS_Renderer *render_priv, int threads)
+{
+}
+
+void ass_render_pool_done(ASS_Renderer *render_priv)
+{
+}
+#endif
+
+/**
+ * \brief Blur the glyphs rasterized for the current event
+ * Must be done before anything reads the bitmap contents.
+ */
+static void run_blur_jobs(ASS_Renderer *render_priv)
+{
+    int i;
+
+#if HAVE_PTHREADS
+    RenderPool *pool = render_priv->pool;
+    if (pool && render_priv->n_blur_jobs > 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->jobs = render_priv->blur_jobs;
+        pool->n_jobs = render_priv->n_blur_jobs;
+        pool->next = 0;
+        pool->pending = pool->n_jobs;
+        pthread_cond_broadcast(&pool->work_cond);
+        pool_run_jobs(pool, render_priv->synth_priv);
+        while (pool->pending)
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        pool->n_jobs = pool->next = 0;
+        pthread_mutex_unlock(&pool->lock);
+        render_priv->n_blur_jobs = 0;
+        return;
+    }
+#endif
+    for (i = 0; i < render_priv->n_blur_jobs; i++) {
+        BlurJob *job = render_priv->blur_jobs + i;
+        blur_bitmaps(render_priv->synth_priv, job->bm, job->bm_o, job->bm_s,
+                     job->be, job->blur_radius, job->shadow_offset,
+                     job->border_style, job->fast_blur);
+    }
+    render_priv->n_blur_jobs = 0;
+}
+
 static void free_list_clear(ASS_Renderer *render_priv)
 {
     if (render_priv->free_head) {
@@ -106,6 +282,7 @@ static void free_list_clear(ASS_Renderer *render_priv)
 
 void ass_renderer_done(ASS_Renderer *render_priv)
 {
+    ass_render_pool_done(render_priv);
     ass_cache_done(render_priv->cache.font_cache);
     ass_cache_done(render_priv->cache.bitmap_cache);
     ass_cache_done(render_priv->cache.composite_cache);
@@ -126,6 +303,7 @@ void ass_renderer_done(ASS_Renderer *render_priv)
         ass_synth_done(render_priv->synth_priv);
     ass_shaper_free(render_priv->shaper);
     free(render_priv->eimg);
+    free(render_priv->blur_jobs);
     free(render_priv->text_info.glyphs);
     free(render_priv->text_info.lines);
 
@@ -1240,6 +1418,37 @@ transform_3d(FT_Vector shift, FT_Outline *outline, FT_Outline *border,
     }
 }
 
+static void queue_blur_job(ASS_Renderer *render_priv, BitmapHashValue *val,
+                           int be, double blur_radius,
+                           FT_Vector shadow_offset, int border_style)
+{
+    BlurJob *job;
+
+    if (render_priv->n_blur_jobs >= render_priv->max_blur_jobs) {
+        int max = render_priv->max_blur_jobs ? 2 * render_priv->max_blur_jobs
+                                             : 64;
+        job = realloc(render_priv->blur_jobs, max * sizeof(BlurJob));
+        if (!job) {
+            blur_bitmaps(render_priv->synth_priv, val->bm, val->bm_o,
+                         val->bm_s, be, blur_radius, shadow_offset,
+                         border_style, render_priv->settings.fast_blur);
+            return;
+        }
+        render_priv->blur_jobs = job;
+        render_priv->max_blur_jobs = max;
+    }
+
+    job = render_priv->blur_jobs + render_priv->n_blur_jobs++;
+    job->bm = val->bm;
+    job->bm_o = val->bm_o;
+    job->bm_s = val->bm_s;
+    job->be = be;
+    job->blur_radius = blur_radius;
+    job->shadow_offset = shadow_offset;
+    job->border_style = border_style;
+    job->fast_blur = render_priv->settings.fast_blur;
+}
+
 /**
  * \brief Get bitmaps for a glyph
  * \param info glyph info
@@ -1299,18 +1508,21 @@ get_bitmap_glyph(ASS_Renderer *render_priv, GlyphInfo *info)
             FT_Outline_Translate(border, key->advance.x, -key->advance.y);
         }
 
-        // render glyph
-        error = outline_to_bitmap3(render_priv->library,
-                render_priv->synth_priv,
+        // render glyph, blurring is deferred to run_blur_jobs
+        error = outline_to_bitmap2(render_priv->library,
                 render_priv->ftlibrary,
                 outline, border,
                 &hash_val.bm, &hash_val.bm_o,
                 &hash_val.bm_s, info->be,
                 info->blur * render_priv->border_scale,
-                key->shadow_offset,
-                render_priv->state.style->BorderStyle);
+                key->shadow_offset);
         if (error)
             info->symbol = 0;
+        else
+            queue_blur_job(render_priv, &hash_val, info->be,
+                           info->blur * render_priv->border_scale,
+                           key->shadow_offset,
+                           render_priv->state.style->BorderStyle);
 
         val = ass_cache_put(render_priv->cache.bitmap_cache, &info->hash_key,
                 &hash_val);
@@ -2118,6 +2330,8 @@ ass_render_event(ASS_Renderer *render_priv, ASS_Event *event,
         }
     }
 
+    run_blur_jobs(render_priv);
+
     memset(event_images, 0, sizeof(*event_images));
     event_images->top = device_y - text_info->lines[0].asc;
     event_images->height = text_info->height;
@@ -2150,18 +2364,27 @@ void ass_free_images(ASS_Image *img)
 }
 
 /**
- * \brief Check cache limits and reset cache if they are exceeded
+ * \brief Check cache limits and evict the least recently used items if they
+ * are exceeded
+ * Bitmap keys point to outlines and composite keys point to bitmaps, so the
+ * dependent caches are emptied when items they may refer to are evicted.
+ * The previous frame's images point into the caches as well.
  */
 static void check_cache_limits(ASS_Renderer *priv, CacheStore *cache)
 {
-    if (ass_cache_empty(cache->bitmap_cache, cache->bitmap_max_size)) {
+    int evicted = 0;
+    if (ass_cache_cut(cache->outline_cache, cache->glyph_max)) {
+        ass_cache_empty(cache->bitmap_cache, 0);
         ass_cache_empty(cache->composite_cache, 0);
-        ass_free_images(priv->prev_images_root);
-        priv->prev_images_root = 0;
+        evicted = 1;
     }
-    if (ass_cache_empty(cache->outline_cache, cache->glyph_max)) {
-        ass_cache_empty(cache->bitmap_cache, 0);
+    if (ass_cache_cut(cache->bitmap_cache, cache->bitmap_max_size)) {
         ass_cache_empty(cache->composite_cache, 0);
+        evicted = 1;
+    }
+    if (ass_cache_cut(cache->composite_cache, cache->composite_max_size))
+        evicted = 1;
+    if (evicted) {
         ass_free_images(priv->prev_images_root);
         priv->prev_images_root = 0;
     }
@@ -41,6 +41,7 @@ typedef struct ass_shaper ASS_Shaper;
 
 #define GLYPH_CACHE_MAX 1000
 #define BITMAP_CACHE_MAX_SIZE 30 * 1048576
+#define COMPOSITE_CACHE_MAX_SIZE 8 * 1048576
 
 #define PARSED_FADE (1<<0)
 #define PARSED_A    (1<<1)
@@ -77,6 +78,7 @@ typedef struct {
     double storage_aspect;      // pixel ratio of the source image
     ASS_Hinting hinting;
     ASS_ShapingLevel shaper;
+    int fast_blur;              // approximate \blur with box blurs
 
     char *default_font;
     char *default_family;
@@ -147,6 +149,19 @@ typedef struct glyph_info {
     struct glyph_info *next;
 } GlyphInfo;
 
+// Glyph rasterized in the current event whose bitmaps still have to be
+// blurred, see run_blur_jobs()
+typedef struct {
+    Bitmap *bm, *bm_o, *bm_s;
+    int be;
+    double blur_radius;
+    FT_Vector shadow_offset;
+    int border_style;
+    int fast_blur;
+} BlurJob;
+
+typedef struct render_pool RenderPool;
+
 typedef struct {
     double asc, desc;
     int offset, len;
@@ -235,6 +250,7 @@ typedef struct {
     Cache *composite_cache;
     size_t glyph_max;
     size_t bitmap_max_size;
+    size_t composite_max_size;
 } CacheStore;
 
 struct ass_renderer {
@@ -270,6 +286,11 @@ struct ass_renderer {
 
     FreeList *free_head;
     FreeList *free_tail;
+
+    BlurJob *blur_jobs;         // glyphs of the current event to be blurred
+    int n_blur_jobs;
+    int max_blur_jobs;
+    RenderPool *pool;           // blur worker threads, 0 if blurring serially
 };
 
 typedef struct render_priv {
@@ -291,6 +312,8 @@ typedef struct {
 
 void reset_render_context(ASS_Renderer *render_priv);
 void ass_free_images(ASS_Image *img);
+void ass_render_pool_init(ASS_Renderer *render_priv, int threads);
+void ass_render_pool_done(ASS_Renderer *render_priv);
 
 // XXX: this is actually in ass.c, includes should be fixed later on
 void ass_lazy_track_init(ASS_Library *lib, ASS_Track *track);
@@ -81,6 +81,14 @@ void ass_set_margins(ASS_Renderer *priv, int t, int b, int l, int r)
     }
 }
 
+void ass_set_fast_blur(ASS_Renderer *priv, int fast)
+{
+    if (priv->settings.fast_blur != fast) {
+        priv->settings.fast_blur = fast;
+        ass_reconfigure(priv);
+    }
+}
+
 void ass_set_use_margins(ASS_Renderer *priv, int use)
 {
     priv->settings.use_margins = use;
@@ -142,6 +150,15 @@ void ass_set_cache_limits(ASS_Renderer *render_priv, int glyph_max,
                           int bitmap_max)
 {
     render_priv->cache.glyph_max = glyph_max ? glyph_max : GLYPH_CACHE_MAX;
-    render_priv->cache.bitmap_max_size = bitmap_max ? 1048576 * bitmap_max :
+    render_priv->cache.bitmap_max_size = bitmap_max ?
+                                         (size_t) bitmap_max << 20 :
                                          BITMAP_CACHE_MAX_SIZE;
+    render_priv->cache.composite_max_size = bitmap_max ?
+                                            (size_t) bitmap_max << 18 :
+                                            COMPOSITE_CACHE_MAX_SIZE;
+}
+
+void ass_set_threads(ASS_Renderer *render_priv, int threads)
+{
+    ass_render_pool_init(render_priv, threads);
 }
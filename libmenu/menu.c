@@ -234,6 +234,7 @@ int menu_init(struct MPContext *mpctx, char* cfg_file) {
   int bl = BUF_STEP, br = 0;
   int f, fd;
 #ifndef CONFIG_FREETYPE
+  vo_load_deferred_fonts();
   if(vo_font == NULL)
     return 0;
 #endif
@@ -41,6 +41,21 @@ typedef struct {
 	int sample_format;
 } audio_encoding_params_t;
 
+/* A piece of the audio encoded with an encoder instance of its own, see
+   ae_thread.c. The frames are concatenated with those of the neighbouring
+   chunks, so they must not depend on each other. */
+typedef struct {
+	uint8_t *src;		//samples, the priming frames included
+	int len;		//in bytes
+	int prime;		//frames only encoded to set up the encoder, not output
+	int frames;		//frames output after them, -1 for all of them
+	uint8_t *dest;
+	int max_size;
+	int *sizes;		//size of each frame in dest
+	int max_sizes;
+	int num_sizes;
+} audio_chunk_t;
+
 typedef struct audio_encoder_s {
 	int codec;
 	int flags;
@@ -53,14 +68,27 @@ typedef struct audio_encoder_s {
 	int decode_buffer_size;
 	int decode_buffer_len;
 	void *priv;
+	struct ae_thread_s *thread;
+	int chunk_frame_len;	//input bytes per frame for encode_chunk
 	int (*bind)(struct audio_encoder_s*, muxer_stream_t*);
 	int (*get_frame_size)(struct audio_encoder_s*);
 	int (*set_decoded_len)(struct audio_encoder_s *encoder, int len);
 	int (*encode)(struct audio_encoder_s *encoder, uint8_t *dest, void *src, int nsamples, int max_size);
 	void (*fixup)(struct audio_encoder_s *encoder);
 	int (*close)(struct audio_encoder_s *encoder);
+	int (*encode_chunk)(struct audio_encoder_s *encoder, audio_chunk_t *chunk);
+	int (*flush)(struct audio_encoder_s *encoder, uint8_t *dest, int max_size);
 } audio_encoder_t;
 
+typedef struct ae_thread_s ae_thread_t;
+
 audio_encoder_t *new_audio_encoder(muxer_stream_t *stream, audio_encoding_params_t *params);
+/**
+ * \brief encode the audio in chunks on several worker threads
+ * Only for encoders with encode_chunk, encode() returns the frames of a
+ * chunk once it is done and flush() the ones still left at the end.
+ * \return 1 on success, 0 if the encoder keeps running synchronously
+ */
+int ae_thread_init(audio_encoder_t *encoder, int threads);
 
 #endif /* MPLAYER_AE_H */
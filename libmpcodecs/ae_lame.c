@@ -167,6 +167,91 @@ static void fixup(audio_encoder_t *encoder)
     }
 }
 
+// Set up gf with the options, used for the chunk instances as well
+static int setup_lame(audio_encoder_t *encoder, lame_global_flags *gf)
+{
+    lame_set_bWriteVbrTag(gf,0);
+    lame_set_in_samplerate(gf,encoder->params.sample_rate);
+    //lame_set_in_samplerate(gf,sh_audio->samplerate); // if resampling done by lame
+    lame_set_num_channels(gf,encoder->params.channels);
+    lame_set_out_samplerate(gf,encoder->params.sample_rate);
+    lame_set_quality(gf,lame_param_algqual); // 0 = best q
+    if(lame_param_free_format) lame_set_free_format(gf,1);
+    if(lame_param_vbr){  // VBR:
+        lame_set_VBR(gf,lame_param_vbr); // vbr mode
+        lame_set_VBR_q(gf,lame_param_quality); // 0 = best vbr q  5=~128k
+        if(lame_param_br>0) lame_set_VBR_mean_bitrate_kbps(gf,lame_param_br);
+        if(lame_param_br_min>0) lame_set_VBR_min_bitrate_kbps(gf,lame_param_br_min);
+        if(lame_param_br_max>0) lame_set_VBR_max_bitrate_kbps(gf,lame_param_br_max);
+    } else {    // CBR:
+        if(lame_param_br>0) lame_set_brate(gf,lame_param_br);
+    }
+    if(lame_param_mode>=0) lame_set_mode(gf,lame_param_mode); // j-st
+    if(lame_param_ratio>0) lame_set_compression_ratio(gf,lame_param_ratio);
+    if(lame_param_scale>0) lame_set_scale(gf,lame_param_scale);
+    if(lame_param_lowpassfreq>=-1) lame_set_lowpassfreq(gf,lame_param_lowpassfreq);
+    if(lame_param_highpassfreq>=-1) lame_set_highpassfreq(gf,lame_param_highpassfreq);
+#ifdef CONFIG_MP3LAME_PRESET
+    if(lame_param_preset != NULL) {
+        if(lame_presets_set(gf,lame_param_fast, (lame_param_vbr==0), lame_param_preset) < 0)
+            return 0;
+    }
+#endif
+    return 1;
+}
+
+/* Every chunk gets a new instance. The bit reservoir is disabled, a frame
+   must not borrow bits from the previous one, which is part of another
+   chunk. The frames of the instance are found by their headers. */
+static int encode_chunk_lame(audio_encoder_t *encoder, audio_chunk_t *chunk)
+{
+    lame_global_flags *gf;
+    int nsamples = chunk->len / (2 * encoder->params.channels);
+    int size = 5 * nsamples / 4 + 7200;
+    unsigned char *buf;
+    int len, n, pos, sz, frame, out;
+
+    buf = malloc(size);
+    gf = lame_init();
+    if(!buf || !gf || !setup_lame(encoder, gf)) {
+        free(buf);
+        if(gf) lame_close(gf);
+        return 0;
+    }
+    lame_set_disable_reservoir(gf,1);
+    if(lame_init_params(gf) == -1) {
+        free(buf);
+        lame_close(gf);
+        return 0;
+    }
+
+    if(encoder->params.channels == 1)
+        len = lame_encode_buffer(gf, (short *)chunk->src, (short *)chunk->src, nsamples, buf, size);
+    else
+        len = lame_encode_buffer_interleaved(gf, (short *)chunk->src, nsamples, buf, size);
+    if(len >= 0 && (n = lame_encode_flush(gf, buf + len, size - len)) > 0)
+        len += n;
+    lame_close(gf);
+
+    out = 0;
+    for(pos = frame = 0; pos + 4 <= len; pos += sz, frame++) {
+        sz = mp_decode_mp3_header(buf + pos);
+        if(sz <= 0 || pos + sz > len)
+            break;
+        if(frame < chunk->prime)
+            continue;
+        if(chunk->frames >= 0 && frame >= chunk->prime + chunk->frames)
+            break;
+        if(out + sz > chunk->max_size || chunk->num_sizes >= chunk->max_sizes)
+            break;
+        memcpy(chunk->dest + out, buf + pos, sz);
+        chunk->sizes[chunk->num_sizes++] = sz;
+        out += sz;
+    }
+    free(buf);
+    return out;
+}
+
 int mpae_init_lame(audio_encoder_t *encoder)
 {
     encoder->params.bitrate = lame_param_br * 125;
@@ -174,37 +259,14 @@ int mpae_init_lame(audio_encoder_t *encoder)
     encoder->decode_buffer_size = 2304;
 
     lame=lame_init();
-    lame_set_bWriteVbrTag(lame,0);
-    lame_set_in_samplerate(lame,encoder->params.sample_rate);
-    //lame_set_in_samplerate(lame,sh_audio->samplerate); // if resampling done by lame
-    lame_set_num_channels(lame,encoder->params.channels);
-    lame_set_out_samplerate(lame,encoder->params.sample_rate);
-    lame_set_quality(lame,lame_param_algqual); // 0 = best q
-    if(lame_param_free_format) lame_set_free_format(lame,1);
-    if(lame_param_vbr){  // VBR:
-        lame_set_VBR(lame,lame_param_vbr); // vbr mode
-        lame_set_VBR_q(lame,lame_param_quality); // 0 = best vbr q  5=~128k
-        if(lame_param_br>0) lame_set_VBR_mean_bitrate_kbps(lame,lame_param_br);
-        if(lame_param_br_min>0) lame_set_VBR_min_bitrate_kbps(lame,lame_param_br_min);
-        if(lame_param_br_max>0) lame_set_VBR_max_bitrate_kbps(lame,lame_param_br_max);
-    } else {    // CBR:
-        if(lame_param_br>0) lame_set_brate(lame,lame_param_br);
-    }
-    if(lame_param_mode>=0) lame_set_mode(lame,lame_param_mode); // j-st
-    if(lame_param_ratio>0) lame_set_compression_ratio(lame,lame_param_ratio);
-    if(lame_param_scale>0) {
-        mp_msg(MSGT_MENCODER, MSGL_V, "Setting audio input gain to %f.\n", lame_param_scale);
-        lame_set_scale(lame,lame_param_scale);
-    }
-    if(lame_param_lowpassfreq>=-1) lame_set_lowpassfreq(lame,lame_param_lowpassfreq);
-    if(lame_param_highpassfreq>=-1) lame_set_highpassfreq(lame,lame_param_highpassfreq);
 #ifdef CONFIG_MP3LAME_PRESET
-    if(lame_param_preset != NULL) {
+    if(lame_param_preset != NULL)
         mp_msg(MSGT_MENCODER, MSGL_V, "\npreset=%s\n\n", lame_param_preset);
-        if(lame_presets_set(lame,lame_param_fast, (lame_param_vbr==0), lame_param_preset) < 0)
-            return 0;
-    }
 #endif
+    if(lame_param_scale>0)
+        mp_msg(MSGT_MENCODER, MSGL_V, "Setting audio input gain to %f.\n", lame_param_scale);
+    if(!setup_lame(encoder, lame))
+        return 0;
     if(lame_init_params(lame) == -1) {
         mp_msg(MSGT_MENCODER, MSGL_FATAL, MSGTR_LameCantInit);
         return 0;
@@ -219,6 +281,11 @@ int mpae_init_lame(audio_encoder_t *encoder)
     encoder->encode = encode_lame;
     encoder->fixup = fixup;
     encoder->close = close_lame;
+    // a VBR chunk would be encoded without knowing about the others
+    if(!lame_param_vbr || lame_param_vbr == vbr_abr) {
+        encoder->encode_chunk = encode_chunk_lame;
+        encoder->chunk_frame_len = encoder->params.samples_per_frame * encoder->params.channels * 2;
+    }
     return 1;
 }
 
@@ -23,6 +23,9 @@
 #include <string.h>
 #include <sys/types.h>
 #include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 #include "m_option.h"
 #include "mp_msg.h"
 #include "libmpdemux/aviheader.h"
@@ -46,6 +49,16 @@ static AVCodec        *lavc_acodec;
 static AVCodecContext *lavc_actx;
 static int compressed_frame_size = 0;
 
+#if HAVE_PTHREADS
+// avcodec_open2() and avcodec_close() must not run at the same time
+static pthread_mutex_t avcodec_lock = PTHREAD_MUTEX_INITIALIZER;
+#define lock_avcodec()   pthread_mutex_lock(&avcodec_lock)
+#define unlock_avcodec() pthread_mutex_unlock(&avcodec_lock)
+#else
+#define lock_avcodec()
+#define unlock_avcodec()
+#endif
+
 static int bind_lavc(audio_encoder_t *encoder, muxer_stream_t *mux_a)
 {
 	mux_a->wf = malloc(sizeof(WAVEFORMATEX)+lavc_actx->extradata_size+256);
@@ -115,9 +128,65 @@ static int bind_lavc(audio_encoder_t *encoder, muxer_stream_t *mux_a)
 	return 1;
 }
 
-static int encode_lavc(audio_encoder_t *encoder, uint8_t *dest, void *src, int size, int max_size)
+// Set up ctx with the options, used for the chunk instances as well
+static int setup_context(audio_encoder_t *encoder, AVCodecContext *ctx)
+{
+	ctx->codec_id = lavc_acodec->id;
+	// put sample parameters
+	ctx->sample_fmt = AV_SAMPLE_FMT_S16;
+	if (lavc_acodec->sample_fmts) {
+		const enum AVSampleFormat *fmts;
+		ctx->sample_fmt = lavc_acodec->sample_fmts[0]; // fallback to first format
+		for (fmts = lavc_acodec->sample_fmts; *fmts != AV_SAMPLE_FMT_NONE; fmts++) {
+			if (samplefmt2affmt(*fmts) == encoder->params.sample_format) { // preferred format found
+				ctx->sample_fmt = *fmts;
+				break;
+			}
+		}
+	}
+	ctx->channels = encoder->params.channels;
+	ctx->sample_rate = encoder->params.sample_rate;
+	ctx->time_base.num = 1;
+	ctx->time_base.den = encoder->params.sample_rate;
+        if(lavc_param_abitrate<1000)
+                ctx->bit_rate = lavc_param_abitrate * 1000;
+        else
+                ctx->bit_rate = lavc_param_abitrate;
+        if(lavc_param_audio_avopt){
+            if(parse_avopts(ctx, lavc_param_audio_avopt) < 0){
+                mp_msg(MSGT_MENCODER,MSGL_ERR, "Your options /%s/ look like gibberish to me pal\n", lavc_param_audio_avopt);
+                return 0;
+            }
+        }
+
+	/*
+	* Special case for adpcm_ima_wav.
+	* The bitrate is only dependent on samplerate.
+	* We have to known frame_size and block_align in advance,
+	* so I just copied the code from libavcodec/adpcm.c
+	*
+	* However, ms adpcm_ima_wav uses a block_align of 2048,
+	* lavc defaults to 1024
+	*/
+	if(lavc_param_atag == 0x11) {
+		int blkalign = 2048;
+		int framesize = (blkalign - 4 * ctx->channels) * 8 / (4 * ctx->channels) + 1;
+		ctx->bit_rate = ctx->sample_rate*8*blkalign/framesize;
+	}
+        if((lavc_param_audio_global_header&1)
+        /*|| (video_global_header==0 && (oc->oformat->flags & AVFMT_GLOBALHEADER))*/){
+                ctx->flags |= CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if(lavc_param_audio_global_header&2){
+                ctx->flags2 |= CODEC_FLAG2_LOCAL_HEADER;
+        }
+
+	return 1;
+}
+
+// lavc wants the channels of 5.1 audio in a different order
+static void reorder_channels(audio_encoder_t *encoder, void *src, int size)
 {
-	int n;
 	if ((encoder->params.channels == 6 || encoder->params.channels == 5) &&
 			(!strcmp(lavc_acodec->name,"ac3") ||
 			!strcmp(lavc_acodec->name,"libfaac"))) {
@@ -129,11 +198,83 @@ static int encode_lavc(audio_encoder_t *encoder, uint8_t *dest, void *src, int s
 		                    encoder->params.channels,
 		                    size / bps, bps);
 	}
+}
+
+static int encode_lavc(audio_encoder_t *encoder, uint8_t *dest, void *src, int size, int max_size)
+{
+	int n;
+	reorder_channels(encoder, src, size);
 	n = avcodec_encode_audio(lavc_actx, dest, size, src);
         compressed_frame_size = n;
 	return n;
 }
 
+/* Every chunk gets a context of its own. Each call to the encoder takes one
+   frame of samples and returns at most one packet, the packets come out in
+   order, delayed by the same number of frames in every context. */
+static int encode_chunk_lavc(audio_encoder_t *encoder, audio_chunk_t *chunk)
+{
+	AVCodecContext *ctx;
+	int fl = encoder->chunk_frame_len;
+	int size = 2 * fl + FF_MIN_BUFFER_SIZE;
+	uint8_t *buf, *frame;
+	int pos, n, packet, out;
+
+	ctx = avcodec_alloc_context3(lavc_acodec);
+	buf = malloc(size);
+	frame = calloc(1, fl);
+	if(!ctx || !buf || !frame || !setup_context(encoder, ctx))
+		goto fail;
+	lock_avcodec();
+	n = avcodec_open2(ctx, lavc_acodec, NULL);
+	unlock_avcodec();
+	if(n < 0)
+		goto fail;
+
+	reorder_channels(encoder, chunk->src, chunk->len);
+	out = packet = 0;
+	for(pos = 0; ; pos += fl) {
+		if(pos < chunk->len) {
+			// the last frame is padded with silence
+			memcpy(frame, chunk->src + pos, FFMIN(fl, chunk->len - pos));
+			if(chunk->len - pos < fl)
+				memset(frame + chunk->len - pos, 0, fl - (chunk->len - pos));
+			n = avcodec_encode_audio(ctx, buf, size, (short *)frame);
+		}
+		else if(lavc_acodec->capabilities & CODEC_CAP_DELAY)
+			n = avcodec_encode_audio(ctx, buf, size, NULL);
+		else
+			n = 0;
+		if(n <= 0) {
+			if(pos < chunk->len)
+				continue;
+			break;
+		}
+		if(packet++ < chunk->prime)
+			continue;
+		if(chunk->frames >= 0 && packet > chunk->prime + chunk->frames)
+			break;
+		if(out + n > chunk->max_size || chunk->num_sizes >= chunk->max_sizes)
+			break;
+		memcpy(chunk->dest + out, buf, n);
+		chunk->sizes[chunk->num_sizes++] = n;
+		out += n;
+	}
+
+	lock_avcodec();
+	avcodec_close(ctx);
+	unlock_avcodec();
+	av_free(ctx);
+	free(buf);
+	free(frame);
+	return out;
+
+fail:
+	av_free(ctx);
+	free(buf);
+	free(frame);
+	return 0;
+}
 
 static int close_lavc(audio_encoder_t *encoder)
 {
@@ -185,57 +326,10 @@ int mpae_init_lavc(audio_encoder_t *encoder)
 		return 0;
 	}
 
-	lavc_actx->codec_id = lavc_acodec->id;
-	// put sample parameters
-	lavc_actx->sample_fmt = AV_SAMPLE_FMT_S16;
-	if (lavc_acodec->sample_fmts) {
-		const enum AVSampleFormat *fmts;
-		lavc_actx->sample_fmt = lavc_acodec->sample_fmts[0]; // fallback to first format
-		for (fmts = lavc_acodec->sample_fmts; *fmts != AV_SAMPLE_FMT_NONE; fmts++) {
-			if (samplefmt2affmt(*fmts) == encoder->params.sample_format) { // preferred format found
-				lavc_actx->sample_fmt = *fmts;
-				break;
-			}
-		}
-	}
+	if(!setup_context(encoder, lavc_actx))
+		return 0;
 	encoder->input_format = samplefmt2affmt(lavc_actx->sample_fmt);
-	lavc_actx->channels = encoder->params.channels;
-	lavc_actx->sample_rate = encoder->params.sample_rate;
-	lavc_actx->time_base.num = 1;
-	lavc_actx->time_base.den = encoder->params.sample_rate;
-        if(lavc_param_abitrate<1000)
-                lavc_actx->bit_rate = encoder->params.bitrate = lavc_param_abitrate * 1000;
-        else
-                lavc_actx->bit_rate = encoder->params.bitrate = lavc_param_abitrate;
-        if(lavc_param_audio_avopt){
-            if(parse_avopts(lavc_actx, lavc_param_audio_avopt) < 0){
-                mp_msg(MSGT_MENCODER,MSGL_ERR, "Your options /%s/ look like gibberish to me pal\n", lavc_param_audio_avopt);
-                return 0;
-            }
-        }
-
-
-	/*
-	* Special case for adpcm_ima_wav.
-	* The bitrate is only dependent on samplerate.
-	* We have to known frame_size and block_align in advance,
-	* so I just copied the code from libavcodec/adpcm.c
-	*
-	* However, ms adpcm_ima_wav uses a block_align of 2048,
-	* lavc defaults to 1024
-	*/
-	if(lavc_param_atag == 0x11) {
-		int blkalign = 2048;
-		int framesize = (blkalign - 4 * lavc_actx->channels) * 8 / (4 * lavc_actx->channels) + 1;
-		lavc_actx->bit_rate = lavc_actx->sample_rate*8*blkalign/framesize;
-	}
-        if((lavc_param_audio_global_header&1)
-        /*|| (video_global_header==0 && (oc->oformat->flags & AVFMT_GLOBALHEADER))*/){
-                lavc_actx->flags |= CODEC_FLAG_GLOBAL_HEADER;
-        }
-        if(lavc_param_audio_global_header&2){
-                lavc_actx->flags2 |= CODEC_FLAG2_LOCAL_HEADER;
-        }
+	encoder->params.bitrate = lavc_param_abitrate<1000 ? lavc_param_abitrate * 1000 : lavc_param_abitrate;
 
 	if(avcodec_open2(lavc_actx, lavc_acodec, NULL) < 0)
 	{
@@ -256,6 +350,13 @@ int mpae_init_lavc(audio_encoder_t *encoder)
 	encoder->get_frame_size = get_frame_size;
 	encoder->encode = encode_lavc;
 	encoder->close = close_lavc;
+	// mp3 frames borrow bits from the ones before them
+	if(lavc_actx->frame_size > 1 && strcmp(lavc_acodec->name, "libmp3lame")) {
+		encoder->encode_chunk = encode_chunk_lavc;
+		encoder->chunk_frame_len = lavc_actx->frame_size *
+		                           av_get_bytes_per_sample(lavc_actx->sample_fmt) *
+		                           encoder->params.channels;
+	}
 
 	return 1;
 }
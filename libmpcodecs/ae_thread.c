@@ -0,0 +1,398 @@
+/*
+ * Encode audio in chunks on worker threads
+ *
+ * This file is part of MPlayer.
+ *
+ * MPlayer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with MPlayer; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* encode() collects the samples into chunks of CHUNK_FRAMES frames, which
+   are encoded by encode_chunk() of the encoder on the workers, each with an
+   encoder instance of its own. A chunk starts PRIME_FRAMES frames early and
+   ends TRAIL_FRAMES frames late, the output of these frames is dropped, so
+   the encoder has settled by the first frame of the chunk and does not see
+   the end of the input before its last one. Frame n of every instance
+   covers the same samples as frame n of a single encoder would, so the
+   chunks join without a gap. The chunks are handed to the workers in turn
+   and collected in the same order, encode() returns the frames of the
+   oldest chunk once it is done and get_frame_size() their sizes. Until then
+   the frames count as delayed by the encoder. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "mp_msg.h"
+#include "ae.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+
+#define CHUNK_FRAMES 128
+#define PRIME_FRAMES 2
+#define TRAIL_FRAMES 2
+#define MAX_THREADS  16
+
+typedef struct {
+    ae_thread_t     *t;
+    pthread_t       thread;
+    int             busy;     // worker is encoding chunk
+    int             queued;   // chunk was handed over and not collected yet
+    int             frames;   // frames the chunk outputs
+    audio_chunk_t   chunk;
+    uint8_t         *in;
+    int             in_size;
+    int             out_size;
+    int             sizes_size;
+    int             ret;
+} ae_slot_t;
+
+struct ae_thread_s {
+    audio_encoder_t *encoder;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             quit;     // workers should exit
+    int             flushed;  // the last chunk was handed over
+    ae_slot_t       slots[MAX_THREADS];
+    int             num_slots;
+    int             next_in;  // number of the next chunk handed over
+    int             next_out; // number of the next chunk collected
+    uint8_t         *in;      // samples not handed over yet
+    int             in_len;
+    int             in_size;
+    int             prime;    // frames at the start of in already output
+    uint8_t         *out;     // frames collected but not returned yet
+    int             out_pos;
+    int             out_len;
+    int             out_size;
+    int             *sizes;   // sizes of the frames returned and collected
+    int             first;    // next size for get_frame_size()
+    int             returned; // frames returned by encode() so far
+    int             num_sizes;
+    int             sizes_size;
+    int             delay;    // frames counted in encoder_delay of the stream
+    // original function of the encoder
+    int (*close)(audio_encoder_t *encoder);
+};
+
+static void *worker(void *arg)
+{
+    ae_slot_t   *s = arg;
+    ae_thread_t *t = s->t;
+
+    pthread_mutex_lock(&t->lock);
+    while (1) {
+        while (!s->busy && !t->quit)
+            pthread_cond_wait(&t->cond, &t->lock);
+        if (!s->busy)
+            break;
+        pthread_mutex_unlock(&t->lock);
+        s->ret = t->encoder->encode_chunk(t->encoder, &s->chunk);
+        pthread_mutex_lock(&t->lock);
+        s->busy = 0;
+        pthread_cond_broadcast(&t->cond);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+// Make sure *buf can hold len bytes
+static int grow(void **buf, int *size, int len)
+{
+    if (*size < len) {
+        void *p = realloc(*buf, len);
+        if (!p)
+            return 0;
+        *buf  = p;
+        *size = len;
+    }
+    return 1;
+}
+
+/// Append the frames of the oldest chunk to out, waiting for it if needed.
+static void collect(ae_thread_t *t)
+{
+    ae_slot_t *s = &t->slots[t->next_out % t->num_slots];
+    audio_chunk_t *c = &s->chunk;
+    int n;
+
+    pthread_mutex_lock(&t->lock);
+    while (s->busy)
+        pthread_cond_wait(&t->cond, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+    s->queued = 0;
+    t->next_out++;
+    if (s->ret <= 0)
+        return;
+
+    // drop what has been returned already
+    if (t->out_pos) {
+        t->out_len -= t->out_pos;
+        memmove(t->out, t->out + t->out_pos, t->out_len);
+        t->out_pos = 0;
+    }
+    if (t->first) {
+        t->num_sizes -= t->first;
+        t->returned  -= t->first;
+        memmove(t->sizes, t->sizes + t->first, t->num_sizes * sizeof(int));
+        t->first = 0;
+    }
+    n = t->num_sizes + c->num_sizes;
+    if (!grow((void **)&t->out, &t->out_size, t->out_len + s->ret) ||
+        !grow((void **)&t->sizes, &t->sizes_size, n * sizeof(int)))
+        return;
+    memcpy(t->out + t->out_len, c->dest, s->ret);
+    t->out_len += s->ret;
+    memcpy(t->sizes + t->num_sizes, c->sizes, c->num_sizes * sizeof(int));
+    t->num_sizes = n;
+}
+
+/// Collect the chunks that are done without waiting for the others.
+static void collect_done(ae_thread_t *t)
+{
+    while (t->next_out < t->next_in) {
+        int busy;
+        pthread_mutex_lock(&t->lock);
+        busy = t->slots[t->next_out % t->num_slots].busy;
+        pthread_mutex_unlock(&t->lock);
+        if (busy)
+            break;
+        collect(t);
+    }
+}
+
+/** \brief Hand the first frames of in over to the next worker.
+ *  \param frames frames to output, -1 for all of in
+ *  \return 0 if out of memory */
+static int submit(ae_thread_t *t, int frames)
+{
+    audio_encoder_t *encoder = t->encoder;
+    int fl = encoder->chunk_frame_len;
+    ae_slot_t *s = &t->slots[t->next_in % t->num_slots];
+    int len, used, n;
+
+    if (s->queued)
+        collect(t);
+
+    len = frames < 0 ? t->in_len : (t->prime + frames + TRAIL_FRAMES) * fl;
+    n = (len + fl - 1) / fl + TRAIL_FRAMES + 2;
+    if (!grow((void **)&s->in, &s->in_size, len) ||
+        !grow((void **)&s->chunk.dest, &s->out_size, len + n * 1024 + 16384) ||
+        !grow((void **)&s->chunk.sizes, &s->sizes_size, n * sizeof(int))) {
+        mp_msg(MSGT_MENCODER, MSGL_ERR, "Cannot allocate audio chunk.\n");
+        return 0;
+    }
+    s->chunk.max_sizes = n;
+    s->frames          = frames < 0 ? n - TRAIL_FRAMES - 2 - t->prime : frames;
+    memcpy(s->in, t->in, len);
+    s->chunk.src       = s->in;
+    s->chunk.len       = len;
+    s->chunk.prime     = t->prime;
+    s->chunk.frames    = frames;
+    s->chunk.max_size  = s->out_size;
+    s->chunk.num_sizes = 0;
+    s->queued = 1;
+    t->next_in++;
+
+    // the next chunk starts PRIME_FRAMES before the end of this one
+    if (frames < 0) {
+        t->in_len = 0;
+    } else {
+        used = (t->prime + frames - PRIME_FRAMES) * fl;
+        t->in_len -= used;
+        memmove(t->in, t->in + used, t->in_len);
+        t->prime = PRIME_FRAMES;
+    }
+
+    pthread_mutex_lock(&t->lock);
+    s->busy = 1;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return 1;
+}
+
+/// Copy the collected frames that fit into dest.
+static int output(ae_thread_t *t, uint8_t *dest, int max_size)
+{
+    int len = 0;
+
+    while (t->returned < t->num_sizes && len + t->sizes[t->returned] <= max_size) {
+        memcpy(dest + len, t->out + t->out_pos, t->sizes[t->returned]);
+        len        += t->sizes[t->returned];
+        t->out_pos += t->sizes[t->returned];
+        t->returned++;
+    }
+    return len;
+}
+
+/* Count the frames given to encode() and not returned yet in encoder_delay,
+   otherwise mencoder sees the audio lag behind by up to a few chunks. */
+static void update_delay(ae_thread_t *t)
+{
+    int held = t->in_len / t->encoder->chunk_frame_len - t->prime;
+    int i;
+
+    // the priming frames at the start of in were output already
+    if (held < 0)
+        held = 0;
+    for (i = 0; i < t->num_slots; i++)
+        if (t->slots[i].queued)
+            held += t->slots[i].frames;
+    held += t->num_sizes - t->returned;
+    t->encoder->stream->encoder_delay += held - t->delay;
+    t->delay = held;
+}
+
+static void stop_workers(ae_thread_t *t)
+{
+    int i;
+
+    if (!t->num_slots)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->quit = 1;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    for (i = 0; i < t->num_slots; i++) {
+        pthread_join(t->slots[i].thread, NULL);
+        free(t->slots[i].in);
+        free(t->slots[i].chunk.dest);
+        free(t->slots[i].chunk.sizes);
+    }
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->lock);
+    t->num_slots = 0;
+}
+
+static int encode(audio_encoder_t *encoder, uint8_t *dest, void *src, int len, int max_size)
+{
+    ae_thread_t *t = encoder->thread;
+    int fl = encoder->chunk_frame_len;
+
+    if (len > 0 && !t->flushed) {
+        if (!grow((void **)&t->in, &t->in_size, t->in_len + len))
+            return 0;
+        memcpy(t->in + t->in_len, src, len);
+        t->in_len += len;
+        while (t->in_len >= (t->prime + CHUNK_FRAMES + TRAIL_FRAMES) * fl)
+            if (!submit(t, CHUNK_FRAMES))
+                break;
+    }
+    collect_done(t);
+    len = output(t, dest, max_size);
+    update_delay(t);
+    return len;
+}
+
+static int get_frame_size(audio_encoder_t *encoder)
+{
+    ae_thread_t *t = encoder->thread;
+
+    if (t->first >= t->returned)
+        return 0;
+    return t->sizes[t->first++];
+}
+
+static int flush(audio_encoder_t *encoder, uint8_t *dest, int max_size)
+{
+    ae_thread_t *t = encoder->thread;
+    int len;
+
+    if (!t->num_slots) {
+        len = output(t, dest, max_size);
+        update_delay(t);
+        return len;
+    }
+    if (!t->flushed) {
+        t->flushed = 1;
+        if (t->in_len > t->prime * encoder->chunk_frame_len)
+            submit(t, -1);
+    }
+    while (t->returned == t->num_sizes && t->next_out < t->next_in)
+        collect(t);
+    if (t->next_out == t->next_in)
+        stop_workers(t);
+    len = output(t, dest, max_size);
+    update_delay(t);
+    return len;
+}
+
+static int close_thread(audio_encoder_t *encoder)
+{
+    ae_thread_t *t = encoder->thread;
+    int ret;
+
+    stop_workers(t);
+    encoder->stream->encoder_delay -= t->delay;
+    ret = t->close ? t->close(encoder) : 1;
+    free(t->in);
+    free(t->out);
+    free(t->sizes);
+    free(t);
+    encoder->thread = NULL;
+    return ret;
+}
+
+int ae_thread_init(audio_encoder_t *encoder, int threads)
+{
+    ae_thread_t *t;
+    int i;
+
+    if (!encoder->encode_chunk || encoder->chunk_frame_len <= 0) {
+        mp_msg(MSGT_MENCODER, MSGL_WARN, "The audio encoder cannot encode on several threads.\n");
+        return 0;
+    }
+    t = calloc(1, sizeof(*t));
+    if (!t)
+        return 0;
+    t->encoder = encoder;
+    t->close   = encoder->close;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+    for (i = 0; i < threads; i++) {
+        t->slots[i].t = t;
+        if (pthread_create(&t->slots[i].thread, NULL, worker, &t->slots[i]))
+            break;
+    }
+    t->num_slots = i;
+    if (t->num_slots < 2) {
+        if (t->num_slots)
+            stop_workers(t);
+        else {
+            pthread_cond_destroy(&t->cond);
+            pthread_mutex_destroy(&t->lock);
+        }
+        free(t);
+        mp_msg(MSGT_MENCODER, MSGL_WARN, "Cannot create audio encoding threads.\n");
+        return 0;
+    }
+
+    encoder->thread         = t;
+    encoder->encode         = encode;
+    encoder->get_frame_size = get_frame_size;
+    encoder->flush          = flush;
+    encoder->close          = close_thread;
+    mp_msg(MSGT_MENCODER, MSGL_V, "Encoding audio in chunks on %d threads.\n", t->num_slots);
+    return 1;
+}
+#else
+int ae_thread_init(audio_encoder_t *encoder, int threads)
+{
+    return 0;
+}
+#endif
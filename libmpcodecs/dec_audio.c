@@ -404,7 +404,9 @@ static int filter_n_bytes(sh_audio_t *sh, int len)
 
     filter_input.len = len;
     af_fix_parameters(&filter_input);
-    filter_output = af_play(sh->afilter, &filter_input);
+    // at the end of the input get what the filters still hold back
+    filter_output = error ? af_play_final(sh->afilter, &filter_input)
+                          : af_play(sh->afilter, &filter_input);
     if (!filter_output)
 	return -1;
     if (sh->a_out_buffer_size < sh->a_out_buffer_len + filter_output->len) {
@@ -488,6 +490,8 @@ void resync_audio_stream(sh_audio_t *sh_audio)
     sh_audio->a_in_buffer_len = 0;	// clear audio input buffer
     if (!sh_audio->initialized)
 	return;
+    if (sh_audio->afilter)
+	af_reset(sh_audio->afilter);
     sh_audio->ad_driver->control(sh_audio, ADCTRL_RESYNC_STREAM, NULL);
 }
 
@@ -20,6 +20,10 @@
 #define MPLAYER_VE_H
 
 #include "m_option.h"
+#include "libmpdemux/muxer.h"
+
+struct vf_instance;
+typedef struct ve_thread_s ve_thread_t;
 
 extern const m_option_t lavcopts_conf[];
 extern const m_option_t vfwopts_conf[];
@@ -34,4 +38,22 @@ extern int   lavc_param_audio_global_header;
 int parse_forced_key_frames(const m_option_t *opt, const char *arg);
 int is_forced_key_frame(double pts);
 
+/**
+ * \brief run put_image of an encoder on a worker thread
+ * The encoder must write its output with the functions below, which the
+ * main thread muxes on the next call to the encoder.
+ * \param threaded 0 to only queue the output until ve_thread_mux()
+ * \return 1 on success, 0 if the encoder keeps writing to the muxer
+ */
+int ve_thread_init(struct vf_instance *vf, muxer_stream_t *mux, int threaded);
+/// mux the output queued by an encoder set up without a thread
+void ve_thread_mux(struct vf_instance *vf);
+/// buffer the encoder has to encode a frame into
+unsigned char *ve_thread_buffer(struct vf_instance *vf, muxer_stream_t *mux);
+/// mux len bytes of the buffer, like muxer_write_chunk()
+void ve_thread_write(struct vf_instance *vf, muxer_stream_t *mux, int len,
+                     unsigned int flags, double dts, double pts);
+/// count a frame kept back by the encoder in mux->encoder_delay
+void ve_thread_delay(struct vf_instance *vf, muxer_stream_t *mux);
+
 #endif /* MPLAYER_VE_H */
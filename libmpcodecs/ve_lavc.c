@@ -291,7 +291,7 @@ const m_option_t lavcopts_conf[]={
 	{"top", &lavc_param_top, CONF_TYPE_INT, CONF_RANGE, -1, 1, NULL},
         {"qns", &lavc_param_qns, CONF_TYPE_INT, CONF_RANGE, 0, 1000000, NULL},
         {"nssew", &lavc_param_nssew, CONF_TYPE_INT, CONF_RANGE, 0, 1000000, NULL},
-	{"threads", &lavc_param_threads, CONF_TYPE_INT, CONF_RANGE, 1, 8, NULL},
+	{"threads", &lavc_param_threads, CONF_TYPE_INT, CONF_RANGE, 1, 16, NULL},
 	{"turbo", &lavc_param_turbo, CONF_TYPE_FLAG, 0, 0, 1, NULL},
         {"skip_threshold", &lavc_param_skip_threshold, CONF_TYPE_INT, CONF_RANGE, 0, 1000000, NULL},
         {"skip_factor", &lavc_param_skip_factor, CONF_TYPE_INT, CONF_RANGE, 0, 1000000, NULL},
@@ -786,8 +786,8 @@ static int encode_frame(struct vf_instance *vf, AVFrame *pic, double pts){
             pic->pts= MP_NOPTS_VALUE;
 #endif
     }
-	out_size = avcodec_encode_video(lavc_venc_context, mux_v->buffer, mux_v->buffer_size,
-	    pic);
+	out_size = avcodec_encode_video(lavc_venc_context, ve_thread_buffer(vf, mux_v),
+	    mux_v->buffer_size, pic);
 
     /* store stats if there are any */
     if(lavc_venc_context->stats_out && stats_file) {
@@ -813,12 +813,12 @@ static int encode_frame(struct vf_instance *vf, AVFrame *pic, double pts){
 #endif
 //fprintf(stderr, "ve_lavc %f/%f\n", dts, pts);
     if(out_size == 0 && lavc_param_skip_threshold==0 && lavc_param_skip_factor==0){
-        ++mux_v->encoder_delay;
+        ve_thread_delay(vf, mux_v);
         return 0;
     }
 
-    muxer_write_chunk(mux_v,out_size,lavc_venc_context->coded_frame->key_frame?0x10:0,
-                      dts, pts);
+    ve_thread_write(vf, mux_v, out_size, lavc_venc_context->coded_frame->key_frame?0x10:0,
+                    dts, pts);
     free(lavc_venc_context->coded_frame->opaque);
     lavc_venc_context->coded_frame->opaque= NULL;
 
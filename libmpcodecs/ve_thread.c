@@ -0,0 +1,308 @@
+/*
+ * Run a video encoder on a worker thread
+ *
+ * This file is part of MPlayer.
+ *
+ * MPlayer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with MPlayer; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* put_image() of the encoder copies the frame and hands it to the worker,
+   so the encoder runs while mencoder reads, decodes and filters the next
+   frame. The encoder does not write to the muxer itself but queues its
+   packets with ve_thread_write(), they are muxed by the main thread on the
+   next put_image() or flush. Until then the frame counts as delayed
+   by the encoder, just like frames held back for B-frames or lookahead.
+   Only the control calls that make the encoder output frames are passed
+   on, they wait until the worker is idle, so the encoder never sees them
+   while it is running. Without a thread the functions below write
+   straight to the muxer.
+   The packets can also be queued without a worker: put_image() then runs
+   the encoder right away and the packets wait for ve_thread_mux(). This
+   lets mencoder encode video while its audio thread is using the muxer. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "mp_msg.h"
+
+#include "img_format.h"
+#include "mp_image.h"
+#include "vf.h"
+#include "ve.h"
+#include "libmpdemux/demuxer.h"
+#include "libmpdemux/muxer.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+
+typedef struct ve_packet {
+    unsigned char *data;
+    int           size;
+    int           len;
+    unsigned int  flags;
+    double        dts;
+    double        pts;
+} ve_packet_t;
+
+struct ve_thread_s {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             threaded; // put_image runs on the worker
+    int             busy;     // worker is encoding img
+    int             quit;     // worker should exit
+    int             pending;  // img was handed over and is counted as delayed
+    muxer_stream_t  *mux;
+    mp_image_t      *img;     // frame encoded by the worker
+    double          pts;
+    unsigned char   *buffer;  // for the encoder to encode into
+    ve_packet_t     *packets; // output of the encoder, not muxed yet
+    int             num_packets;
+    int             max_packets;
+    int             delayed;  // frames the encoder kept back meanwhile
+    // original functions of the encoder
+    int (*put_image)(struct vf_instance *vf, mp_image_t *mpi, double pts);
+    int (*control)(struct vf_instance *vf, int request, void *data);
+    void (*uninit)(struct vf_instance *vf);
+};
+
+static void *worker(void *arg)
+{
+    vf_instance_t *vf = arg;
+    ve_thread_t   *t  = vf->thread;
+
+    pthread_mutex_lock(&t->lock);
+    while (1) {
+        while (!t->busy && !t->quit)
+            pthread_cond_wait(&t->cond, &t->lock);
+        if (t->quit)
+            break;
+        pthread_mutex_unlock(&t->lock);
+        t->put_image(vf, t->img, t->pts);
+        pthread_mutex_lock(&t->lock);
+        t->busy = 0;
+        pthread_cond_broadcast(&t->cond);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+// Wait for the worker and mux what the encoder produced meanwhile
+static void collect(ve_thread_t *t)
+{
+    muxer_stream_t *mux = t->mux;
+    unsigned char *buffer = mux->buffer;
+    int i;
+
+    pthread_mutex_lock(&t->lock);
+    while (t->busy)
+        pthread_cond_wait(&t->cond, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+
+    mux->encoder_delay += t->delayed - t->pending;
+    t->delayed = t->pending = 0;
+    for (i = 0; i < t->num_packets; i++) {
+        ve_packet_t *p = t->packets + i;
+        mux->buffer = p->data;
+        muxer_write_chunk(mux, p->len, p->flags, p->dts, p->pts);
+    }
+    mux->buffer = buffer;
+    t->num_packets = 0;
+}
+
+static int put_image(struct vf_instance *vf, mp_image_t *mpi, double pts)
+{
+    ve_thread_t *t = vf->thread;
+
+    if (!t->threaded)
+        return t->put_image(vf, mpi, pts);
+
+    collect(t);
+
+    if (t->img && (t->img->w != mpi->w || t->img->h != mpi->h ||
+                   t->img->imgfmt != mpi->imgfmt)) {
+        free_mp_image(t->img);
+        t->img = NULL;
+    }
+    if (!t->img)
+        t->img = alloc_mpi(mpi->w, mpi->h, mpi->imgfmt);
+    copy_mpi(t->img, mpi);
+    t->img->fields    = mpi->fields;
+    t->img->pict_type = mpi->pict_type;
+    t->pts = pts;
+    // until its packet is muxed the frame is delayed by the encoder
+    t->pending = 1;
+    t->mux->encoder_delay++;
+
+    pthread_mutex_lock(&t->lock);
+    t->busy = 1;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    return 1;
+}
+
+static int control(struct vf_instance *vf, int request, void *data)
+{
+    ve_thread_t *t = vf->thread;
+    int ret;
+
+    switch (request) {
+    case VFCTRL_FLUSH_FRAMES:
+    case VFCTRL_DUPLICATE_FRAME:
+        // flushed and duplicated frames come after the frame in flight
+        collect(t);
+        ret = t->control(vf, request, data);
+        collect(t);
+        return ret;
+    }
+    // the threaded encoders answer nothing else, do not wait for the worker
+    return CONTROL_UNKNOWN;
+}
+
+static void uninit(struct vf_instance *vf)
+{
+    ve_thread_t *t = vf->thread;
+    int i;
+
+    if (t->threaded) {
+        pthread_mutex_lock(&t->lock);
+        t->quit = 1;
+        pthread_cond_broadcast(&t->cond);
+        pthread_mutex_unlock(&t->lock);
+        pthread_join(t->thread, NULL);
+    }
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->lock);
+
+    t->uninit(vf);
+    if (t->img)
+        free_mp_image(t->img);
+    for (i = 0; i < t->max_packets; i++)
+        free(t->packets[i].data);
+    free(t->packets);
+    free(t->buffer);
+    free(t);
+    vf->thread = NULL;
+}
+
+int ve_thread_init(vf_instance_t *vf, muxer_stream_t *mux, int threaded)
+{
+    ve_thread_t *t = calloc(1, sizeof(*t));
+    if (!t)
+        return 0;
+
+    t->buffer = malloc(mux->buffer_size);
+    if (!t->buffer) {
+        free(t);
+        return 0;
+    }
+    t->mux       = mux;
+    t->threaded  = threaded;
+    t->put_image = vf->put_image;
+    t->control   = vf->control;
+    t->uninit    = vf->uninit;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    vf->thread = t;
+
+    if (threaded && pthread_create(&t->thread, NULL, worker, vf)) {
+        pthread_cond_destroy(&t->cond);
+        pthread_mutex_destroy(&t->lock);
+        free(t->buffer);
+        free(t);
+        vf->thread = NULL;
+        mp_msg(MSGT_MENCODER, MSGL_WARN, "Cannot create video encoding thread.\n");
+        return 0;
+    }
+
+    vf->put_image = put_image;
+    vf->control   = control;
+    vf->uninit    = uninit;
+    if (threaded)
+        mp_msg(MSGT_MENCODER, MSGL_V, "Encoding video on a worker thread.\n");
+    return 1;
+}
+
+void ve_thread_mux(vf_instance_t *vf)
+{
+    if (vf->thread && !vf->thread->threaded)
+        collect(vf->thread);
+}
+#else
+int ve_thread_init(vf_instance_t *vf, muxer_stream_t *mux, int threaded)
+{
+    return 0;
+}
+
+void ve_thread_mux(vf_instance_t *vf)
+{
+}
+#endif
+
+unsigned char *ve_thread_buffer(vf_instance_t *vf, muxer_stream_t *mux)
+{
+#if HAVE_PTHREADS
+    if (vf->thread)
+        return vf->thread->buffer;
+#endif
+    return mux->buffer;
+}
+
+void ve_thread_write(vf_instance_t *vf, muxer_stream_t *mux, int len,
+                     unsigned int flags, double dts, double pts)
+{
+#if HAVE_PTHREADS
+    ve_thread_t *t = vf->thread;
+    if (t) {
+        ve_packet_t *p;
+        if (t->num_packets == t->max_packets) {
+            p = realloc_struct(t->packets, t->max_packets + 1, sizeof(*p));
+            if (!p)
+                return;
+            t->packets = p;
+            memset(p + t->max_packets++, 0, sizeof(*p));
+        }
+        p = t->packets + t->num_packets;
+        if (p->size < len) {
+            free(p->data);
+            p->data = malloc(len);
+            p->size = p->data ? len : 0;
+            if (!p->data)
+                return;
+        }
+        memcpy(p->data, t->buffer, len);
+        p->len   = len;
+        p->flags = flags;
+        p->dts   = dts;
+        p->pts   = pts;
+        t->num_packets++;
+        return;
+    }
+#endif
+    muxer_write_chunk(mux, len, flags, dts, pts);
+}
+
+void ve_thread_delay(vf_instance_t *vf, muxer_stream_t *mux)
+{
+#if HAVE_PTHREADS
+    ve_thread_t *t = vf->thread;
+    if (t) {
+        t->delayed++;
+        return;
+    }
+#endif
+    ++mux->encoder_delay;
+}
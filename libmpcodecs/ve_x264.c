@@ -267,11 +267,12 @@ static int encode_frame(struct vf_instance *vf, x264_picture_t *pic_in)
     }
     if(i_size>0) {
         int keyframe = pic_out.b_keyframe;
-        memcpy(mod->mux->buffer, nal->p_payload, i_size);
-        muxer_write_chunk(mod->mux, i_size, keyframe?AVIIF_KEYFRAME:0, MP_NOPTS_VALUE, MP_NOPTS_VALUE);
+        memcpy(ve_thread_buffer(vf, mod->mux), nal->p_payload, i_size);
+        ve_thread_write(vf, mod->mux, i_size, keyframe?AVIIF_KEYFRAME:0,
+                        MP_NOPTS_VALUE, MP_NOPTS_VALUE);
     }
     else
-        ++mod->mux->encoder_delay;
+        ve_thread_delay(vf, mod->mux);
 
     return i_size;
 }
@@ -292,7 +293,7 @@ static int vf_open(vf_instance_t *vf, char *args) {
     vf->query_format = query_format;
     vf->put_image = put_image;
     vf->uninit = uninit;
-    vf->priv = malloc(sizeof(h264_module_t));
+    vf->priv = calloc(1, sizeof(h264_module_t));
 
     mod=(h264_module_t*)vf->priv;
     mod->mux = (muxer_stream_t*)args;
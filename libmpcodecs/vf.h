@@ -84,6 +84,7 @@ typedef struct vf_instance {
     struct vf_instance *next;
     mp_image_t *dmpi;
     struct vf_priv_s* priv;
+    struct ve_thread_s* thread; // encoder running on a worker thread, see ve_thread.c
 } vf_instance_t;
 
 // control codes:
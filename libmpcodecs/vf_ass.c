@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "config.h"
@@ -61,10 +62,18 @@ static const struct vf_priv_s {
     // 0 = insert always
     int auto_insert;
 
-    unsigned char *planes[3];
-    unsigned char *dirty_rows;
+    /* All EOSD images composited into one layer, kept until the images
+       change. Transparency is 0..LAYER_ONE, colors are premultiplied and
+       scaled by 128. The chroma layer is at chroma resolution. */
+    uint16_t *alpha, *color[3];
+    uint16_t *calpha, *ccolor[2];
+    int layer_size;
+    int x0, y0, w, h;   ///< bounding box of the layer, w == 0 if empty
+    int layer_valid;
 } vf_priv_dflt;
 
+#define LAYER_ONE 0x8000
+
 
 static int config(struct vf_instance *vf,
                   int width, int height, int d_width, int d_height,
@@ -86,9 +95,7 @@ static int config(struct vf_instance *vf,
         d_height = d_height * vf->priv->outh / height;
     }
 
-    vf->priv->planes[1]  = malloc(vf->priv->outw * vf->priv->outh);
-    vf->priv->planes[2]  = malloc(vf->priv->outw * vf->priv->outh);
-    vf->priv->dirty_rows = malloc(vf->priv->outh);
+    vf->priv->layer_valid = 0;
 
     res.w    = vf->priv->outw;
     res.h    = vf->priv->outh;
@@ -224,137 +231,168 @@ static int prepare_image(struct vf_instance *vf, mp_image_t *mpi)
 }
 
 /**
- * \brief Copy specified rows from render_context.dmpi to render_context.planes, upsampling to 4:4:4
+ * \brief Make sure the layer buffers can hold size pixels
  */
-static void copy_from_image(struct vf_instance *vf, int first_row,
-                            int last_row)
+static int alloc_layer(struct vf_instance *vf, int size)
 {
-    int pl;
-    int i, j, k;
-    unsigned char val;
-    int chroma_rows;
-
-    first_row  &= 0xFFFFFFFFFFFFFFFE;
-    last_row    = ((last_row + 1) & 0xFFFFFFFFFFFFFFFE);
-    chroma_rows = (last_row - first_row) >> 1;
-
-	assert(first_row >= 0);
-    assert(first_row <= last_row);
-
-	if (last_row > vf->priv->outh) {
-		last_row = vf->priv->outh;
-	}
-	
-    for (pl = 1; pl < 3; ++pl) {
-        int dst_stride = vf->priv->outw;
-        int src_stride = vf->dmpi->stride[pl];
-
-        unsigned char *src      = vf->dmpi->planes[pl] + (first_row >> 1) * src_stride;
-        unsigned char *dst      = vf->priv->planes[pl] +  first_row       * dst_stride;
-        unsigned char *dst_next = dst + dst_stride;
-        for (i = 0; i < chroma_rows; ++i) {
-            if ((vf->priv->dirty_rows[first_row + i * 2    ] == 0) ||
-                (vf->priv->dirty_rows[first_row + i * 2 + 1] == 0)) {
-                for (j = 0, k = 0; j < vf->dmpi->chroma_width; ++j, k += 2) {
-                    val = *(src + j);
-                    *(dst + k    ) = val;
-                    *(dst + k + 1) = val;
-                    *(dst_next + k    ) = val;
-                    *(dst_next + k + 1) = val;
-                }
-            }
-            src += src_stride;
-            dst      = dst_next + dst_stride;
-            dst_next = dst      + dst_stride;
+    struct vf_priv_s *p = vf->priv;
+    int i;
+    if (size <= p->layer_size)
+        return 1;
+    free(p->alpha);
+    free(p->calpha);
+    for (i = 0; i < 3; i++)
+        free(p->color[i]);
+    for (i = 0; i < 2; i++)
+        free(p->ccolor[i]);
+    p->alpha     = malloc(size * sizeof(uint16_t));
+    p->calpha    = malloc(size / 4 * sizeof(uint16_t));
+    p->color[0]  = malloc(size * sizeof(uint16_t));
+    p->color[1]  = malloc(size * sizeof(uint16_t));
+    p->color[2]  = malloc(size * sizeof(uint16_t));
+    p->ccolor[0] = malloc(size / 4 * sizeof(uint16_t));
+    p->ccolor[1] = malloc(size / 4 * sizeof(uint16_t));
+    p->layer_size = size;
+    if (!p->alpha || !p->calpha || !p->color[0] || !p->color[1] ||
+        !p->color[2] || !p->ccolor[0] || !p->ccolor[1]) {
+        p->layer_size = 0;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * \brief Composite one image into the layer
+ */
+static void draw_to_layer(struct vf_instance *vf, struct mp_eosd_image *img)
+{
+    struct vf_priv_s *p = vf->priv;
+    unsigned char y = rgba2y(img->color);
+    unsigned char u = rgba2u(img->color);
+    unsigned char v = rgba2v(img->color);
+    unsigned yuv[3] = { y << 7, u << 7, v << 7 };
+    unsigned opacity = 255 - _a(img->color);
+    int x0 = FFMAX(img->dst_x, p->x0), x1 = FFMIN(img->dst_x + img->w, p->x0 + p->w);
+    int y0 = FFMAX(img->dst_y, p->y0), y1 = FFMIN(img->dst_y + img->h, p->y0 + p->h);
+    int i, j, pl;
+
+    opacity = (0x10203 * opacity + 0x80) >> 8; /* 0x10203 = (1<<32)/(255*255) */
+    /* 0 <= opacity <= 0x10101 */
+    for (i = y0; i < y1; i++) {
+        unsigned char *src = img->bitmap + (i - img->dst_y) * img->stride - img->dst_x;
+        int off = (i - p->y0) * p->w - p->x0;
+        for (j = x0; j < x1; j++) {
+            unsigned a = src[j], t;
+            if (!a)
+                continue;
+            a = (a * opacity + 0x80) >> 9; /* 0 <= a <= LAYER_ONE */
+            t = LAYER_ONE - a;
+            p->alpha[off + j] = (p->alpha[off + j] * t + LAYER_ONE / 2) >> 15;
+            for (pl = 0; pl < 3; pl++)
+                p->color[pl][off + j] = (p->color[pl][off + j] * t + a * yuv[pl] + LAYER_ONE / 2) >> 15;
         }
     }
-    for (i = first_row; i < last_row; ++i)
-        vf->priv->dirty_rows[i] = 1;
 }
 
 /**
- * \brief Copy all previously copied rows back to render_context.dmpi
+ * \brief Composite all images into the layer and subsample its chroma
  */
-static void copy_to_image(struct vf_instance *vf)
+static void build_layer(struct vf_instance *vf, struct mp_eosd_image_list *images)
 {
-    int pl;
-    int i, j, k;
-    for (pl = 1; pl < 3; ++pl) {
-        int dst_stride = vf->dmpi->stride[pl];
-        int src_stride = vf->priv->outw;
-
-        unsigned char *dst      = vf->dmpi->planes[pl];
-        unsigned char *src      = vf->priv->planes[pl];
-        unsigned char *src_next = vf->priv->planes[pl] + src_stride;
-        for (i = 0; i < vf->priv->outh / 2; ++i) {
-            if ((vf->priv->dirty_rows[i * 2] == 1)) {
-                assert(vf->priv->dirty_rows[i * 2 + 1] == 1);
-                for (j = 0, k = 0; j < vf->dmpi->chroma_width; ++j, k += 2) {
-                    unsigned val = 0;
-                    val += *(src + k);
-                    val += *(src + k + 1);
-                    val += *(src_next + k);
-                    val += *(src_next + k + 1);
-                    *(dst + j) = val >> 2;
-                }
+    struct vf_priv_s *p = vf->priv;
+    struct mp_eosd_image *img;
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    int i, j, pl;
+
+    p->w = 0;
+    p->layer_valid = 1;
+    for (img = eosd_image_first(images); img; img = eosd_image_next(images)) {
+        x0 = FFMIN(x0, img->dst_x);
+        y0 = FFMIN(y0, img->dst_y);
+        x1 = FFMAX(x1, img->dst_x + img->w);
+        y1 = FFMAX(y1, img->dst_y + img->h);
+    }
+    x0 = FFMAX(x0, 0) & ~1;
+    y0 = FFMAX(y0, 0) & ~1;
+    x1 = (FFMIN(x1, p->outw) + 1) & ~1;
+    y1 = (FFMIN(y1, p->outh) + 1) & ~1;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+    if (!alloc_layer(vf, (x1 - x0) * (y1 - y0)))
+        return;
+    p->x0 = x0;
+    p->y0 = y0;
+    p->w  = x1 - x0;
+    p->h  = y1 - y0;
+
+    for (i = 0; i < p->w * p->h; i++)
+        p->alpha[i] = LAYER_ONE;
+    for (pl = 0; pl < 3; pl++)
+        memset(p->color[pl], 0, p->w * p->h * sizeof(uint16_t));
+    for (img = eosd_image_first(images); img; img = eosd_image_next(images))
+        draw_to_layer(vf, img);
+
+    for (i = 0; i < p->h / 2; i++) {
+        int cw  = p->w / 2;
+        int off = 2 * i * p->w;
+        for (j = 0; j < cw; j++, off += 2) {
+            int o = i * cw + j;
+            p->calpha[o] = (p->alpha[off] + p->alpha[off + 1] +
+                            p->alpha[off + p->w] + p->alpha[off + p->w + 1] + 2) >> 2;
+            for (pl = 0; pl < 2; pl++) {
+                uint16_t *c = p->color[pl + 1];
+                p->ccolor[pl][o] = (c[off] + c[off + 1] +
+                                    c[off + p->w] + c[off + p->w + 1] + 2) >> 2;
             }
-            dst += dst_stride;
-            src      = src_next + src_stride;
-            src_next = src      + src_stride;
         }
     }
 }
 
-static void my_draw_bitmap(struct vf_instance *vf, unsigned char *bitmap,
-                           int bitmap_w, int bitmap_h, int stride,
-                           int dst_x, int dst_y, unsigned color)
+static void blend_plane(unsigned char *dst, int dst_stride, int w, int h,
+                        const uint16_t *alpha, const uint16_t *color, int stride)
 {
-    unsigned char y = rgba2y(color);
-    unsigned char u = rgba2u(color);
-    unsigned char v = rgba2v(color);
-    unsigned opacity = 255 - _a(color);
-    unsigned char *src, *dsty, *dstu, *dstv;
     int i, j;
-    mp_image_t *dmpi = vf->dmpi;
-
-    opacity = (0x10203 * opacity + 0x80) >> 8; /* 0x10203 = (1<<32)/(255*255) */
-    /* 0 <= opacity <= 0x10101 */
-    src = bitmap;
-    dsty = dmpi->planes[0]     + dst_x + dst_y * dmpi->stride[0];
-    dstu = vf->priv->planes[1] + dst_x + dst_y * vf->priv->outw;
-    dstv = vf->priv->planes[2] + dst_x + dst_y * vf->priv->outw;
-    for (i = 0; i < bitmap_h; ++i) {
-        for (j = 0; j < bitmap_w; ++j) {
-            unsigned k = src[j];
-            if (!k)
+    for (i = 0; i < h; i++) {
+        for (j = 0; j < w; j++) {
+            unsigned t = alpha[j];
+            if (t == LAYER_ONE)
                 continue;
-            k *= opacity; /* 0 <= k <= 0xFFFFFF */
-            dsty[j] = (k * y + (0xFFFFFF - k) * dsty[j] + 0x800000) >> 24;
-            dstu[j] = (k * u + (0xFFFFFF - k) * dstu[j] + 0x800000) >> 24;
-            dstv[j] = (k * v + (0xFFFFFF - k) * dstv[j] + 0x800000) >> 24;
+            dst[j] = FFMIN(255, (color[j] * 256 + t * dst[j] + LAYER_ONE / 2) >> 15);
         }
-        src  += stride;
-        dsty += dmpi->stride[0];
-        dstu += vf->priv->outw;
-        dstv += vf->priv->outw;
+        dst   += dst_stride;
+        alpha += stride;
+        color += stride;
     }
 }
 
+/**
+ * \brief Blend the layer into the bounding box of vf->dmpi
+ */
+static void blend_layer(struct vf_instance *vf)
+{
+    struct vf_priv_s *p = vf->priv;
+    mp_image_t *dmpi = vf->dmpi;
+    int pl;
+    int cx = p->x0 >> 1, cy = p->y0 >> 1;
+
+    blend_plane(dmpi->planes[0] + p->y0 * dmpi->stride[0] + p->x0, dmpi->stride[0],
+                FFMIN(p->w, p->outw - p->x0), FFMIN(p->h, p->outh - p->y0),
+                p->alpha, p->color[0], p->w);
+    for (pl = 1; pl < 3; pl++)
+        blend_plane(dmpi->planes[pl] + cy * dmpi->stride[pl] + cx, dmpi->stride[pl],
+                    FFMIN(p->w / 2, dmpi->chroma_width  - cx),
+                    FFMIN(p->h / 2, dmpi->chroma_height - cy),
+                    p->calpha, p->ccolor[pl - 1], p->w / 2);
+}
+
 static void render_frame(struct vf_instance *vf, mp_image_t *mpi,
                          struct mp_eosd_image_list *images)
 {
-    struct mp_eosd_image *img;
-    img = eosd_image_first(images);
-    if (!img)
-        return;
-        memset(vf->priv->dirty_rows, 0, vf->priv->outh);        // reset dirty rows
-        while (img) {
-            copy_from_image(vf, img->dst_y, img->dst_y + img->h);
-            my_draw_bitmap(vf, img->bitmap, img->w, img->h, img->stride,
-                           img->dst_x, img->dst_y, img->color);
-            img = eosd_image_next(images);
-        }
-        copy_to_image(vf);
+    // libass reports whether anything changed, reuse the layer otherwise
+    if (images->changed || !vf->priv->layer_valid)
+        build_layer(vf, images);
+    if (vf->priv->w)
+        blend_layer(vf);
 }
 
 static int put_image(struct vf_instance *vf, mp_image_t *mpi, double pts)
@@ -390,9 +428,13 @@ static int control(vf_instance_t *vf, int request, void *data)
 
 static void uninit(struct vf_instance *vf)
 {
-    free(vf->priv->planes[1]);
-    free(vf->priv->planes[2]);
-    free(vf->priv->dirty_rows);
+    int i;
+    free(vf->priv->alpha);
+    free(vf->priv->calpha);
+    for (i = 0; i < 3; i++)
+        free(vf->priv->color[i]);
+    for (i = 0; i < 2; i++)
+        free(vf->priv->ccolor[i]);
 }
 
 static const unsigned int fmt_list[] = {
@@ -1176,6 +1176,23 @@ static demuxer_t *demux_open_stream(stream_t *stream, int file_format,
     return demuxer;
 }
 
+/**
+ * Open the demuxer of stream while the stream keeps what the demuxers read
+ * from its start, so checking each of them does not seek back in it.
+ */
+static demuxer_t *demux_probe_stream(stream_t *stream, int file_format,
+                                     int force, int audio_id, int video_id,
+                                     int dvdsub_id, char *filename)
+{
+    demuxer_t *demuxer;
+
+    stream_probe_start(stream);
+    demuxer = demux_open_stream(stream, file_format, force, audio_id,
+                                video_id, dvdsub_id, filename);
+    stream_probe_end(stream);
+    return demuxer;
+}
+
 char *audio_stream = NULL;
 char *sub_stream = NULL;
 int audio_stream_cache = 0;
@@ -1243,9 +1260,9 @@ demuxer_t *demux_open(stream_t *vs, int file_format, int audio_id,
         }
     }
 
-    vd = demux_open_stream(vs, demuxer_type ? demuxer_type : file_format,
-                           demuxer_force, audio_stream ? -2 : audio_id,
-                           video_id, sub_stream ? -2 : dvdsub_id, filename);
+    vd = demux_probe_stream(vs, demuxer_type ? demuxer_type : file_format,
+                            demuxer_force, audio_stream ? -2 : audio_id,
+                            video_id, sub_stream ? -2 : dvdsub_id, filename);
     if (!vd) {
         if (as)
             free_stream(as);
@@ -1254,10 +1271,10 @@ demuxer_t *demux_open(stream_t *vs, int file_format, int audio_id,
         return NULL;
     }
     if (as) {
-        ad = demux_open_stream(as,
-                               audio_demuxer_type ? audio_demuxer_type : afmt,
-                               audio_demuxer_force, audio_id, -2, -2,
-                               audio_stream);
+        ad = demux_probe_stream(as,
+                                audio_demuxer_type ? audio_demuxer_type : afmt,
+                                audio_demuxer_force, audio_id, -2, -2,
+                                audio_stream);
         if (!ad) {
             mp_msg(MSGT_DEMUXER, MSGL_WARN, MSGTR_OpeningAudioDemuxerFailed,
                    audio_stream);
@@ -1267,9 +1284,9 @@ demuxer_t *demux_open(stream_t *vs, int file_format, int audio_id,
             hr_mp3_seek = 1;    // Enable high res seeking
     }
     if (ss) {
-        sd = demux_open_stream(ss, sub_demuxer_type ? sub_demuxer_type : sfmt,
-                               sub_demuxer_force, -2, -2, dvdsub_id,
-                               sub_stream);
+        sd = demux_probe_stream(ss, sub_demuxer_type ? sub_demuxer_type : sfmt,
+                                sub_demuxer_force, -2, -2, dvdsub_id,
+                                sub_stream);
         if (!sd) {
             mp_msg(MSGT_DEMUXER, MSGL_WARN,
                    MSGTR_OpeningSubtitlesDemuxerFailed, sub_stream);
@@ -96,16 +96,19 @@ void muxer_flush(muxer_t *m) {
       muxbuf_t tmp_buf;
       muxbuf_t *buf;
       muxer_stream_t *s;
+      struct demux_packet *packet;
       buf = m->muxbuf + num;
       s = buf->stream;
 
       /* 1. save timer and buffer (might have changed by now) */
       tmp_buf.dts = s->timer;
       tmp_buf.buffer = s->buffer;
+      packet = s->packet;
 
       /* 2. move stored timer and buffer into stream and mux it */
       s->timer = buf->dts;
       s->buffer = buf->buffer;
+      s->packet = NULL;
       m->cont_write_chunk(s, buf->len, buf->flags, buf->dts, buf->pts);
       free(buf->buffer);
       buf->buffer = NULL;
@@ -113,6 +116,7 @@ void muxer_flush(muxer_t *m) {
       /* 3. restore saved timer and buffer */
       s->timer = tmp_buf.dts;
       s->buffer = tmp_buf.buffer;
+      s->packet = packet;
     }
 
     free(m->muxbuf);
@@ -120,6 +124,22 @@ void muxer_flush(muxer_t *m) {
     m->muxbuf_num = 0;
 }
 
+static void release_packet(void *ref) {
+    free_demux_packet(ref);
+}
+
+/* Write data of stream s to the output file. When it lies in the demuxer
+ * packet the stream is copied from, the output keeps a reference to the
+ * packet and writes it from there instead of copying it. */
+void muxer_write_data(muxer_stream_t *s, unsigned char *data, size_t len) {
+    demux_packet_t *dp = s->packet;
+    if (dp && data >= dp->buffer && data + len <= dp->buffer + dp->len)
+        stream_write_ref(s->muxer->stream, data, len, release_packet,
+                         clone_demux_packet(dp));
+    else
+        stream_write_buffer(s->muxer->stream, data, len);
+}
+
 /* buffer frames until we either:
  * (a) have at least one non-empty frame from each stream
  * (b) run out of memory */
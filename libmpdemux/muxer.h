@@ -28,6 +28,8 @@
 
 #define MUXER_MAX_STREAMS 16
 
+struct demux_packet;
+
 #define MUXER_TYPE_VIDEO 0
 #define MUXER_TYPE_AUDIO 1
 
@@ -50,6 +52,8 @@ typedef struct {
   unsigned char *buffer;
   unsigned int buffer_size;
   unsigned int buffer_len;
+  // demuxer packet buffer points into when copying, written without copy:
+  struct demux_packet *packet;
   // mpeg block buffer:
   unsigned char *b_buffer;
   unsigned int b_buffer_size;	//size of b_buffer
@@ -91,8 +95,8 @@ typedef struct muxer_t{
   off_t movi_end;
   off_t file_end; // for MPEG it's system timestamp in 1/90000 s
   float audio_delay_fix;
-  // index:
-  AVIINDEXENTRY *idx;
+  // index, in blocks of AVIINDEXENTRY (see muxer_avi.c):
+  void **idx;
   int idx_pos;
   int idx_size;
   // streams:
@@ -137,6 +141,7 @@ void muxer_flush(muxer_t *m);
 #define muxer_new_stream(muxer,a) muxer->cont_new_stream(muxer,a)
 #define muxer_stream_fix_parameters(muxer, a) muxer->fix_stream_parameters(a)
 void muxer_write_chunk(muxer_stream_t *s, size_t len, unsigned int flags, double dts, double pts);
+void muxer_write_data(muxer_stream_t *s, unsigned char *data, size_t len);
 #define muxer_write_header(muxer) muxer->cont_write_header(muxer)
 #define muxer_write_index(muxer) muxer->cont_write_index(muxer)
 
@@ -64,10 +64,28 @@ struct avi_stream_info {
 	int riffofspos;
 	int riffofssize;
 	off_t *riffofs;
-	struct avi_odmlidx_entry *idx;
+	void **idx;
 	struct avi_odmlsuperidx_entry *superidx;
 };
 
+/* The indexes grow by whole blocks of IDX_BLOCK entries, so adding an entry
+ * never copies the ones before it, however long the file gets. */
+#define IDX_BLOCK 4096
+#define IDX_ENTRY(type, blocks, n) ((type *)(blocks)[(n) / IDX_BLOCK] + (n) % IDX_BLOCK)
+#define AVI_IDX(muxer, n) IDX_ENTRY(AVIINDEXENTRY, (muxer)->idx, n)
+#define ODML_IDX(si, n) IDX_ENTRY(struct avi_odmlidx_entry, (si)->idx, n)
+
+/// Make room for entry n of an index
+static void idx_grow(void ***blocks, int *size, int n, size_t entry_size)
+{
+    if (n >= *size) {
+        int nblocks = *size / IDX_BLOCK;
+        *blocks = realloc_struct(*blocks, nblocks + 1, sizeof(void *));
+        (*blocks)[nblocks] = malloc(IDX_BLOCK * entry_size);
+        *size += IDX_BLOCK;
+    }
+}
+
 static unsigned int avi_aspect(muxer_stream_t *vstream)
 {
     int x,y;
@@ -116,8 +134,7 @@ static muxer_stream_t* avifile_new_stream(muxer_t *muxer,int type){
     s->muxer=muxer;
     s->priv=si=malloc(sizeof(struct avi_stream_info));
     memset(si,0,sizeof(struct avi_stream_info));
-    si->idxsize=256;
-    si->idx=calloc(si->idxsize, sizeof(struct avi_odmlidx_entry));
+    idx_grow(&si->idx, &si->idxsize, 0, sizeof(struct avi_odmlidx_entry));
     si->riffofssize=16;
     si->riffofs=calloc((si->riffofssize+1), sizeof(off_t));
     memset(si->riffofs, 0, sizeof(off_t)*si->riffofssize);
@@ -168,6 +185,22 @@ if(len>0){
 }
 }
 
+// write a frame of stream s, from the demuxer packet when copying
+static void write_avi_stream_chunk(muxer_stream_t *s,int len){
+ int le_len = le2me_32(len);
+ int le_id = le2me_32(s->ckid);
+ stream_write_buffer(s->muxer->stream, &le_id, 4);
+ stream_write_buffer(s->muxer->stream, &le_len, 4);
+
+ if(len>0){
+   muxer_write_data(s, s->buffer, len);
+   if(len&1){  // padding
+     unsigned char zerobyte=0;
+     stream_write_buffer(s->muxer->stream, &zerobyte, 1);
+   }
+ }
+}
+
 static void write_avi_list(stream_t *stream, unsigned int id, int len)
 {
   unsigned int list_id = FOURCC_LIST;
@@ -282,7 +315,7 @@ static void avifile_write_header(muxer_t *muxer){
       muxer->avih.dwFlags|=AVIF_ISINTERLEAVED|AVIF_TRUSTCKTYPE;
       muxer->avih.dwTotalFrames=0;
       for (i=0; i<muxer->idx_pos; i++) {
-          if (muxer->idx[i].ckid == muxer->def_v->ckid)
+          if (AVI_IDX(muxer, i)->ckid == muxer->def_v->ckid)
               muxer->avih.dwTotalFrames++;
       }
 //      muxer->avih.dwSuggestedBufferSize=muxer->def_v->h.dwSuggestedBufferSize;
@@ -502,12 +535,18 @@ static void avifile_write_standard_index(muxer_t *muxer)
   muxer->movi_end = stream_tell(muxer->stream);
   if (muxer->idx && muxer->idx_pos>0) {
       int i;
+      unsigned int idxhdr[2];
       // fixup index entries:
 //      for (i = 0; i < muxer->idx_pos; i++) muxer->idx[i].dwChunkOffset -= muxer->movi_start - 4;
       // write index chunk:
-      for (i = 0; i < muxer->idx_pos; i++) le2me_AVIINDEXENTRY((&muxer->idx[i]));
-      write_avi_chunk(muxer->stream, ckidAVINEWINDEX, 16 * muxer->idx_pos, muxer->idx); /* AVIINDEXENTRY */
-      for (i = 0; i < muxer->idx_pos; i++) le2me_AVIINDEXENTRY((&muxer->idx[i]));
+      for (i = 0; i < muxer->idx_pos; i++) le2me_AVIINDEXENTRY(AVI_IDX(muxer, i));
+      idxhdr[0] = le2me_32(ckidAVINEWINDEX);
+      idxhdr[1] = le2me_32(16 * muxer->idx_pos);
+      stream_write_buffer(muxer->stream, idxhdr, sizeof(idxhdr));
+      for (i = 0; i < muxer->idx_pos; i += IDX_BLOCK) /* AVIINDEXENTRY */
+          stream_write_buffer(muxer->stream, muxer->idx[i / IDX_BLOCK],
+                              16 * FFMIN(IDX_BLOCK, muxer->idx_pos - i));
+      for (i = 0; i < muxer->idx_pos; i++) le2me_AVIINDEXENTRY(AVI_IDX(muxer, i));
       muxer->avih.dwFlags |= AVIF_HASINDEX;
   }
   muxer->file_end=stream_tell(muxer->stream);
@@ -540,29 +579,25 @@ static void avifile_write_chunk(muxer_stream_t *s,size_t len,unsigned int flags,
 
     if (vsi->riffofspos == 0) {
         // add to the traditional index:
-        if(muxer->idx_pos>=muxer->idx_size){
-            muxer->idx_size+=256; // 4kB
-            muxer->idx=realloc_struct(muxer->idx,muxer->idx_size,16);
-        }
-        muxer->idx[muxer->idx_pos].ckid=s->ckid;
-        muxer->idx[muxer->idx_pos].dwFlags=flags; // keyframe?
-        muxer->idx[muxer->idx_pos].dwChunkOffset=muxer->file_end-(muxer->movi_start-4);
-        muxer->idx[muxer->idx_pos].dwChunkLength=len;
+        AVIINDEXENTRY *entry;
+        idx_grow(&muxer->idx, &muxer->idx_size, muxer->idx_pos, sizeof(AVIINDEXENTRY));
+        entry = AVI_IDX(muxer, muxer->idx_pos);
+        entry->ckid=s->ckid;
+        entry->dwFlags=flags; // keyframe?
+        entry->dwChunkOffset=muxer->file_end-(muxer->movi_start-4);
+        entry->dwChunkLength=len;
         ++muxer->idx_pos;
     }
 
     // add to odml index
-    if(si->idxpos>=si->idxsize){
-	si->idxsize+=256;
-	si->idx=realloc_struct(si->idx,si->idxsize,sizeof(*si->idx));
-    }
-    si->idx[si->idxpos].flags=(flags&AVIIF_KEYFRAME)?0:ODML_NOTKEYFRAME;
-    si->idx[si->idxpos].ofs=muxer->file_end;
-    si->idx[si->idxpos].len=len;
+    idx_grow(&si->idx, &si->idxsize, si->idxpos, sizeof(struct avi_odmlidx_entry));
+    ODML_IDX(si, si->idxpos)->flags=(flags&AVIIF_KEYFRAME)?0:ODML_NOTKEYFRAME;
+    ODML_IDX(si, si->idxpos)->ofs=muxer->file_end;
+    ODML_IDX(si, si->idxpos)->len=len;
     ++si->idxpos;
   }
     // write out the chunk:
-    write_avi_chunk(muxer->stream,s->ckid,len,s->buffer); /* unsigned char */
+    write_avi_stream_chunk(s,len);
 
     if (len > s->h.dwSuggestedBufferSize){
 	s->h.dwSuggestedBufferSize = len;
@@ -596,15 +631,15 @@ static void avifile_odml_write_index(muxer_t *muxer){
     n = 0;
     entries_per_subidx = INT_MAX;
     do {
-	off_t start = si->idx[0].ofs;
+	off_t start = ODML_IDX(si, 0)->ofs;
 	last = entries_per_subidx;
 	for (j=0; j<si->idxpos; j++) {
-	    len = si->idx[j].ofs - start;
+	    len = ODML_IDX(si, j)->ofs - start;
 	    if(len >= ODML_CHUNKLEN || n >= entries_per_subidx) {
 		if (entries_per_subidx > n) {
 		    entries_per_subidx = n;
 		}
-		start = si->idx[j].ofs;
+		start = ODML_IDX(si, j)->ofs;
 		len = 0;
 		n = 0;
 	    }
@@ -623,12 +658,12 @@ static void avifile_odml_write_index(muxer_t *muxer){
 
     idxpos = 0;
     for (j=0; j<si->superidxpos; j++) {
-	off_t start = si->idx[idxpos].ofs;
+	off_t start = ODML_IDX(si, idxpos)->ofs;
 	int duration;
 
 	duration = 0;
 	for (k=0; k<entries_per_subidx && idxpos+k<si->idxpos; k++) {
-		duration += s->h.dwSampleSize ? si->idx[idxpos+k].len/s->h.dwSampleSize : 1;
+		duration += s->h.dwSampleSize ? ODML_IDX(si, idxpos+k)->len/s->h.dwSampleSize : 1;
 	}
 
 	idxhdr[0] = le2me_32((s->ckid << 16) | mmioFOURCC('i', 'x', 0, 0));
@@ -647,8 +682,8 @@ static void avifile_odml_write_index(muxer_t *muxer){
 	stream_write_buffer(muxer->stream, idxhdr,sizeof(idxhdr));
 	for (k=0; k<entries_per_subidx && idxpos<si->idxpos; k++) {
 	    unsigned int entry[2];
-	    entry[0] = le2me_32(si->idx[idxpos].ofs - start);
-	    entry[1] = le2me_32(si->idx[idxpos].len | si->idx[idxpos].flags);
+	    entry[0] = le2me_32(ODML_IDX(si, idxpos)->ofs - start);
+	    entry[1] = le2me_32(ODML_IDX(si, idxpos)->len | ODML_IDX(si, idxpos)->flags);
 	    idxpos++;
 	    stream_write_buffer(muxer->stream, entry, sizeof(entry));
 	}
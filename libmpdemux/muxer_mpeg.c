@@ -187,9 +187,11 @@ typedef struct {
 	uint32_t buffer_size;
 	double delta_clock, timer;
 	int drop_delayed_frames;
-	mpeg_frame_t *framebuf;
+	mpeg_frame_t *framebuf;	//ring of framebuf_cnt frames, the first one at framebuf_head
 	uint16_t framebuf_cnt;
 	uint16_t framebuf_used;
+	uint16_t framebuf_head;
+	size_t framebuf_bytes;	//bytes in the ring not written yet
 	int32_t last_tr;
 	int max_tr;
 	uint8_t id, is_mpeg12, telecine;
@@ -197,8 +199,8 @@ typedef struct {
 	int64_t display_frame;
 	mp_mpeg_header_t picture;
 	int max_buffer_size;
-	buffer_track_t *buffer_track;
-	int track_pos, track_len, track_bufsize;	//pos and len control the array, bufsize is the size of the buffer
+	buffer_track_t *buffer_track;	//ring of track_len entries, the first one at track_head
+	int track_head, track_pos, track_len, track_bufsize;	//pos is the number of entries used, bufsize is the size of the buffer
 	unsigned char *pack;
 	int pack_offset, pes_offset, pes_set, payload_offset;
 	int frames;
@@ -207,6 +209,23 @@ typedef struct {
 	int mpa_layer;
 } muxer_headers_t;
 
+//n-th buffered frame of a stream, the ring wraps at framebuf_cnt
+static inline mpeg_frame_t *frame_at(muxer_headers_t *spriv, int n)
+{
+	n += spriv->framebuf_head;
+	if(n >= spriv->framebuf_cnt)
+		n -= spriv->framebuf_cnt;
+	return &spriv->framebuf[n];
+}
+
+#define FRAME(spriv, n) (*frame_at(spriv, n))
+
+//frames and bytes buffered per stream at most, a few seconds are needed
+//normally, when either is reached the buffers are flushed without waiting
+//for the next GOP
+#define MAX_FRAMES 65535
+#define MAX_BUFFER_BYTES (64*1024*1024)
+
 #define PULLDOWN32 1
 #define TELECINE_FILM2PAL 2
 #define TELECINE_DGPULLDOWN 3
@@ -889,23 +908,37 @@ static int write_mpeg_pack(muxer_t *muxer, muxer_stream_t *s, stream_t *stream,
 
 static void update_demux_bufsize(muxer_headers_t *spriv, uint64_t dts, int framelen, int type)
 {
-	int dim = (spriv->track_len+16)*sizeof(buffer_track_t);
+	int i;
 
-	if(spriv->track_pos+1 >= spriv->track_len)
+	if(spriv->track_pos >= MAX_FRAMES)
+	{
+		//drop the oldest entry, as if it had left the buffer
+		spriv->track_bufsize -= spriv->buffer_track[spriv->track_head].size;
+		spriv->track_head = (spriv->track_head + 1) % spriv->track_len;
+		spriv->track_pos--;
+	}
+	else if(spriv->track_pos >= spriv->track_len)
 	{
-		buffer_track_t *tmp = realloc(spriv->buffer_track, dim);
+		//double the ring, unwrapping it into the new one
+		int len = FFMIN(2*spriv->track_len, MAX_FRAMES);
+		int dim = len*sizeof(buffer_track_t);
+		buffer_track_t *tmp = malloc(dim);
 		if(!tmp)
 		{
 			mp_msg(MSGT_MUXER, MSGL_ERR, "\r\nERROR, couldn't realloc %d bytes for tracking buffer\r\n", dim);
 			return;
 		}
+		for(i = 0; i < spriv->track_pos; i++)
+			tmp[i] = spriv->buffer_track[(spriv->track_head + i) % spriv->track_len];
+		free(spriv->buffer_track);
 		spriv->buffer_track = tmp;
-		memset(&(spriv->buffer_track[spriv->track_pos+1]), 0, 16*sizeof(buffer_track_t));
-		spriv->track_len += 16;
+		spriv->track_head = 0;
+		spriv->track_len = len;
 	}
 
-	spriv->buffer_track[spriv->track_pos].size = framelen;
-	spriv->buffer_track[spriv->track_pos].dts = dts;	//must be dts
+	i = (spriv->track_head + spriv->track_pos) % spriv->track_len;
+	spriv->buffer_track[i].size = framelen;
+	spriv->buffer_track[i].dts = dts;	//must be dts
 
 	spriv->track_pos++;
 }
@@ -928,15 +961,8 @@ static void fix_a52_headers(muxer_stream_t *s)
 
 static inline void remove_frames(muxer_headers_t *spriv, int n)
 {
-	mpeg_frame_t tmp;
-	int i;
-
-	for(i = n; i < spriv->framebuf_used; i++)
-	{
-		tmp = spriv->framebuf[i - n];
-		spriv->framebuf[i - n] = spriv->framebuf[i];
-		spriv->framebuf[i] = tmp;
-	}
+	//the buffers of the removed frames are reused at the end of the ring
+	spriv->framebuf_head = (spriv->framebuf_head + n) % spriv->framebuf_cnt;
 	spriv->framebuf_used -= n;
 }
 
@@ -946,15 +972,15 @@ static int calc_packet_len(muxer_stream_t *s, int psize, int finalize)
 	int n, len, frpos, m;
 
 	n = len = 0;
-	frpos = spriv->framebuf[0].pos;
+	frpos = FRAME(spriv, 0).pos;
 	while(len < psize && n < spriv->framebuf_used)
 	{
-		if(!frpos && len>0 && s->type == MUXER_TYPE_VIDEO && spriv->framebuf[n].type==I_FRAME)
+		if(!frpos && len>0 && s->type == MUXER_TYPE_VIDEO && FRAME(spriv, n).type==I_FRAME)
 			return len;
-		m = FFMIN(spriv->framebuf[n].size - frpos, psize - len);
+		m = FFMIN(FRAME(spriv, n).size - frpos, psize - len);
 		len += m;
 		frpos += m;
-		if(frpos == spriv->framebuf[n].size)
+		if(frpos == FRAME(spriv, n).size)
 		{
 			frpos = 0;
 			n++;
@@ -979,7 +1005,7 @@ static int find_packet_timestamps(muxer_priv_t *priv, muxer_stream_t *s, unsigne
 	sdts = spriv->dts;
 	spriv->dts = spriv->pts = 0;
 	ret = 0;
-	if(spriv->framebuf[0].pos == 0)	// start of frame
+	if(FRAME(spriv, 0).pos == 0)	// start of frame
 		i = 0;
 	else
 	{
@@ -988,7 +1014,7 @@ static int find_packet_timestamps(muxer_priv_t *priv, muxer_stream_t *s, unsigne
 		if(pes_hlen < spriv->min_pes_hlen)
 			pes_hlen = spriv->min_pes_hlen;
 
-		m = spriv->framebuf[0].size - spriv->framebuf[0].pos;
+		m = FRAME(spriv, 0).size - FRAME(spriv, 0).pos;
 
 		if(start + pes_hlen + m  >= priv->packet_size)	//spriv->pack_offset
 			i = -1;	//this pack won't have a pts: no space available
@@ -997,7 +1023,7 @@ static int find_packet_timestamps(muxer_priv_t *priv, muxer_stream_t *s, unsigne
 			if(spriv->framebuf_used < 2)
 				goto fail;
 
-			if(spriv->framebuf[1].pts == spriv->framebuf[1].dts)
+			if(FRAME(spriv, 1).pts == FRAME(spriv, 1).dts)
 				threshold = 5;
 			else
 				threshold = 10;
@@ -1012,19 +1038,19 @@ static int find_packet_timestamps(muxer_priv_t *priv, muxer_stream_t *s, unsigne
 
 	if(i > -1)
 	{
-		dpts = FFMAX(spriv->last_saved_pts, spriv->framebuf[i].pts) -
-			FFMIN(spriv->last_saved_pts, spriv->framebuf[i].pts) +
-			spriv->framebuf[0].idur;
+		dpts = FFMAX(spriv->last_saved_pts, FRAME(spriv, i).pts) -
+			FFMIN(spriv->last_saved_pts, FRAME(spriv, i).pts) +
+			FRAME(spriv, 0).idur;
 
 		if(s->type != MUXER_TYPE_VIDEO)
 			ret = 1;
-		else if((spriv->framebuf[i].type == I_FRAME || priv->ts_allframes || dpts >= 36000*300))	//0.4 seconds
+		else if((FRAME(spriv, i).type == I_FRAME || priv->ts_allframes || dpts >= 36000*300))	//0.4 seconds
 			ret = 1;
 
 		if(ret)
 		{
-			*pts = spriv->framebuf[i].pts;
-			*dts = spriv->framebuf[i].dts;
+			*pts = FRAME(spriv, i).pts;
+			*dts = FRAME(spriv, i).dts;
 			if(*dts == *pts)
 				*dts = 0;
 		}
@@ -1187,7 +1213,7 @@ static int fill_packet(muxer_t *muxer, muxer_stream_t *s, int finalize)
 		}
 
 		if(priv->is_dvd && s->type == MUXER_TYPE_VIDEO
-			&& spriv->framebuf[0].type==I_FRAME && spriv->framebuf[0].pos==0)
+			&& FRAME(spriv, 0).type==I_FRAME && FRAME(spriv, 0).pos==0)
 			dvd_pack = 1;
 
 		if(! get_packet_stats(priv, s, &p, finalize))
@@ -1207,10 +1233,10 @@ static int fill_packet(muxer_t *muxer, muxer_stream_t *s, int finalize)
 		{
 			spriv->payload_offset = spriv->pack_offset;
 			spriv->pack_offset += 4;	//for the 4 bytes of header
-			if(!spriv->framebuf[0].pos)
+			if(!FRAME(spriv, 0).pos)
 				spriv->last_frame_rest = 0;
 			else
-				spriv->last_frame_rest = spriv->framebuf[0].size - spriv->framebuf[0].pos;
+				spriv->last_frame_rest = FRAME(spriv, 0).size - FRAME(spriv, 0).pos;
 		}
 
 		spriv->pes_set = 1;
@@ -1228,9 +1254,9 @@ static int fill_packet(muxer_t *muxer, muxer_stream_t *s, int finalize)
 	n = 0;
 	len = 0;
 
-	frm = spriv->framebuf;
 	while(spriv->pack_offset < priv->packet_size && n < spriv->framebuf_used)
 	{
+		frm = frame_at(spriv, n);
 		if(!frm->pos)
 		{
 			//since iframes must always be aligned at block boundaries exit when we find the
@@ -1248,6 +1274,7 @@ static int fill_packet(muxer_t *muxer, muxer_stream_t *s, int finalize)
 
 		len += m;
 		spriv->pack_offset += m;
+		spriv->framebuf_bytes -= m;
 		frm->pos += m;
 
 		if(frm->pos == frm->size)	//end of frame
@@ -1255,7 +1282,6 @@ static int fill_packet(muxer_t *muxer, muxer_stream_t *s, int finalize)
 			frm->pos = frm->size = 0;
 			frm->pts = frm->dts = 0;
 			n++;
-			frm++;
 		}
 	}
 
@@ -1324,9 +1350,9 @@ static inline int find_best_stream(muxer_t *muxer)
 		if(p.frame_pts && p.frame_dts > priv->scr + 63000*300)
 			continue;
 
-		if(spriv->framebuf[0].dts <= dts)
+		if(FRAME(spriv, 0).dts <= dts)
 		{
-			dts = spriv->framebuf[0].dts;
+			dts = FRAME(spriv, 0).dts;
 			ndts = i;
 		}
 
@@ -1413,8 +1439,8 @@ static void update_scr(muxer_t *muxer)
 	{
 		stream = muxer->streams[i];
 		spriv = stream->priv;
-		if(spriv->framebuf_used && spriv->framebuf[0].dts < mindts)
-			mindts = spriv->framebuf[0].dts;
+		if(spriv->framebuf_used && FRAME(spriv, 0).dts < mindts)
+			mindts = FRAME(spriv, 0).dts;
 	}
 
 	mp_msg(MSGT_MUXER, MSGL_DBG2, "UPDATE SCR TO %"PRIu64" (%.3f)\n", priv->scr, (double) (priv->scr/27000000.0));
@@ -1425,9 +1451,9 @@ static void update_scr(muxer_t *muxer)
 		spriv = stream->priv;
 
 		j = 0;
-		while(j < spriv->track_pos && priv->scr >= spriv->buffer_track[j].dts)
+		while(j < spriv->track_pos && priv->scr >= spriv->buffer_track[(spriv->track_head + j) % spriv->track_len].dts)
 		{
-			spriv->track_bufsize -= spriv->buffer_track[j].size;
+			spriv->track_bufsize -= spriv->buffer_track[(spriv->track_head + j) % spriv->track_len].size;
 			j++;
 		}
 		if(spriv->track_bufsize < 0)
@@ -1442,14 +1468,12 @@ static void update_scr(muxer_t *muxer)
 
 		if(j > 0)
 		{
-			memmove(spriv->buffer_track, &(spriv->buffer_track[j]), (spriv->track_len - j) * sizeof(buffer_track_t));
+			spriv->track_head = (spriv->track_head + j) % spriv->track_len;
 			spriv->track_pos -= j;
-			for(j = spriv->track_pos; j < spriv->track_len; j++)
-				spriv->buffer_track[j].size = 0;
 		}
 
-		if(spriv->framebuf_used && spriv->framebuf[0].dts < mindts)
-			mindts = spriv->framebuf[0].dts;
+		if(spriv->framebuf_used && FRAME(spriv, 0).dts < mindts)
+			mindts = FRAME(spriv, 0).dts;
 	}
 }
 
@@ -1465,11 +1489,11 @@ static int calc_frames_to_flush(muxer_headers_t *vpriv)
 		mp_msg(MSGT_MUXER, MSGL_DBG2, "\n");
 		while(n < vpriv->framebuf_used)
 		{
-			mp_msg(MSGT_MUXER, MSGL_DBG2, "CALC_FRAMES, n=%d, type=%c, pts=%.3f\n", n, FTYPE(vpriv->framebuf[n].type), (double)vpriv->framebuf[n].pts/27000000.0f);
+			mp_msg(MSGT_MUXER, MSGL_DBG2, "CALC_FRAMES, n=%d, type=%c, pts=%.3f\n", n, FTYPE(FRAME(vpriv, n).type), (double)FRAME(vpriv, n).pts/27000000.0f);
 			if(n+1 < vpriv->framebuf_used)
-				mp_msg(MSGT_MUXER, MSGL_DBG2, "n+1=%d, type=%c, pts=%.3f\n", n+1, FTYPE(vpriv->framebuf[n+1].type), (double)vpriv->framebuf[n+1].pts/27000000.0f);
+				mp_msg(MSGT_MUXER, MSGL_DBG2, "n+1=%d, type=%c, pts=%.3f\n", n+1, FTYPE(FRAME(vpriv, n+1).type), (double)FRAME(vpriv, n+1).pts/27000000.0f);
 
-			if(vpriv->framebuf[n].type == I_FRAME)
+			if(FRAME(vpriv, n).type == I_FRAME)
 			{
 				if(n > 0)
 				{
@@ -1488,9 +1512,24 @@ static int calc_frames_to_flush(muxer_headers_t *vpriv)
 		return 0;
 }
 
+//check if a stream has buffered so much that it must be flushed right away
+static int buffers_full(muxer_t *muxer)
+{
+	int i;
+
+	for(i = 0; i < muxer->avih.dwStreams; i++)
+	{
+		muxer_headers_t *spriv = muxer->streams[i]->priv;
+		if(spriv->framebuf_used >= MAX_FRAMES / 2 ||
+		   spriv->framebuf_bytes >= MAX_BUFFER_BYTES / 2)
+			return 1;
+	}
+	return 0;
+}
+
 static int flush_buffers(muxer_t *muxer, int finalize)
 {
-	int i, n, found;
+	int i, n, found, full;
 	int skip_cnt;
 	uint64_t init_delay = 0;
 	muxer_stream_t *s, *vs, *as;
@@ -1522,10 +1561,13 @@ static int flush_buffers(muxer_t *muxer, int finalize)
 			as = s;
 	}
 
-	if((! found) && finalize)
+	full = buffers_full(muxer);
+	if((! found) && (finalize || full))
 	{
 		if(vpriv != NULL)
 			found = n = vpriv->framebuf_used;
+		if(full && found)
+			mp_msg(MSGT_MUXER, MSGL_WARN, "\r\nMuxer buffers full, flushing %d frames without waiting for the next GOP\r\n", n);
 	}
 
 	if(found)
@@ -1537,7 +1579,7 @@ static int flush_buffers(muxer_t *muxer, int finalize)
 		duration = 0;
 		iduration = 0;
 		for(i = 0; i < n; i++)
-			iduration += vpriv->framebuf[i].idur;
+			iduration += FRAME(vpriv, i).idur;
 		duration = (double) (iduration / 27000000.0);
 
 		if(as != NULL)
@@ -1546,9 +1588,9 @@ static int flush_buffers(muxer_t *muxer, int finalize)
 			iaduration = 0;
 			for(i = 0; i < apriv->framebuf_used; i++)
 			{
-				iaduration += apriv->framebuf[i].idur;
+				iaduration += FRAME(apriv, i).idur;
 			}
-			if(iaduration < iduration)
+			if(iaduration < iduration && !full)
 			{
 				mp_msg(MSGT_MUXER, MSGL_DBG2, "Not enough audio data exit\n");
 				return 0;
@@ -1557,12 +1599,12 @@ static int flush_buffers(muxer_t *muxer, int finalize)
 
 		if(as != NULL && (apriv->size == 0))
 		{
-			init_delay = vpriv->framebuf[0].pts - vpriv->framebuf[0].dts;
+			init_delay = FRAME(vpriv, 0).pts - FRAME(vpriv, 0).dts;
 
 			for(i = 0; i < apriv->framebuf_cnt; i++)
 			{
-				apriv->framebuf[i].pts += init_delay;
-				apriv->framebuf[i].dts += init_delay;
+				FRAME(apriv, i).pts += init_delay;
+				FRAME(apriv, i).dts += init_delay;
 			}
 			apriv->last_pts += init_delay;
 			mp_msg(MSGT_MUXER, MSGL_DBG2, "\r\nINITIAL VIDEO DELAY: %.3f, currAPTS: %.3f\r\n", (double) init_delay/27000000.0f, (double) apriv->last_pts/27000000.0f);
@@ -1795,9 +1837,9 @@ static size_t parse_mpeg12_video(muxer_stream_t *s, muxer_priv_t *priv, muxer_he
 
 			for(j = n; j >= 0; j--)
 			{
-				if(spriv->framebuf[j].pts >= spriv->last_pts)
+				if(FRAME(spriv, j).pts >= spriv->last_pts)
 				{
-					spriv->framebuf[j].pts += diff;
+					FRAME(spriv, j).pts += diff;
 					adj++;
 				}
 			}
@@ -1818,20 +1860,20 @@ static uint64_t fix_mp4_frame_duration(muxer_headers_t *vpriv)
 	uint64_t mn, md, mx, diff;
 	uint32_t i;
 
-	mn = mx = vpriv->framebuf[0].pts;
+	mn = mx = FRAME(vpriv, 0).pts;
 	for(i = 0; i < 3; i++)
 	{
-		mp_msg(MSGT_DECVIDEO,MSGL_DBG2, "PTS: %"PRIu64"\n", vpriv->framebuf[i].pts);
-		if(vpriv->framebuf[i].pts < mn)
-			mn = vpriv->framebuf[i].pts;
-		if(vpriv->framebuf[i].pts > mx)
-			mx = vpriv->framebuf[i].pts;
+		mp_msg(MSGT_DECVIDEO,MSGL_DBG2, "PTS: %"PRIu64"\n", FRAME(vpriv, i).pts);
+		if(FRAME(vpriv, i).pts < mn)
+			mn = FRAME(vpriv, i).pts;
+		if(FRAME(vpriv, i).pts > mx)
+			mx = FRAME(vpriv, i).pts;
 	}
 	md = mn;
 	for(i=0; i<3; i++)
 	{
-		if((vpriv->framebuf[i].pts > mn) && (vpriv->framebuf[i].pts < mx))
-		md = vpriv->framebuf[i].pts;
+		if((FRAME(vpriv, i).pts > mn) && (FRAME(vpriv, i).pts < mx))
+		md = FRAME(vpriv, i).pts;
 	}
 
 	if(mx - md > md - mn)
@@ -1844,10 +1886,10 @@ static uint64_t fix_mp4_frame_duration(muxer_headers_t *vpriv)
 	{
 		for(i=0; i<3; i++)
 		{
-			vpriv->framebuf[i].pts += diff;
-			vpriv->framebuf[i].dts += i * diff;
+			FRAME(vpriv, i).pts += diff;
+			FRAME(vpriv, i).dts += i * diff;
 			mp_msg(MSGT_MUXER, MSGL_DBG2, "FIXED_PTS: %.3f, FIXED_DTS: %.3f\n",
-				(double) (vpriv->framebuf[i].pts/27000000.0), (double) (vpriv->framebuf[i].dts/27000000.0));
+				(double) (FRAME(vpriv, i).pts/27000000.0), (double) (FRAME(vpriv, i).dts/27000000.0));
 		}
 		return diff;
 	}
@@ -1933,7 +1975,7 @@ static size_t parse_mpeg4_video(muxer_stream_t *s, muxer_priv_t *priv, muxer_hea
 		if(vpriv->frame_duration)
 		{
 			vpriv->last_pts += vpriv->frame_duration;
-			vpriv->last_dts = vpriv->framebuf[vpriv->framebuf_used-1].dts;
+			vpriv->last_dts = FRAME(vpriv, vpriv->framebuf_used-1).dts;
 			vpriv->delta_clock = ((double) vpriv->frame_duration)/27000000.0;
 			mp_msg(MSGT_MUXER, MSGL_INFO, "FRAME DURATION: %"PRIu64"   %.3f\n",
 				vpriv->frame_duration, (double) (vpriv->frame_duration/27000000.0));
@@ -1962,18 +2004,19 @@ static int fill_last_frame(muxer_headers_t *spriv,  uint8_t *ptr, int len)
 	else
 		idx = spriv->framebuf_used - 1;
 
-	if(spriv->framebuf[idx].alloc_size < spriv->framebuf[idx].size + len)
+	if(FRAME(spriv, idx).alloc_size < FRAME(spriv, idx).size + len)
 	{
-		if(spriv->framebuf[idx].size > SIZE_MAX - (size_t)len)
+		if(FRAME(spriv, idx).size > SIZE_MAX - (size_t)len)
 			return 0;
-		spriv->framebuf[idx].buffer = realloc(spriv->framebuf[idx].buffer, spriv->framebuf[idx].size + len);
-		if(! spriv->framebuf[idx].buffer)
+		FRAME(spriv, idx).buffer = realloc(FRAME(spriv, idx).buffer, FRAME(spriv, idx).size + len);
+		if(! FRAME(spriv, idx).buffer)
 			return 0;
-		spriv->framebuf[idx].alloc_size = spriv->framebuf[idx].size + len;
+		FRAME(spriv, idx).alloc_size = FRAME(spriv, idx).size + len;
 	}
 
-	memcpy(&(spriv->framebuf[idx].buffer[spriv->framebuf[idx].size]), ptr, len);
-	spriv->framebuf[idx].size += len;
+	memcpy(&(FRAME(spriv, idx).buffer[FRAME(spriv, idx).size]), ptr, len);
+	FRAME(spriv, idx).size += len;
+	spriv->framebuf_bytes += len;
 
 	return len;
 }
@@ -1981,55 +2024,66 @@ static int fill_last_frame(muxer_headers_t *spriv,  uint8_t *ptr, int len)
 static int add_frame(muxer_headers_t *spriv, uint64_t idur, uint8_t *ptr, int len, uint8_t pt, uint64_t dts, uint64_t pts)
 {
 	int idx;
+	mpeg_frame_t *frm;
+
+	if(spriv->framebuf_bytes + len > MAX_BUFFER_BYTES)
+	{
+		mp_msg(MSGT_MUXER, MSGL_ERR, "More than %d bytes buffered, dropping frame\n", MAX_BUFFER_BYTES);
+		return -1;
+	}
 
 	idx = spriv->framebuf_used;
 	if(idx >= spriv->framebuf_cnt)
 	{
-		spriv->framebuf = realloc_struct(spriv->framebuf, (spriv->framebuf_cnt+1), sizeof(mpeg_frame_t));
-		if(spriv->framebuf == NULL)
+		//double the ring, unwrapping it into the new one
+		int i, cnt = FFMIN(2 * spriv->framebuf_cnt, MAX_FRAMES);
+		mpeg_frame_t *tmp;
+
+		if(idx >= MAX_FRAMES)
 		{
-			mp_msg(MSGT_MUXER, MSGL_FATAL, "Couldn't realloc frame buffer(idx), abort\n");
+			mp_msg(MSGT_MUXER, MSGL_ERR, "More than %d frames buffered, dropping frame\n", MAX_FRAMES);
 			return -1;
 		}
-
-		spriv->framebuf[spriv->framebuf_cnt].size = 0;
-		spriv->framebuf[spriv->framebuf_cnt].alloc_size = 0;
-		spriv->framebuf[spriv->framebuf_cnt].pos = 0;
-
-		spriv->framebuf[spriv->framebuf_cnt].buffer = malloc(len);
-		if(spriv->framebuf[spriv->framebuf_cnt].buffer == NULL)
+		tmp = calloc(cnt, sizeof(mpeg_frame_t));
+		if(tmp == NULL)
 		{
-			mp_msg(MSGT_MUXER, MSGL_FATAL, "Couldn't realloc frame buffer(frame), abort\n");
+			mp_msg(MSGT_MUXER, MSGL_FATAL, "Couldn't realloc frame buffer(idx), abort\n");
 			return -1;
 		}
-		spriv->framebuf[spriv->framebuf_cnt].alloc_size = len;
-		spriv->framebuf_cnt++;
+		for(i = 0; i < spriv->framebuf_cnt; i++)
+			tmp[i] = FRAME(spriv, i);
+		free(spriv->framebuf);
+		spriv->framebuf = tmp;
+		spriv->framebuf_head = 0;
+		spriv->framebuf_cnt = cnt;
 	}
 
-	if(spriv->framebuf[idx].alloc_size < spriv->framebuf[idx].size + len)
+	frm = frame_at(spriv, idx);
+	if(frm->alloc_size < frm->size + len)
 	{
-		if(spriv->framebuf[idx].size > SIZE_MAX - (size_t)len)
+		if(frm->size > SIZE_MAX - (size_t)len)
 		{
 			mp_msg(MSGT_MUXER, MSGL_FATAL, "Size overflow, couldn't realloc frame buffer(frame), abort\n");
 			return -1;
 		}
-		spriv->framebuf[idx].buffer = realloc(spriv->framebuf[idx].buffer, spriv->framebuf[idx].size + len);
-		if(spriv->framebuf[idx].buffer == NULL)
+		frm->buffer = realloc(frm->buffer, frm->size + len);
+		if(frm->buffer == NULL)
 		{
 			mp_msg(MSGT_MUXER, MSGL_FATAL, "Couldn't realloc frame buffer(frame), abort\n");
 			return -1;
 		}
-		spriv->framebuf[idx].alloc_size = spriv->framebuf[idx].size + len;
+		frm->alloc_size = frm->size + len;
 	}
 
-	memcpy(&(spriv->framebuf[idx].buffer[spriv->framebuf[idx].size]), ptr, len);
-	spriv->framebuf[idx].size += len;
-	spriv->framebuf[idx].pos = 0;
-	spriv->framebuf[idx].type = pt;
+	memcpy(&(frm->buffer[frm->size]), ptr, len);
+	frm->size += len;
+	spriv->framebuf_bytes += len;
+	frm->pos = 0;
+	frm->type = pt;
 
-	spriv->framebuf[idx].idur = idur;
-	spriv->framebuf[idx].dts = dts;
-	spriv->framebuf[idx].pts = pts;
+	frm->idur = idur;
+	frm->dts = dts;
+	frm->pts = pts;
 	spriv->framebuf_used++;
 	mp_msg(MSGT_MUXER, MSGL_DBG2, "\r\nAdded frame, size: %u, idur: %"PRIu64", dts: %"PRIu64", pts: %"PRIu64", used: %u\r\n", len, idur, dts, pts, spriv->framebuf_used);
 
@@ -2184,7 +2238,7 @@ static int parse_audio(muxer_stream_t *s, int finalize, unsigned int *nf, double
 			goto audio_exit;
 		}
 		for(j = frm_idx; j < spriv->framebuf_cnt; j++)
-			spriv->framebuf[j].pts = spriv->last_pts;
+			FRAME(spriv, j).pts = spriv->last_pts;
 		spriv->last_pts += idur;
 
 		i += len;
@@ -2208,7 +2262,7 @@ audio_exit:
 		if(frm_idx >= 0)
 		{
 			for(j = frm_idx; j < spriv->framebuf_cnt; j++)
-				spriv->framebuf[j].pts = spriv->last_pts;
+				FRAME(spriv, j).pts = spriv->last_pts;
 		}
 	}
 
@@ -55,21 +55,19 @@ static muxer_stream_t* rawvideofile_new_stream(muxer_t *muxer,int type){
     return s;
 }
 
-static void write_rawvideo_chunk(stream_t *stream,int len,void* data){
+static void write_rawvideo_chunk(muxer_stream_t *s,int len,void* data){
     if(len>0){
 	if(data){
 	    // DATA
-            stream_write_buffer(stream,data,len);
+            muxer_write_data(s,data,len);
 	}
     }
 }
 
 static void rawvideofile_write_chunk(muxer_stream_t *s,size_t len,unsigned int flags, double dts, double pts){
-    muxer_t *muxer=s->muxer;
-
     // write out the chunk:
     if (s->type == MUXER_TYPE_VIDEO)
-    write_rawvideo_chunk(muxer->stream,len,s->buffer); /* unsigned char */
+    write_rawvideo_chunk(s,len,s->buffer); /* unsigned char */
 
     // if((unsigned int)len>s->h.dwSuggestedBufferSize) s->h.dwSuggestedBufferSize=len;
 
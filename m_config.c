@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
 #ifdef MP_DEBUG
 #include <assert.h>
 #endif
@@ -223,14 +224,51 @@ m_config_free(m_config_t* config) {
     free(p->opts);
     free(p);
   }
+  free(config->hash);
   free(config->self_opts);
   free(config);
 }
 
+/// Put a slot for level lvl on top of the save stack of co.
+/** The slot starts with the value of the slot below.
+ */
+static m_config_save_slot_t*
+m_config_new_slot(m_config_option_t *co, int lvl) {
+  m_config_save_slot_t *slot;
+
+  slot = calloc(1,sizeof(m_config_save_slot_t) + co->opt->type->size);
+  if(!slot)
+    return NULL;
+  slot->lvl = lvl;
+  slot->prev = co->slots;
+  co->slots = slot;
+  m_option_copy(co->opt,slot->data,slot->prev->data);
+  return slot;
+}
+
+/// Check if the variable of an option differs from a saved value.
+/** Values that can't be compared count as changed.
+ */
+static int
+m_config_value_changed(const m_option_t *opt, const void *data) {
+  const m_option_type_t *type = opt->type;
+
+  if(type->flags & M_OPT_TYPE_INDIRECT)
+    return 1;
+  if(!opt->p || !type->size)
+    return 0;
+  if(type == &m_option_type_string) {
+    const char *a = *(char**)opt->p, *b = *(const char**)data;
+    return a != b && (!a || !b || strcmp(a,b));
+  }
+  if(type->flags & M_OPT_TYPE_DYNAMIC)
+    return 1;
+  return memcmp(opt->p,data,type->size) != 0;
+}
+
 void
 m_config_push(m_config_t* config) {
   m_config_option_t *co;
-  m_config_save_slot_t *slot;
 
 #ifdef MP_DEBUG
   assert(config != NULL);
@@ -239,6 +277,8 @@ m_config_push(m_config_t* config) {
 
   config->lvl++;
 
+  // Levels only get a slot for the options they set, but the variables
+  // may have been changed without the config in the meantime, keep that.
   for(co = config->opts ; co ; co = co->next ) {
     if(co->opt->type->flags & M_OPT_TYPE_HAS_CHILD)
       continue;
@@ -249,15 +289,17 @@ m_config_push(m_config_t* config) {
     if(co->flags & M_CFG_OPT_ALIAS)
       continue;
 
-    // Update the current status
-    m_option_save(co->opt,co->slots->data,co->opt->p);
-
-    // Allocate a new slot
-    slot = calloc(1,sizeof(m_config_save_slot_t) + co->opt->type->size);
-    slot->lvl = config->lvl;
-    slot->prev = co->slots;
-    co->slots = slot;
-    m_option_copy(co->opt,co->slots->data,co->slots->prev->data);
+    if(co->opt->flags & M_OPT_OLD) {
+      // Old options still get a slot on every level
+      m_option_save(co->opt,co->slots->data,co->opt->p);
+      m_config_new_slot(co,config->lvl);
+    } else if(co->opt->type->save &&
+              m_config_value_changed(co->opt,co->slots->data)) {
+      // Update the current status, without touching the lower levels
+      if(co->slots->lvl < config->lvl - 1)
+        m_config_new_slot(co,config->lvl - 1);
+      m_option_save(co->opt,co->slots->data,co->opt->p);
+    }
     // Reset our set flag
     co->flags &= ~M_CFG_OPT_SET;
   }
@@ -293,7 +335,9 @@ m_config_pop(m_config_t* config) {
       free(slot);
       pop++;
     }
-    if(pop) // We removed some ctx -> set the previous value
+    // We removed some ctx or the variable was changed -> set the previous value
+    if(pop || (!(co->opt->flags & M_OPT_OLD) &&
+               m_config_value_changed(co->opt,co->slots->data)))
       m_option_set(co->opt,co->opt->p,co->slots->data);
   }
 
@@ -301,6 +345,64 @@ m_config_pop(m_config_t* config) {
   mp_msg(MSGT_CFGPARSER, MSGL_DBG2,"Config poped level=%d\n",config->lvl);
 }
 
+static int
+m_config_is_wildcard(const m_config_option_t *co) {
+  int l = strlen(co->name) - 1;
+  return (co->opt->type->flags & M_OPT_TYPE_ALLOW_WILDCARD) &&
+         l >= 0 && co->name[l] == '*';
+}
+
+static unsigned int
+m_config_hash_name(const char *name) {
+  unsigned int h = 2166136261U;
+  for( ; *name ; name++)
+    h = (h ^ tolower((unsigned char)*name)) * 16777619U;
+  return h;
+}
+
+/// Rebuild the hash from the option list with size buckets.
+static int
+m_config_rehash(m_config_t *config, int size) {
+  m_config_option_t *co, **hash;
+
+  hash = calloc(size,sizeof(m_config_option_t*));
+  if(!hash)
+    return 0;
+  free(config->hash);
+  config->hash = hash;
+  config->hash_size = size;
+  for(co = config->opts ; co ; co = co->next) {
+    unsigned int h;
+    if(m_config_is_wildcard(co))
+      continue;
+    h = m_config_hash_name(co->name) & (size - 1);
+    co->hash_next = hash[h];
+    hash[h] = co;
+  }
+  return 1;
+}
+
+/// Index an option that was just put at the head of the option list.
+static void
+m_config_hash_option(m_config_t *config, m_config_option_t *co) {
+  unsigned int h;
+
+  co->index = ++config->num_opts;
+  if(m_config_is_wildcard(co)) {
+    co->hash_next = config->wildcards;
+    config->wildcards = co;
+    return;
+  }
+  if(++config->num_hashed > config->hash_size &&
+     m_config_rehash(config,config->hash_size ? 2*config->hash_size : 256))
+    return;
+  if(!config->hash)
+    return;
+  h = m_config_hash_name(co->name) & (config->hash_size - 1);
+  co->hash_next = config->hash[h];
+  config->hash[h] = co;
+}
+
 static void
 m_config_add_option(m_config_t *config, const m_option_t *arg, const char* prefix) {
   m_config_option_t *co;
@@ -329,6 +431,7 @@ m_config_add_option(m_config_t *config, const m_option_t *arg, const char* prefi
     const m_option_t *ol = arg->p;
     int i;
     co->slots = NULL;
+    co->owner = co;
     for(i = 0 ; ol[i].name != NULL ; i++)
       m_config_add_option(config,&ol[i], co->name);
   } else {
@@ -337,7 +440,7 @@ m_config_add_option(m_config_t *config, const m_option_t *arg, const char* prefi
     if(arg->p) {
       for(i = config->opts ; i ; i = i->next ) {
 	if(i->opt->p == arg->p) { // So we don't save the same vars more than 1 time
-	  co->slots = i->slots;
+	  co->owner = i->owner;
 	  co->flags |= M_CFG_OPT_ALIAS;
 	  break;
 	}
@@ -359,10 +462,12 @@ m_config_add_option(m_config_t *config, const m_option_t *arg, const char* prefi
     co->slots->prev = sl;
     co->slots->lvl = config->lvl;
     m_option_copy(co->opt,co->slots->data,sl->data);
+    co->owner = co;
     } // !M_OPT_ALIAS
   }
   co->next = config->opts;
   config->opts = co;
+  m_config_hash_option(config,co);
 }
 
 int
@@ -383,18 +488,31 @@ m_config_register_options(m_config_t *config, const m_option_t *args) {
 
 static m_config_option_t*
 m_config_get_co(const m_config_t *config, char *arg) {
-  m_config_option_t *co;
-
-  for(co = config->opts ; co ; co = co->next ) {
-    int l = strlen(co->name) - 1;
-    if((co->opt->type->flags & M_OPT_TYPE_ALLOW_WILDCARD) &&
-       (co->name[l] == '*')) {
-      if(strncasecmp(co->name,arg,l) == 0)
-	return co;
-    } else if(strcasecmp(co->name,arg) == 0)
-      return co;
+  m_config_option_t *co, *found = NULL;
+
+  if(!config->hash) {
+    for(co = config->opts ; co ; co = co->next ) {
+      int l = strlen(co->name) - 1;
+      if((co->opt->type->flags & M_OPT_TYPE_ALLOW_WILDCARD) &&
+         (co->name[l] == '*')) {
+        if(strncasecmp(co->name,arg,l) == 0)
+          return co;
+      } else if(strcasecmp(co->name,arg) == 0)
+        return co;
+    }
+    return NULL;
   }
-  return NULL;
+
+  // When several options match the last registered one wins
+  co = config->hash[m_config_hash_name(arg) & (config->hash_size - 1)];
+  for( ; co ; co = co->hash_next)
+    if((!found || co->index > found->index) && strcasecmp(co->name,arg) == 0)
+      found = co;
+  for(co = config->wildcards ; co ; co = co->hash_next)
+    if((!found || co->index > found->index) &&
+       strncasecmp(co->name,arg,strlen(co->name) - 1) == 0)
+      found = co;
+  return found;
 }
 
 static int
@@ -467,15 +585,23 @@ m_config_parse_option(const m_config_t *config, char *arg, char *param, int set)
       free(lst[2*i+1]);
     }
     free(lst);
-  } else
-    r = m_option_parse(co->opt,arg,param,set ? co->slots->data : NULL,config->mode);
+  } else {
+    m_config_option_t *owner = co->owner;
+    // Give the current level its own slot on the first change
+    if(set && !(co->opt->flags & M_OPT_OLD) && owner->slots &&
+       owner->slots->lvl < config->lvl &&
+       !m_config_new_slot(owner,config->lvl))
+      return M_OPT_INVALID;
+    r = m_option_parse(co->opt,arg,param,set ? owner->slots->data : NULL,config->mode);
+  }
 
   // Parsing failed ?
   if(r < 0)
     return r;
   // Set the option
   if(set) {
-    m_option_set(co->opt,co->opt->p,co->slots->data);
+    if(!(co->opt->type->flags & M_OPT_TYPE_HAS_CHILD))
+      m_option_set(co->opt,co->opt->p,co->owner->slots->data);
     co->flags |= M_CFG_OPT_SET;
   }
 
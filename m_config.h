@@ -49,12 +49,18 @@ struct m_config_save_slot {
 /// Config option
 struct m_config_option {
   m_config_option_t* next;
+  /// Next option in the same hash bucket or wildcard list.
+  m_config_option_t* hash_next;
   /// Full name (ie option:subopt).
   char* name;
   /// Option description.
   const struct m_option* opt;
-  /// Save slot stack.
+  /// Save slot stack, only the levels that changed the option have a slot.
   m_config_save_slot_t* slots;
+  /// Option owning the save slots, differs from the option for aliases.
+  m_config_option_t* owner;
+  /// Registration order, later options take precedence.
+  int index;
   /// See \ref ConfigOptionFlags.
   unsigned int flags;
 };
@@ -86,6 +92,16 @@ typedef struct m_config {
   /** This contains all options and suboptions.
    */
   m_config_option_t* opts;
+  /// Options by name, except the ones ending with a wildcard.
+  m_config_option_t** hash;
+  /// Number of buckets in hash, a power of 2.
+  int hash_size;
+  /// Number of options in hash.
+  int num_hashed;
+  /// Number of registered options.
+  int num_opts;
+  /// Options ending with a wildcard.
+  m_config_option_t* wildcards;
   /// Current stack level.
   int lvl;
   /// \ref OptionParserModes
@@ -51,6 +51,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#ifndef __MINGW32__
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 #if defined(__MINGW32__) || defined(__CYGWIN__)
 #include <windows.h>
 #endif
@@ -98,6 +106,7 @@
 #include "sub/vobsub.h"
 #include "sub/eosd.h"
 #include "mencoder.h"
+#include "stats.h"
 
 
 int vo_doublebuffering=0;
@@ -148,6 +157,18 @@ static float audio_delay_fix=0.0;
 static float audio_delay=0.0;
 static int ignore_start=0;
 static int audio_density=2;
+static int audio_thread=0;
+static int audio_threads=1;
+static int video_thread=0;
+static vf_instance_t *ve_queued; // encoder muxed after the audio step
+static int segments=0;
+static char *stats_file=NULL;
+
+static stats_stage_t *stage_demux;
+static stats_stage_t *stage_video_decode;
+static stats_stage_t *stage_audio_decode;
+static stats_stage_t *stage_audio_encode;
+static stats_stage_t *stage_audio_wait;
 
 double force_fps=0;
 static double force_ofps=0; // set to 24 for inverse telecine
@@ -527,6 +548,453 @@ static int edl_seek(edl_record_ptr next_edl_record, demuxer_t *demuxer,
 }
 
 
+/* The audio of one main loop iteration is encoded by encode_audio(). With
+ * -audio-thread this runs on a worker thread while the main thread reads,
+ * decodes and filters the next video frame. The frame is only handed to the
+ * video encoder once the audio step is done, so chunks reach the muxer in
+ * the same order as without the thread and the output does not change.
+ * Both threads read from the same demuxer, which is serialized by
+ * demux_lock. */
+typedef struct {
+    sh_audio_t *sh_audio;
+    muxer_stream_t *mux_a;
+    audio_encoder_t *aencoder;
+    double v_muxer_time; ///< video muxer time to encode the audio up to
+    float stop_time;     ///< stop_time() at the start of the iteration
+    uint32_t rate;       ///< ms spent in the audio step
+    uint32_t samples;
+#if HAVE_PTHREADS
+    int threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int busy;            ///< worker is encoding
+    int quit;            ///< worker should exit
+#endif
+} audio_step_t;
+
+static audio_step_t audio_step = { .samples = 1 };
+
+#if HAVE_PTHREADS
+static pthread_mutex_t demux_lock = PTHREAD_MUTEX_INITIALIZER;
+#define lock_demuxer()   pthread_mutex_lock(&demux_lock)
+#define unlock_demuxer() pthread_mutex_unlock(&demux_lock)
+#else
+#define lock_demuxer()
+#define unlock_demuxer()
+#endif
+
+static void encode_audio(audio_step_t *a)
+{
+    sh_audio_t *sh_audio = a->sh_audio;
+    muxer_stream_t *mux_a = a->mux_a;
+    audio_encoder_t *aencoder = a->aencoder;
+    double a_muxer_time = adjusted_muxer_time(mux_a);
+
+    while(a_muxer_time-audio_preload<a->v_muxer_time){
+        float tottime;
+	int len=0;
+	uint32_t ptimer_start = GetTimerMS();
+
+	// CBR - copy 0.5 sec of audio
+	// or until the end of video:
+	tottime = a->stop_time;
+	if (tottime != -1) {
+		tottime -= a_muxer_time;
+		if (tottime > 1./audio_density) tottime = 1./audio_density;
+	}
+	else tottime = 1./audio_density;
+
+	// let's not output more audio than necessary
+	if (tottime <= 0) break;
+
+	if(aencoder)
+	{
+		if(mux_a->h.dwSampleSize) /* CBR */
+		{
+			if(aencoder->set_decoded_len)
+			{
+				len = mux_a->h.dwSampleSize*(int)(mux_a->h.dwRate*tottime);
+				aencoder->set_decoded_len(aencoder, len);
+			}
+			else
+				len = aencoder->decode_buffer_size;
+
+			lock_demuxer();
+			stats_begin();
+			len = dec_audio(sh_audio, aencoder->decode_buffer, len);
+			stats_end(stage_audio_decode);
+			unlock_demuxer();
+			stats_begin();
+			mux_a->buffer_len += aencoder->encode(aencoder, mux_a->buffer + mux_a->buffer_len,
+				aencoder->decode_buffer, len, mux_a->buffer_size-mux_a->buffer_len);
+			stats_end(stage_audio_encode);
+			if(mux_a->buffer_len < mux_a->wf->nBlockAlign)
+				len = 0;
+			else
+				len = mux_a->wf->nBlockAlign*(mux_a->buffer_len/mux_a->wf->nBlockAlign);
+		}
+		else	/* VBR */
+		{
+			int sz = 0;
+			while(1)
+			{
+				len = 0;
+				if(! sz)
+					sz = aencoder->get_frame_size(aencoder);
+				if(sz > 0 && mux_a->buffer_len >= sz)
+				{
+					len = sz;
+					break;
+				}
+				lock_demuxer();
+				stats_begin();
+				len = dec_audio(sh_audio,aencoder->decode_buffer, aencoder->decode_buffer_size);
+				stats_end(stage_audio_decode);
+				unlock_demuxer();
+				if(len <= 0)
+				{
+					len = 0;
+					break;
+				}
+				stats_begin();
+				len = aencoder->encode(aencoder, mux_a->buffer + mux_a->buffer_len, aencoder->decode_buffer, len, mux_a->buffer_size-mux_a->buffer_len);
+				stats_end(stage_audio_encode);
+				mux_a->buffer_len += len;
+			}
+	    }
+	    if (a->v_muxer_time == 0) mux_a->h.dwInitialFrames++;
+	}
+	else {
+	lock_demuxer();
+	stats_begin();
+	if(mux_a->h.dwSampleSize){
+	    switch(mux_a->codec){
+	    case ACODEC_COPY: // copy
+		len=mux_a->wf->nAvgBytesPerSec*tottime;
+		len/=mux_a->h.dwSampleSize;if(len<1) len=1;
+		len*=mux_a->h.dwSampleSize;
+		len=demux_read_data(sh_audio->ds,mux_a->buffer,len);
+		break;
+	    }
+	} else {
+	    // VBR - encode/copy an audio frame
+	    switch(mux_a->codec){
+	    case ACODEC_COPY: // copy
+		len=ds_get_packet(sh_audio->ds,(unsigned char**) &mux_a->buffer);
+		if(len>0) mux_a->packet=sh_audio->ds->current; // written without copy
+		break;
+		}
+	    }
+	stats_end(stage_demux);
+	unlock_demuxer();
+	}
+	if(len<=0) break; // EOF?
+	muxer_write_chunk(mux_a,len,AVIIF_KEYFRAME, MP_NOPTS_VALUE, MP_NOPTS_VALUE);
+	mux_a->packet=NULL;
+	a_muxer_time = adjusted_muxer_time(mux_a); // update after muxing
+	if(!mux_a->h.dwSampleSize && a_muxer_time>0)
+	    mux_a->wf->nAvgBytesPerSec=0.5f+(double)mux_a->size/a_muxer_time; // avg bps (VBR)
+	if(mux_a->buffer_len>=len){
+	    mux_a->buffer_len-=len;
+	    memmove(mux_a->buffer,mux_a->buffer+len,mux_a->buffer_len);
+	}
+
+
+	a->samples++;
+	a->rate+= (GetTimerMS() - ptimer_start);
+
+    }
+}
+
+/// Write the audio the encoder still holds back at the end.
+static void flush_audio(muxer_stream_t *mux_a, audio_encoder_t *aencoder)
+{
+    double a_muxer_time;
+    int len;
+
+    do {
+        while ((len = aencoder->get_frame_size(aencoder)) > 0 && len <= mux_a->buffer_len) {
+            muxer_write_chunk(mux_a, len, AVIIF_KEYFRAME, MP_NOPTS_VALUE, MP_NOPTS_VALUE);
+            mux_a->buffer_len -= len;
+            memmove(mux_a->buffer, mux_a->buffer + len, mux_a->buffer_len);
+        }
+        len = aencoder->flush(aencoder, mux_a->buffer + mux_a->buffer_len,
+                              mux_a->buffer_size - mux_a->buffer_len);
+        mux_a->buffer_len += len;
+    } while (len > 0);
+
+    a_muxer_time = adjusted_muxer_time(mux_a);
+    if (a_muxer_time > 0)
+        mux_a->wf->nAvgBytesPerSec = 0.5f + (double)mux_a->size / a_muxer_time; // avg bps (VBR)
+}
+
+/// Encode the audio of this iteration, in the background if possible.
+static void run_audio_step(audio_step_t *a)
+{
+#if HAVE_PTHREADS
+    if (a->threaded) {
+        pthread_mutex_lock(&a->lock);
+        a->busy = 1;
+        pthread_cond_broadcast(&a->cond);
+        pthread_mutex_unlock(&a->lock);
+        return;
+    }
+#endif
+    encode_audio(a);
+}
+
+static void wait_audio_step(audio_step_t *a)
+{
+#if HAVE_PTHREADS
+    if (!a->threaded)
+        return;
+    stats_begin();
+    pthread_mutex_lock(&a->lock);
+    while (a->busy)
+        pthread_cond_wait(&a->cond, &a->lock);
+    pthread_mutex_unlock(&a->lock);
+    stats_end(stage_audio_wait);
+#endif
+}
+
+#if HAVE_PTHREADS
+static void *audio_worker(void *arg)
+{
+    audio_step_t *a = arg;
+
+    pthread_mutex_lock(&a->lock);
+    while (1) {
+        while (!a->busy && !a->quit)
+            pthread_cond_wait(&a->cond, &a->lock);
+        if (a->quit)
+            break;
+        pthread_mutex_unlock(&a->lock);
+        encode_audio(a);
+        pthread_mutex_lock(&a->lock);
+        a->busy = 0;
+        pthread_cond_broadcast(&a->cond);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return NULL;
+}
+
+static vf_instance_t *ve_after_audio;
+static int (*ve_put_image)(struct vf_instance *vf, mp_image_t *mpi, double pts);
+
+/// Wait for the audio step of this iteration before muxing any video,
+/// for encoders that write to the muxer while encoding.
+static int put_image_after_audio(struct vf_instance *vf, mp_image_t *mpi, double pts)
+{
+    wait_audio_step(&audio_step);
+    return ve_put_image(vf, mpi, pts);
+}
+
+/** \brief Move the audio step to a worker thread.
+ *  Only worth it when audio and video are both encoded, in copy mode there
+ *  is nothing left to overlap.
+ *  \param vfilter filter chain ending in the video encoder */
+static void start_audio_thread(audio_step_t *a, vf_instance_t *vfilter)
+{
+    vf_instance_t *ve;
+
+    if (!a->threaded) {
+        pthread_mutex_init(&a->lock, NULL);
+        pthread_cond_init(&a->cond, NULL);
+        if (pthread_create(&a->thread, NULL, audio_worker, a)) {
+            pthread_cond_destroy(&a->cond);
+            pthread_mutex_destroy(&a->lock);
+            mp_msg(MSGT_MENCODER, MSGL_WARN, "Cannot create audio encoding thread.\n");
+            return;
+        }
+        a->threaded = 1;
+        mp_msg(MSGT_MENCODER, MSGL_V, "Encoding audio on a worker thread.\n");
+    }
+    // the encoder instance is kept when switching files, wrap it only once
+    for (ve = vfilter; ve->next; ve = ve->next);
+    if (ve != ve_after_audio && ve != ve_queued) {
+        ve_after_audio = ve;
+        ve_put_image = ve->put_image;
+        ve->put_image = put_image_after_audio;
+    }
+}
+
+static void stop_audio_thread(audio_step_t *a)
+{
+    if (!a->threaded)
+        return;
+    pthread_mutex_lock(&a->lock);
+    a->quit = 1;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+    pthread_cond_destroy(&a->cond);
+    pthread_mutex_destroy(&a->lock);
+    a->threaded = 0;
+}
+#endif
+
+#ifndef __MINGW32__
+/** \brief Find the keyframe times at which the input is split.
+ *  Seeks to n evenly spaced positions and records where the demuxer lands,
+ *  a child started with -ss at the same position lands on the same keyframe.
+ *  \param seek nominal seek positions, passed on to -ss
+ *  \param pts  time stamps of the keyframes found, pts[0] is the start
+ *  \param frametime duration of an output frame
+ *  \return number of segments, 0 if the file cannot be split */
+static int find_segments(char *filename, int n, double *seek, double *pts,
+                         double *frametime)
+{
+    int file_format = DEMUXER_TYPE_UNKNOWN;
+    stream_t *stream;
+    demuxer_t *demuxer;
+    double len;
+    int i, count = 0;
+
+    stream = open_stream(filename, 0, &file_format);
+    if (!stream)
+        return 0;
+    demuxer = demux_open(stream, file_format, -2, video_id, -2, filename);
+    if (demuxer && demuxer->video->sh && demuxer->seekable &&
+        (len = demuxer_get_time_length(demuxer)) > 0) {
+        sh_video_t *sh_video = demuxer->video->sh;
+        double fps = force_ofps ? force_ofps :
+                     (force_fps ? force_fps : sh_video->fps) * playback_speed;
+        *frametime = fps > 0 ? 1 / fps : 0;
+        seek[0] = 0;
+        pts[0] = ds_get_next_pts(demuxer->video);
+        count = pts[0] != MP_NOPTS_VALUE;
+        for (i = 1; i < n && count; i++) {
+            double t = i * len / n;
+            if (!demux_seek(demuxer, t, 0, SEEK_ABSOLUTE))
+                break;
+            pts[count] = ds_get_next_pts(demuxer->video);
+            if (pts[count] == MP_NOPTS_VALUE)
+                break;
+            // landed on the keyframe of the previous segment
+            if (pts[count] <= pts[count - 1])
+                continue;
+            seek[count++] = t;
+        }
+    }
+    if (demuxer)
+        free_demuxer(demuxer);
+    free_stream(stream);
+    return count;
+}
+
+/** \brief Encode the input in segments on separate processes.
+ *  Each child is a copy of this MEncoder with -ss/-endpos restricting it to
+ *  one segment and its own output and pass log file. The caller then joins
+ *  the segment files with -ovc copy -oac copy. The segment files are kept
+ *  next to the pass log file. If the output is not a regular file, as with
+ *  -o /dev/null in a first pass, the children write straight to it and
+ *  there is nothing to join.
+ *  \return file list of the segment files, NULL to encode normally */
+static m_entry_t *encode_segments(int argc, char *argv[], m_entry_t *filelist)
+{
+    double seek[64], pts[64], frametime = 0;
+    pid_t pid[64];
+    m_entry_t *parts;
+    char **args;
+    struct stat st;
+    int i, j, n, discard, failed = 0;
+
+    if (filelist[1].name || seek_to_sec || seek_to_byte ||
+        end_at.type != END_AT_NONE || play_n_frames_mf >= 0 || frameno_filename ||
+        vobsub_out) {
+        mp_msg(MSGT_MENCODER, MSGL_WARN, MSGTR_CannotEncodeSegments);
+        return NULL;
+    }
+    for (i = 0; filelist[0].opts[2*i]; i++)
+        if (!strcmp(filelist[0].opts[2*i], "ss") ||
+            !strcmp(filelist[0].opts[2*i], "sb") ||
+            !strcmp(filelist[0].opts[2*i], "endpos") ||
+            !strcmp(filelist[0].opts[2*i], "frames")) {
+            mp_msg(MSGT_MENCODER, MSGL_WARN, MSGTR_CannotEncodeSegments);
+            return NULL;
+        }
+
+    n = find_segments(filelist[0].name, segments, seek, pts, &frametime);
+    if (n < 2) {
+        mp_msg(MSGT_MENCODER, MSGL_WARN, MSGTR_CannotSplitInput);
+        return NULL;
+    }
+
+    discard = !stat(out_filename, &st) && !S_ISREG(st.st_mode);
+    parts = calloc(n + 1, sizeof(m_entry_t));
+    args = calloc(argc + 16, sizeof(char *));
+    memcpy(args, argv, argc * sizeof(char *));
+    for (i = 0; i < n; i++) {
+        char ss[32], endpos[32], logfile[1024], statsfile[1024];
+        j = argc;
+        if (discard)
+            parts[i].name = strdup(out_filename);
+        else {
+            parts[i].name = malloc(strlen(passtmpfile) + 16);
+            sprintf(parts[i].name, "%s.seg%d", passtmpfile, i);
+        }
+        parts[i].opts = calloc(2, sizeof(char *));
+        if (i > 0) {
+            snprintf(ss, sizeof(ss), "%f", seek[i]);
+            args[j++] = "-ss";
+            args[j++] = ss;
+        }
+        if (i < n - 1) {
+            // stop half a frame early so the keyframe of the next segment
+            // is not encoded twice
+            snprintf(endpos, sizeof(endpos), "%f",
+                     (pts[i + 1] - pts[i]) / playback_speed - frametime / 2);
+            args[j++] = "-endpos";
+            args[j++] = endpos;
+        }
+        // every segment gets its own rate control statistics, which stay
+        // valid between passes since the split points are the same
+        snprintf(logfile, sizeof(logfile), "%s.%d", passtmpfile, i);
+        args[j++] = "-passlogfile";
+        args[j++] = logfile;
+        if (stats_file) {
+            snprintf(statsfile, sizeof(statsfile), "%s.seg%d", stats_file, i);
+            args[j++] = "-statsfile";
+            args[j++] = statsfile;
+        }
+        args[j++] = "-o";
+        args[j++] = parts[i].name;
+        args[j++] = "-segments";
+        args[j++] = "0";
+        args[j++] = "-quiet";
+        args[j] = NULL;
+
+        mp_msg(MSGT_MENCODER, MSGL_INFO, MSGTR_EncodingSegment,
+               i + 1, n, pts[i] - pts[0]);
+        fflush(stdout);
+        pid[i] = fork();
+        if (!pid[i]) {
+            execvp(argv[0], args);
+            _exit(1);
+        }
+        if (pid[i] < 0)
+            failed = 1;
+    }
+    for (i = 0; i < n; i++) {
+        int status;
+        if (pid[i] > 0 && (waitpid(pid[i], &status, 0) != pid[i] ||
+                           !WIFEXITED(status) || WEXITSTATUS(status)))
+            failed = 1;
+    }
+    free(args);
+    if (failed || interrupted || discard) {
+        for (i = 0; i < n && !discard; i++)
+            unlink(parts[i].name);
+        m_entry_list_free(parts);
+        if (failed || interrupted)
+            mencoder_exit(1, MSGTR_SegmentEncodingFailed);
+        mencoder_exit(0, NULL);
+    }
+    return parts;
+}
+#endif
+
 int main(int argc,char* argv[]){
 
 stream_t* stream=NULL;
@@ -545,9 +1013,7 @@ void *vobsub_writer=NULL;
 s_frame_data frame_data = { .start = NULL, .in_size = 0, .frame_time = 0., .already_read = 0 };
 
 uint32_t ptimer_start;
-uint32_t audiorate=0;
 uint32_t videorate=0;
-uint32_t audiosamples=1;
 uint32_t videosamples=1;
 uint32_t skippedframes=0;
 uint32_t duplicatedframes=0;
@@ -568,6 +1034,7 @@ char* filename=NULL;
 int decoded_frameno=0;
 int next_frameno=-1;
 int curfile=0;
+int segment_files=0;
 int new_srate=0;
 
 unsigned int timer_start=0;
@@ -625,6 +1092,37 @@ user_correct_pts = 0;
  mp_msg(MSGT_MENCODER, MSGL_V, "Configuration: " CONFIGURATION "\n");
 
 
+if (segments > 1) {
+#ifndef __MINGW32__
+  m_entry_t *parts = encode_segments(argc, argv, filelist);
+  if (parts) {
+    // join the segments, the children already applied everything else
+    m_entry_list_free(filelist);
+    filelist = parts;
+    segment_files = 1;
+    out_video_codec = VCODEC_COPY;
+    if (out_audio_codec >= 0)
+      out_audio_codec = ACODEC_COPY;
+    skip_limit = 0;
+    force_fps = 0;
+    force_srate = 0;
+    playback_speed = 1.0;
+    audio_delay = 0;
+  }
+#else
+  mp_msg(MSGT_MENCODER, MSGL_WARN, MSGTR_CannotEncodeSegments);
+#endif
+}
+
+if (stats_file) {
+  stats_init();
+  stage_demux        = stats_stage("demux");
+  stage_video_decode = stats_stage("video decode");
+  stage_audio_decode = stats_stage("audio decode");
+  stage_audio_encode = stats_stage("audio encode");
+  stage_audio_wait   = stats_stage("audio wait");
+}
+
 if (frameno_filename) {
   stream2=open_stream(frameno_filename, NULL, NULL);
   if(stream2){
@@ -831,6 +1329,7 @@ if(!muxer) {
   mp_msg(MSGT_MENCODER, MSGL_FATAL, MSGTR_CannotInitializeMuxer);
   mencoder_exit(1,NULL);
 }
+stats_wrap_muxer(muxer);
 #if 0
 //disabled: it horrybly distorts filtered sound
 if(out_file_format == MUXER_TYPE_MPEG) audio_preload = 0;
@@ -951,6 +1450,13 @@ default: {
         mp_msg(MSGT_MENCODER,MSGL_FATAL,MSGTR_EncoderOpenFailed);
         mencoder_exit(1,NULL);
     }
+    // only these encoders hand their output over with ve_thread_write(),
+    // with -audio-thread alone it is queued so that the encoder does not
+    // have to wait for the audio step, and muxed once the step is done
+    if ((video_thread || audio_thread) &&
+        (mux_v->codec == VCODEC_LIBAVCODEC || mux_v->codec == VCODEC_X264) &&
+        ve_thread_init(sh_video->vfilter, mux_v, video_thread) && !video_thread)
+        ve_queued = sh_video->vfilter;
     ve = sh_video->vfilter;
   } else sh_video->vfilter = ve;
     // append 'expand' filter, it fixes stride problems and renders osd:
@@ -1082,6 +1588,9 @@ if(mux_a->codec != ACODEC_COPY) {
     ao_data.format = aencoder->input_format;
     ao_data.channels = aparams.channels;
     ao_data.samplerate = aparams.sample_rate;
+    // the frames must reach the muxer one by one
+    if (audio_threads > 1 && !mux_a->h.dwSampleSize)
+        ae_thread_init(aencoder, audio_threads);
 }
 switch(mux_a->codec){
 case ACODEC_COPY:
@@ -1230,6 +1739,12 @@ if (sh_audio && audio_delay != 0.) fixdelay(d_video, d_audio, mux_a, &frame_data
 // Just assume a seek. Also works if time stamps do not start with 0
 did_seek = 1;
 
+#if HAVE_PTHREADS
+if (audio_thread && sh_audio && aencoder && sh_video->vfilter &&
+    mux_v->codec != VCODEC_COPY && mux_v->codec != VCODEC_FRAMENO)
+    start_audio_thread(&audio_step, sh_video->vfilter);
+#endif
+
 while(!at_eof){
 
     int blit_frame=0;
@@ -1296,110 +1811,37 @@ goto_redo_edl:
     }
 
 
+// filters and their instances may change with every frame
+stats_wrap_filters(sh_video->vfilter);
+stats_sample(stats_queue("video packets"), d_video->packs);
+stats_sample(stats_queue("video bytes"), d_video->bytes);
+if (mux_v->codec != VCODEC_COPY && mux_v->codec != VCODEC_FRAMENO)
+    stats_sample(stats_queue("video encoder delay"), mux_v->encoder_delay);
 if(sh_audio){
-    // get audio:
-    while(a_muxer_time-audio_preload<v_muxer_time){
-        float tottime;
-	int len=0;
-
-	ptimer_start = GetTimerMS();
-	// CBR - copy 0.5 sec of audio
-	// or until the end of video:
-	tottime = stop_time(demuxer, mux_v);
-	if (tottime != -1) {
-		tottime -= a_muxer_time;
-		if (tottime > 1./audio_density) tottime = 1./audio_density;
-	}
-	else tottime = 1./audio_density;
-
-	// let's not output more audio than necessary
-	if (tottime <= 0) break;
-
-	if(aencoder)
-	{
-		if(mux_a->h.dwSampleSize) /* CBR */
-		{
-			if(aencoder->set_decoded_len)
-			{
-				len = mux_a->h.dwSampleSize*(int)(mux_a->h.dwRate*tottime);
-				aencoder->set_decoded_len(aencoder, len);
-			}
-			else
-				len = aencoder->decode_buffer_size;
-
-			len = dec_audio(sh_audio, aencoder->decode_buffer, len);
-			mux_a->buffer_len += aencoder->encode(aencoder, mux_a->buffer + mux_a->buffer_len,
-				aencoder->decode_buffer, len, mux_a->buffer_size-mux_a->buffer_len);
-			if(mux_a->buffer_len < mux_a->wf->nBlockAlign)
-				len = 0;
-			else
-				len = mux_a->wf->nBlockAlign*(mux_a->buffer_len/mux_a->wf->nBlockAlign);
-		}
-		else	/* VBR */
-		{
-			int sz = 0;
-			while(1)
-			{
-				len = 0;
-				if(! sz)
-					sz = aencoder->get_frame_size(aencoder);
-				if(sz > 0 && mux_a->buffer_len >= sz)
-				{
-					len = sz;
-					break;
-				}
-				len = dec_audio(sh_audio,aencoder->decode_buffer, aencoder->decode_buffer_size);
-				if(len <= 0)
-				{
-					len = 0;
-					break;
-				}
-				len = aencoder->encode(aencoder, mux_a->buffer + mux_a->buffer_len, aencoder->decode_buffer, len, mux_a->buffer_size-mux_a->buffer_len);
-				mux_a->buffer_len += len;
-			}
-	    }
-	    if (v_muxer_time == 0) mux_a->h.dwInitialFrames++;
-	}
-	else {
-	if(mux_a->h.dwSampleSize){
-	    switch(mux_a->codec){
-	    case ACODEC_COPY: // copy
-		len=mux_a->wf->nAvgBytesPerSec*tottime;
-		len/=mux_a->h.dwSampleSize;if(len<1) len=1;
-		len*=mux_a->h.dwSampleSize;
-		len=demux_read_data(sh_audio->ds,mux_a->buffer,len);
-		break;
-	    }
-	} else {
-	    // VBR - encode/copy an audio frame
-	    switch(mux_a->codec){
-	    case ACODEC_COPY: // copy
-		len=ds_get_packet(sh_audio->ds,(unsigned char**) &mux_a->buffer);
-		break;
-		}
-	    }
-	}
-	if(len<=0) break; // EOF?
-	muxer_write_chunk(mux_a,len,AVIIF_KEYFRAME, MP_NOPTS_VALUE, MP_NOPTS_VALUE);
-	a_muxer_time = adjusted_muxer_time(mux_a); // update after muxing
-	if(!mux_a->h.dwSampleSize && a_muxer_time>0)
-	    mux_a->wf->nAvgBytesPerSec=0.5f+(double)mux_a->size/a_muxer_time; // avg bps (VBR)
-	if(mux_a->buffer_len>=len){
-	    mux_a->buffer_len-=len;
-	    memmove(mux_a->buffer,mux_a->buffer+len,mux_a->buffer_len);
-	}
-
-
-	audiosamples++;
-	audiorate+= (GetTimerMS() - ptimer_start);
+    stats_wrap_audio_filters(sh_audio->afilter);
+    stats_sample(stats_queue("audio packets"), d_audio->packs);
+    stats_sample(stats_queue("audio bytes"), d_audio->bytes);
+    stats_sample(stats_queue("audio encoder output"), mux_a->buffer_len);
+}
 
-    }
+if(sh_audio){
+    // get audio:
+    audio_step.sh_audio = sh_audio;
+    audio_step.mux_a = mux_a;
+    audio_step.aencoder = aencoder;
+    audio_step.v_muxer_time = v_muxer_time;
+    audio_step.stop_time = stop_time(demuxer, mux_v);
+    run_audio_step(&audio_step);
 }
 
     // get video frame!
 
     if (!frame_data.already_read) {
+        lock_demuxer();
+        stats_begin();
         frame_data.in_size=video_read_frame(sh_video,&frame_data.frame_time,&frame_data.start,force_fps);
+        stats_end(stage_demux);
+        unlock_demuxer();
         frame_data.flush = frame_data.in_size < 0 && d_video->eof &&
                            mux_v->codec != VCODEC_COPY &&
                            mux_v->codec != VCODEC_FRAMENO;
@@ -1470,7 +1912,9 @@ ptimer_start = GetTimerMS();
 switch(mux_v->codec){
 case VCODEC_COPY:
     mux_v->buffer=frame_data.start;
+    mux_v->packet=sh_video->ds->current; // written without copy if in there
     if(skip_flag<=0) muxer_write_chunk(mux_v,frame_data.in_size,(sh_video->ds->flags&1)?AVIIF_KEYFRAME:0, MP_NOPTS_VALUE, MP_NOPTS_VALUE);
+    mux_v->packet=NULL;
     break;
 case VCODEC_FRAMENO:
     mux_v->buffer=(unsigned char *)&decoded_frameno; // tricky
@@ -1482,8 +1926,11 @@ default:
     int drop_frame = skip_flag > 0 &&
                      (!sh_video->vfilter ||
                       ((vf_instance_t *)sh_video->vfilter)->control(sh_video->vfilter, VFCTRL_SKIP_NEXT_FRAME, 0) != CONTROL_TRUE);
-    void *decoded_frame = decode_video(sh_video,frame_data.start,frame_data.in_size,
-                                       drop_frame, MP_NOPTS_VALUE, NULL);
+    void *decoded_frame;
+    stats_begin();
+    decoded_frame = decode_video(sh_video,frame_data.start,frame_data.in_size,
+                                 drop_frame, MP_NOPTS_VALUE, NULL);
+    stats_end(stage_video_decode);
     if (frame_data.flush && !decoded_frame)
         at_eof = 1;
     if (did_seek && sh_video->pts != MP_NOPTS_VALUE) {
@@ -1497,6 +1944,9 @@ default:
     // encoder due to not being monotonic.
     // If you change this please note the reason here!
     blit_frame = decoded_frame && filter_video(sh_video, decoded_frame, v_muxer_time + sub_offset);}
+    wait_audio_step(&audio_step);
+    if (ve_queued)
+        ve_thread_mux(ve_queued);
     v_muxer_time = adjusted_muxer_time(mux_v); // update after muxing
 
     if (sh_video->vf_initialized < 0) mencoder_exit(1, NULL);
@@ -1547,6 +1997,8 @@ if(skip_flag>0){
     --skip_flag;
 }
 
+a_muxer_time = adjusted_muxer_time(mux_a); // update after the audio step
+
 if(sh_audio && !demuxer2){
     float AV_delay,x;
     // A-V sync!
@@ -1602,7 +2054,7 @@ if(sh_audio && !demuxer2){
 	    	v_pts_corr,
 	    	(v_muxer_time>1) ? (int)(mux_v->size/v_muxer_time/125) : 0,
 	    	(mux_a && a_muxer_time>1) ? (int)(mux_a->size/a_muxer_time/125) : 0,
-			audiorate/audiosamples, videorate/videosamples,
+			audio_step.rate/audio_step.samples, videorate/videosamples,
 			duplicatedframes, badframes, skippedframes
 		);
 	} else
@@ -1644,6 +2096,8 @@ if(sh_audio && !demuxer2){
 
 } // while(!at_eof)
 
+wait_audio_step(&audio_step);
+
 if (!interrupted && filelist[++curfile].name != 0) {
 	if (sh_video && sh_video->vfilter) { // Before uniniting sh_video and the filter chain, break apart the VE.
  		vf_instance_t * ve; // this will be the filter right before the ve.
@@ -1675,6 +2129,13 @@ if(sh_video && sh_video->vfilter){
     	                                              VFCTRL_FLUSH_FRAMES, 0);
 }
 
+#if HAVE_PTHREADS
+stop_audio_thread(&audio_step);
+#endif
+
+if(aencoder && aencoder->flush)
+    flush_audio(mux_a, aencoder);
+
 if(aencoder)
     if(aencoder->fixup)
         aencoder->fixup(aencoder);
@@ -1686,6 +2147,7 @@ if (muxer->cont_write_index) muxer_write_index(muxer);
 muxer_f_size=stream_tell(muxer->stream);
 stream_seek(muxer->stream,0);
 if (muxer->cont_write_header) muxer_write_header(muxer); // update header
+free_stream(muxer->stream); // writes out what is still buffered
 #if 0
 if(ferror(muxer_f) || fclose(muxer_f) != 0) {
     mp_msg(MSGT_MENCODER,MSGL_FATAL,MSGTR_ErrorWritingFile, out_filename);
@@ -1710,10 +2172,19 @@ if(sh_audio)
 mp_msg(MSGT_MENCODER, MSGL_INFO, MSGTR_AudioStreamResult,
     (float)(mux_a->size/mux_a->timer*8.0f/1000.0f), (int)(mux_a->size/mux_a->timer), (uint64_t)mux_a->size, (float)mux_a->timer);
 
+if (stats_file)
+    stats_write(stats_file, (GetTimerMS() - timer_start) * 0.001, decoded_frameno);
+
 if(sh_audio){ uninit_audio(sh_audio);sh_audio=NULL; }
 if(sh_video){ uninit_video(sh_video);sh_video=NULL; }
 if(demuxer) free_demuxer(demuxer);
 if(stream) free_stream(stream); // kill cache thread
 
+#ifndef __MINGW32__
+if (segment_files && !interrupted)
+    for (i = 0; filelist[i].name; i++)
+        unlink(filelist[i].name);
+#endif
+
 return interrupted;
 }
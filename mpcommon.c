@@ -416,6 +416,8 @@ static void noconfig_all(void)
 
 m_config_t *mconfig;
 
+int fast_start;
+
 int cfg_inc_verbose(m_option_t *conf)
 {
     ++verbose;
@@ -472,6 +474,29 @@ static void sanitize_os(void)
 #endif
 }
 
+#ifdef CONFIG_BITMAP_FONT
+static void load_bitmap_fonts(void)
+{
+    if (font_name) {
+        vo_font = read_font_desc(font_name, font_factor, verbose>1);
+        if (!vo_font)
+            mp_msg(MSGT_CPLAYER,MSGL_ERR,MSGTR_CantLoadFont,
+                   filename_recode(font_name));
+    } else {
+        // try default:
+        char *desc_path = get_path("font/font.desc");
+        vo_font = read_font_desc(desc_path, font_factor, verbose>1);
+        free(desc_path);
+        if (!vo_font)
+            vo_font = read_font_desc(MPLAYER_DATADIR "/font/font.desc", font_factor, verbose>1);
+    }
+    if (sub_font_name)
+        sub_font = read_font_desc(sub_font_name, font_factor, verbose>1);
+    else
+        sub_font = vo_font;
+}
+#endif
+
 /**
  * Initialization code to be run after command-line parsing.
  */
@@ -513,23 +538,10 @@ int common_init(void)
 #endif
     {
 #ifdef CONFIG_BITMAP_FONT
-        if (font_name) {
-            vo_font = read_font_desc(font_name, font_factor, verbose>1);
-            if (!vo_font)
-                mp_msg(MSGT_CPLAYER,MSGL_ERR,MSGTR_CantLoadFont,
-                       filename_recode(font_name));
-        } else {
-            // try default:
-            char *desc_path = get_path("font/font.desc");
-            vo_font = read_font_desc(desc_path, font_factor, verbose>1);
-            free(desc_path);
-            if (!vo_font)
-                vo_font = read_font_desc(MPLAYER_DATADIR "/font/font.desc", font_factor, verbose>1);
-        }
-        if (sub_font_name)
-            sub_font = read_font_desc(sub_font_name, font_factor, verbose>1);
+        if (fast_start)
+            vo_font_loader = load_bitmap_fonts;
         else
-            sub_font = vo_font;
+            load_bitmap_fonts();
 #endif
     }
 
@@ -72,6 +72,9 @@ extern const char *mplayer_version;
 extern m_config_t *mconfig;
 extern const m_option_t noconfig_opts[];
 
+/// Defer what is not needed for the first frame, see -faststart.
+extern int fast_start;
+
 void print_version(const char* name);
 void init_vo_spudec(struct stream *stream, struct sh_video *sh_video, struct sh_sub *sh_sub);
 void update_subtitles(struct sh_video *sh_video, double refpts, demux_stream_t *d_dvdsub, int reset);
@@ -180,6 +180,24 @@ static int total_frame_cnt;
 static int drop_frame_cnt; // total number of dropped frames
 int benchmark;
 
+// startup phases, reported in verbose mode once the first file plays
+enum {
+    STARTUP_CONFIG,
+    STARTUP_INIT,
+    STARTUP_INPUT,
+    STARTUP_OPEN,
+    STARTUP_PLAY,
+    STARTUP_PHASES
+};
+static const char * const startup_phase_names[STARTUP_PHASES] = {
+    "config", "init", "input", "open", "first frame"
+};
+static unsigned int startup_times[STARTUP_PHASES];
+static unsigned int startup_last;
+static int startup_done;
+static int startup_pending; // finish_startup() not run for this file yet
+static int auto_subs_pending; // -faststart left the automatic subtitles
+
 // options:
 #define DEFAULT_STARTUP_DECODE_RETRY 8
 int auto_quality;
@@ -1900,6 +1918,77 @@ static int select_subtitle(MPContext *mpctx)
     return found;
 }
 
+/**
+ * \brief Charge the time since the last call to a startup phase.
+ */
+static void startup_phase(int phase)
+{
+    unsigned int now = GetTimer();
+
+    if (startup_done)
+        return;
+    startup_times[phase] += now - startup_last;
+    startup_last = now;
+}
+
+/**
+ * \brief Load the subtitles found next to the file after -faststart.
+ *
+ * They are handled like subtitles loaded with sub_load, one of them is
+ * only selected if no subtitle was selected yet.
+ */
+static void load_deferred_subtitles(void)
+{
+    int old_size = mpctx->set_of_sub_size;
+    int added;
+    double fps   = mpctx->sh_video ? mpctx->sh_video->fps : 25;
+
+    auto_subs_pending = 0;
+    current_module    = "read_auto_subtitles";
+    load_auto_subtitles(filename, fps, add_subtitles);
+    added = mpctx->set_of_sub_size - old_size;
+    if (added <= 0)
+        return;
+
+    // the vobsubs come after the subtitle files
+    if (mpctx->global_sub_pos >= mpctx->sub_counts[SUB_SOURCE_DEMUX] +
+                                 mpctx->sub_counts[SUB_SOURCE_SUBS])
+        mpctx->global_sub_pos += added;
+    mpctx->sub_counts[SUB_SOURCE_SUBS] += added;
+    mpctx->global_sub_size += added;
+    if (mpctx->global_sub_pos == -1)
+        mp_property_do("sub_file", M_PROPERTY_SET, &old_size, mpctx);
+}
+
+/**
+ * \brief Called once the file has started playing.
+ *
+ * Reports the startup timings after the first file and does what
+ * -faststart left for later unless playback already ends.
+ */
+static void finish_startup(void)
+{
+    if (!startup_done) {
+        unsigned int total = 0;
+        int i;
+        startup_phase(STARTUP_PLAY);
+        startup_done = 1;
+        mp_msg(MSGT_CPLAYER, MSGL_V, "Startup times:");
+        for (i = 0; i < STARTUP_PHASES; i++) {
+            mp_msg(MSGT_CPLAYER, MSGL_V, " %s %.1f ms,",
+                   startup_phase_names[i], startup_times[i] / 1000.0);
+            total += startup_times[i];
+        }
+        mp_msg(MSGT_CPLAYER, MSGL_V, " total %.1f ms\n", total / 1000.0);
+    }
+    if (mpctx->eof)
+        return;
+    startup_pending = 0;
+    mp_input_init_devices();
+    if (auto_subs_pending)
+        load_deferred_subtitles();
+}
+
 #ifdef CONFIG_DVDNAV
 #ifndef FF_B_TYPE
 #define FF_B_TYPE 3
@@ -2793,6 +2882,7 @@ int main(int argc, char *argv[])
     int i;
 
     common_preinit();
+    startup_last = GetTimer();
 
     // Create the config context and register the options
     mconfig = m_config_new();
@@ -2839,6 +2929,7 @@ int main(int argc, char *argv[])
             }
         }
     }
+    startup_phase(STARTUP_CONFIG);
 
     print_version("MPlayer");
 #if (defined(__MINGW32__) || defined(__CYGWIN__)) && defined(CONFIG_GUI)
@@ -2857,6 +2948,7 @@ int main(int argc, char *argv[])
 #endif
     if (!common_init())
         exit_player_with_rc(EXIT_NONE, 0);
+    startup_phase(STARTUP_INIT);
 
 #ifndef CONFIG_GUI
     if (use_gui) {
@@ -3009,7 +3101,7 @@ int main(int argc, char *argv[])
 
     // Init input system
     current_module = "init_input";
-    mp_input_init();
+    mp_input_init(fast_start && !use_gui);
     mp_input_add_key_fd(-1, 0, mplayer_get_key, NULL);
     if (slave_mode)
         mp_input_add_cmd_fd(0, USE_SELECT, MP_INPUT_SLAVE_CMD_FUNC, NULL);
@@ -3081,10 +3173,14 @@ int main(int argc, char *argv[])
     }
 #endif
 
+    startup_phase(STARTUP_INPUT);
+
 // ******************* Now, let's see the per-file stuff ********************
 
 play_next_file:
 
+    startup_pending = 1;
+
     // init global sub numbers
     mpctx->global_sub_size = 0;
     memset(mpctx->sub_counts, 0, sizeof(mpctx->sub_counts));
@@ -3125,6 +3221,7 @@ play_next_file:
             }
         }
         gui(GUI_PREPARE, 0);
+        startup_last = GetTimer(); // waiting is not part of the startup
     }
 #endif /* CONFIG_GUI */
 
@@ -3133,11 +3230,13 @@ play_next_file:
         mp_cmd_t *cmd;
         if (mpctx->video_out && vo_config_count)
             mpctx->video_out->control(VOCTRL_PAUSE, NULL);
+        mp_input_init_devices();
         while (!(cmd = mp_input_get_cmd(0, 1, 0))) { // wait for command
             if (mpctx->video_out && vo_config_count)
                 mpctx->video_out->check_events();
             usec_sleep(20000);
         }
+        startup_last = GetTimer(); // waiting is not part of the startup
         switch (cmd->id) {
         case MP_CMD_LOADFILE:
             // prepare a tree entry with the new filename
@@ -3574,7 +3673,9 @@ goto_enable_cache:
         // check .sub
         double fps = mpctx->sh_video ? mpctx->sh_video->fps : 25;
         current_module = "read_subtitles_file";
-        load_subtitles(filename, fps, add_subtitles);
+        // with -faststart the directories are searched once playing
+        auto_subs_pending = fast_start && sub_auto;
+        load_subtitles(auto_subs_pending ? NULL : filename, fps, add_subtitles);
         if (mpctx->set_of_sub_size > 0)
             mpctx->sub_counts[SUB_SOURCE_SUBS] = mpctx->set_of_sub_size;
         // set even if we have no subs yet, they may be added later
@@ -3641,6 +3742,8 @@ goto_enable_cache:
         }
     }
 
+    startup_phase(STARTUP_OPEN);
+
     if (mpctx->sh_video)
         reinit_video_chain();
 
@@ -3860,6 +3963,8 @@ goto_enable_cache:
                     mpctx->eof = PT_NEXT_ENTRY;
                 update_subtitles(NULL, a_pos, mpctx->d_sub, 0);
                 update_osd_msg();
+                if (startup_pending)
+                    finish_startup();
             } else {
                 int frame_time_remaining = 0;
                 int blit_frame = 1;
@@ -3979,6 +4084,9 @@ goto_enable_cache:
                 if (!frame_time_remaining && is_at_end(mpctx, &end_at,
                                                        mpctx->sh_video->pts))
                     mpctx->eof = PT_NEXT_ENTRY;
+
+                if (startup_pending && !frame_time_remaining && blit_frame)
+                    finish_startup();
             } // end if(mpctx->sh_video)
 
 #ifdef CONFIG_DVDNAV
@@ -0,0 +1,441 @@
+/*
+ * Per-stage timing statistics for MEncoder
+ *
+ * This file is part of MPlayer.
+ *
+ * MPlayer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with MPlayer; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Every stage keeps a histogram of its call times with 8 bins per power of
+   two, so the percentiles are exact to 1/16. Filters, audio filters and the
+   muxer are timed by replacing their function with a wrapper that looks up
+   the original by instance. The nesting of stats_begin() and stats_end() is
+   tracked per thread. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#ifndef __MINGW32__
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "config.h"
+#include "mp_msg.h"
+#include "stats.h"
+#include "libavutil/avstring.h"
+#include "libavutil/common.h"
+#include "osdep/timer.h"
+#include "libmpcodecs/img_format.h"
+#include "libmpcodecs/mp_image.h"
+#include "libmpcodecs/vf.h"
+#include "libaf/af.h"
+#include "libmpdemux/muxer.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   stack_key;
+#define lock()   pthread_mutex_lock(&stats_lock)
+#define unlock() pthread_mutex_unlock(&stats_lock)
+#else
+#define lock()
+#define unlock()
+#endif
+
+#define HIST_BINS  240
+#define MAX_STAGES 64
+#define MAX_QUEUES 16
+#define MAX_WRAPS  64
+#define MAX_DEPTH  16
+
+struct stats_stage {
+    char     name[64];
+    unsigned calls;
+    uint64_t total;           // usec spent in the stage itself
+    unsigned max;
+    unsigned hist[HIST_BINS];
+};
+
+struct stats_queue {
+    char     name[64];
+    unsigned samples;
+    int64_t  sum;
+    int64_t  max;
+};
+
+enum { WRAP_VF, WRAP_AF, WRAP_MUXER };
+
+typedef struct {
+    const void    *key;       // instance with a wrapped function
+    int           type;
+    stats_stage_t *stage;
+    union {
+        int (*put_image)(struct vf_instance *vf, mp_image_t *mpi, double pts);
+        af_data_t *(*play)(struct af_instance_s *af, af_data_t *data);
+        void (*write_chunk)(muxer_stream_t *s, size_t len, unsigned int flags,
+                            double dts, double pts);
+    } orig;
+} stats_wrap_t;
+
+typedef struct {
+    int depth;
+    struct {
+        unsigned start;
+        unsigned nested;      // time spent in nested stages
+    } level[MAX_DEPTH];
+} stats_stack_t;
+
+static int collecting;
+static stats_stage_t *stages[MAX_STAGES];
+static int num_stages;
+static stats_queue_t *queues[MAX_QUEUES];
+static int num_queues;
+static stats_wrap_t wraps[MAX_WRAPS];
+static int num_wraps;
+
+static stats_stack_t *get_stack(void)
+{
+#if HAVE_PTHREADS
+    stats_stack_t *st = pthread_getspecific(stack_key);
+    if (!st) {
+        st = calloc(1, sizeof(*st));
+        pthread_setspecific(stack_key, st);
+    }
+    return st;
+#else
+    static stats_stack_t st;
+    return &st;
+#endif
+}
+
+void stats_init(void)
+{
+    if (collecting)
+        return;
+#if HAVE_PTHREADS
+    if (pthread_key_create(&stack_key, free))
+        return;
+#endif
+    collecting = 1;
+}
+
+stats_stage_t *stats_stage(const char *name)
+{
+    stats_stage_t *s = NULL;
+    int i;
+
+    if (!collecting)
+        return NULL;
+    lock();
+    for (i = 0; i < num_stages; i++)
+        if (!strcmp(stages[i]->name, name)) {
+            s = stages[i];
+            break;
+        }
+    if (!s && num_stages < MAX_STAGES && (s = calloc(1, sizeof(*s)))) {
+        av_strlcpy(s->name, name, sizeof(s->name));
+        stages[num_stages++] = s;
+    }
+    unlock();
+    return s;
+}
+
+stats_queue_t *stats_queue(const char *name)
+{
+    stats_queue_t *q = NULL;
+    int i;
+
+    if (!collecting)
+        return NULL;
+    for (i = 0; i < num_queues; i++)
+        if (!strcmp(queues[i]->name, name))
+            return queues[i];
+    if (num_queues < MAX_QUEUES && (q = calloc(1, sizeof(*q)))) {
+        av_strlcpy(q->name, name, sizeof(q->name));
+        queues[num_queues++] = q;
+    }
+    return q;
+}
+
+void stats_begin(void)
+{
+    stats_stack_t *st;
+
+    if (!collecting || !(st = get_stack()))
+        return;
+    if (st->depth < MAX_DEPTH) {
+        st->level[st->depth].start  = GetTimer();
+        st->level[st->depth].nested = 0;
+    }
+    st->depth++;
+}
+
+static int bin(unsigned t)
+{
+    int e = 4;
+    if (t < 16)
+        return t;
+    while (t >> (e + 1))
+        e++;
+    return 16 + (e - 4) * 8 + ((t >> (e - 3)) & 7);
+}
+
+// Middle of the time range of bin b
+static unsigned bin_time(int b)
+{
+    int e;
+    if (b < 16)
+        return b;
+    e = (b - 16) / 8 + 4;
+    return ((8 + (b - 16) % 8) << (e - 3)) + (1 << (e - 4));
+}
+
+void stats_end(stats_stage_t *stage)
+{
+    stats_stack_t *st;
+    unsigned elapsed, t;
+
+    if (!collecting || !(st = get_stack()) || st->depth <= 0)
+        return;
+    if (--st->depth >= MAX_DEPTH)
+        return;
+    elapsed = GetTimer() - st->level[st->depth].start;
+    t = elapsed - st->level[st->depth].nested;
+    if (elapsed < st->level[st->depth].nested)
+        t = 0;
+    if (st->depth > 0)
+        st->level[st->depth - 1].nested += elapsed;
+    if (!stage)
+        return;
+    lock();
+    stage->calls++;
+    stage->total += t;
+    if (t > stage->max)
+        stage->max = t;
+    stage->hist[bin(t)]++;
+    unlock();
+}
+
+void stats_sample(stats_queue_t *queue, int64_t len)
+{
+    if (!queue)
+        return;
+    queue->samples++;
+    queue->sum += len;
+    if (len > queue->max)
+        queue->max = len;
+}
+
+static stats_wrap_t *find_wrap(const void *key, int type)
+{
+    stats_wrap_t *w = NULL;
+    int i;
+
+    lock();
+    for (i = 0; i < num_wraps; i++)
+        if (wraps[i].key == key && wraps[i].type == type) {
+            w = &wraps[i];
+            break;
+        }
+    unlock();
+    return w;
+}
+
+// Get the wrap of instance key, taking it over if the address was reused
+static stats_wrap_t *new_wrap(const void *key, int type, const char *name)
+{
+    stats_wrap_t *w = find_wrap(key, type);
+    stats_stage_t *stage = stats_stage(name);
+
+    if (!stage)
+        return NULL;
+    lock();
+    if (!w && num_wraps < MAX_WRAPS)
+        w = &wraps[num_wraps++];
+    if (w) {
+        w->key   = key;
+        w->type  = type;
+        w->stage = stage;
+    }
+    unlock();
+    return w;
+}
+
+static int put_image(struct vf_instance *vf, mp_image_t *mpi, double pts)
+{
+    stats_wrap_t *w = find_wrap(vf, WRAP_VF);
+    int ret;
+
+    stats_begin();
+    ret = w->orig.put_image(vf, mpi, pts);
+    stats_end(w->stage);
+    return ret;
+}
+
+static af_data_t *play(struct af_instance_s *af, af_data_t *data)
+{
+    stats_wrap_t *w = find_wrap(af, WRAP_AF);
+    af_data_t *ret;
+
+    stats_begin();
+    ret = w->orig.play(af, data);
+    stats_end(w->stage);
+    return ret;
+}
+
+static void write_chunk(muxer_stream_t *s, size_t len, unsigned int flags,
+                        double dts, double pts)
+{
+    stats_wrap_t *w = find_wrap(s->muxer, WRAP_MUXER);
+
+    stats_begin();
+    w->orig.write_chunk(s, len, flags, dts, pts);
+    stats_end(w->stage);
+}
+
+void stats_wrap_filters(struct vf_instance *vf)
+{
+    char name[64];
+    stats_wrap_t *w;
+
+    if (!collecting)
+        return;
+    for (; vf; vf = vf->next) {
+        if (vf->put_image == put_image)
+            continue;
+        // the last one is the encoder
+        snprintf(name, sizeof(name), "%s:%s", vf->next ? "vf" : "ve", vf->info->name);
+        if (!(w = new_wrap(vf, WRAP_VF, name)))
+            return;
+        w->orig.put_image = vf->put_image;
+        vf->put_image = put_image;
+    }
+}
+
+void stats_wrap_audio_filters(struct af_stream *afs)
+{
+    char name[64];
+    af_instance_t *af;
+    stats_wrap_t *w;
+
+    if (!collecting || !afs)
+        return;
+    for (af = afs->first; af; af = af->next) {
+        if (af->play == play)
+            continue;
+        snprintf(name, sizeof(name), "af:%s", af->info->name);
+        if (!(w = new_wrap(af, WRAP_AF, name)))
+            return;
+        w->orig.play = af->play;
+        af->play = play;
+    }
+}
+
+void stats_wrap_muxer(struct muxer_t *muxer)
+{
+    stats_wrap_t *w;
+
+    if (!collecting || muxer->cont_write_chunk == write_chunk)
+        return;
+    if (!(w = new_wrap(muxer, WRAP_MUXER, "mux")))
+        return;
+    w->orig.write_chunk = muxer->cont_write_chunk;
+    muxer->cont_write_chunk = write_chunk;
+}
+
+static unsigned percentile(stats_stage_t *s, int p)
+{
+    unsigned n = 0, target = ((uint64_t)s->calls * p + 99) / 100;
+    int b;
+
+    for (b = 0; b < HIST_BINS; b++) {
+        n += s->hist[b];
+        if (n >= target && n)
+            return FFMIN(bin_time(b), s->max);
+    }
+    return s->max;
+}
+
+static void write_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*str >= ' ')
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+int stats_write(const char *filename, double elapsed, int frames)
+{
+    FILE *f;
+    int i;
+#ifndef __MINGW32__
+    struct rusage ru;
+#endif
+
+    if (!collecting)
+        return 1;
+    f = fopen(filename, "w");
+    if (!f) {
+        mp_msg(MSGT_MENCODER, MSGL_ERR, "Cannot write statistics to %s.\n", filename);
+        return 0;
+    }
+    fprintf(f, "{\n  \"elapsed\": %.3f,\n  \"frames\": %d,\n  \"fps\": %.3f,\n",
+            elapsed, frames, elapsed > 0 ? frames / elapsed : 0.0);
+
+    fprintf(f, "  \"stages\": [");
+    for (i = 0; i < num_stages; i++) {
+        stats_stage_t *s = stages[i];
+        fprintf(f, "%s\n    { \"name\": ", i ? "," : "");
+        write_string(f, s->name);
+        fprintf(f, ", \"calls\": %u, \"total_ms\": %.3f, \"mean_us\": %.1f, "
+                   "\"p50_us\": %u, \"p90_us\": %u, \"p99_us\": %u, \"max_us\": %u }",
+                s->calls, s->total / 1000.0,
+                s->calls ? (double)s->total / s->calls : 0.0,
+                percentile(s, 50), percentile(s, 90), percentile(s, 99), s->max);
+    }
+    fprintf(f, "\n  ],\n");
+
+    fprintf(f, "  \"queues\": [");
+    for (i = 0; i < num_queues; i++) {
+        stats_queue_t *q = queues[i];
+        fprintf(f, "%s\n    { \"name\": ", i ? "," : "");
+        write_string(f, q->name);
+        fprintf(f, ", \"samples\": %u, \"mean\": %.1f, \"max\": %"PRId64" }",
+                q->samples, q->samples ? (double)q->sum / q->samples : 0.0, q->max);
+    }
+    fprintf(f, "\n  ],\n");
+
+#ifndef __MINGW32__
+    if (!getrusage(RUSAGE_SELF, &ru))
+#ifdef __APPLE__
+        fprintf(f, "  \"max_rss_kb\": %ld,\n", (long)(ru.ru_maxrss / 1024));
+#else
+        fprintf(f, "  \"max_rss_kb\": %ld,\n", (long)ru.ru_maxrss);
+#endif
+#endif
+    fprintf(f, "  \"version\": 1\n}\n");
+
+    if (fclose(f)) {
+        mp_msg(MSGT_MENCODER, MSGL_ERR, "Cannot write statistics to %s.\n", filename);
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of MPlayer.
+ *
+ * MPlayer is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * MPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with MPlayer; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPLAYER_STATS_H
+#define MPLAYER_STATS_H
+
+#include <stdint.h>
+
+struct vf_instance;
+struct af_stream;
+struct muxer_t;
+
+typedef struct stats_stage stats_stage_t;
+typedef struct stats_queue stats_queue_t;
+
+/// Start collecting, all other functions do nothing until then.
+void stats_init(void);
+
+/** \brief Get the stage called name, it is created on first use.
+ *  \return NULL if not collecting */
+stats_stage_t *stats_stage(const char *name);
+stats_queue_t *stats_queue(const char *name);
+
+/** \brief Time the code between stats_begin() and stats_end().
+ *  The pairs nest, a stage is only charged with the time not spent in the
+ *  stages nested inside it. */
+void stats_begin(void);
+void stats_end(stats_stage_t *stage);
+
+/// Record the current length of a queue.
+void stats_sample(stats_queue_t *queue, int64_t len);
+
+/// Time every filter, the encoder at the end, every audio filter and the muxer.
+void stats_wrap_filters(struct vf_instance *vf);
+void stats_wrap_audio_filters(struct af_stream *afs);
+void stats_wrap_muxer(struct muxer_t *muxer);
+
+/** \brief Write what was collected as JSON.
+ *  \param elapsed wall clock time in seconds
+ *  \return 0 if the file could not be written */
+int stats_write(const char *filename, double elapsed, int frames);
+
+#endif /* MPLAYER_STATS_H */
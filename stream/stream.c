@@ -356,12 +356,66 @@ eof_out:
   return len;
 }
 
+#define PROBE_MAX_GAP (64*1024)
+
+/**
+ * Fill the buffer from the probe data if the position is inside it.
+ * Drops the probe data once it is left after probing ended.
+ */
+static int probe_fill_buffer(stream_t *s){
+  off_t off = s->pos - s->probe_start;
+  int len;
+  if (!s->probe_synced || off < 0 || off >= s->probe_len) {
+    if (!s->probe_grow) {
+      free(s->probe_buf);
+      s->probe_buf = NULL;
+    }
+    return 0;
+  }
+  len = FFMIN(s->probe_len - off, STREAM_BUFFER_SIZE);
+  memcpy(s->buffer, s->probe_buf + off, len);
+  s->pos += len;
+  s->buf_pos = 0;
+  s->buf_len = len;
+  s->eof = 0;
+  return len;
+}
+
+// Append what was just read if it continues the probe data
+static void probe_append(stream_t *s, int len){
+  if (s->probe_grow && s->pos - len == s->probe_start + s->probe_len) {
+    if (s->probe_len + len > s->probe_size) {
+      int size = FFMIN(FFMAX(2 * s->probe_size, s->probe_len + len),
+                       STREAM_PROBE_SIZE);
+      unsigned char *buf = NULL;
+      if (s->probe_len + len <= size)
+        buf = realloc(s->probe_buf, size);
+      if (buf) {
+        s->probe_buf  = buf;
+        s->probe_size = size;
+      } else
+        s->probe_grow = 0; // full, keep what we have until it is left
+    }
+    if (s->probe_grow) {
+      memcpy(s->probe_buf + s->probe_len, s->buffer, len);
+      s->probe_len += len;
+    }
+  }
+  // after reading the real position is s->pos again
+  s->probe_synced = s->pos == s->probe_start + s->probe_len;
+}
+
 int stream_fill_buffer(stream_t *s){
-  int len = stream_read_internal(s, s->buffer, STREAM_BUFFER_SIZE);
+  int len;
+  if (s->probe_buf && (len = probe_fill_buffer(s)) > 0)
+    return len;
+  len = stream_read_internal(s, s->buffer, STREAM_BUFFER_SIZE);
   if (len <= 0)
     return 0;
   s->buf_pos=0;
   s->buf_len=len;
+  if (s->probe_buf)
+    probe_append(s, len);
 //  printf("[%d]",len);fflush(stdout);
   if (s->capture_file)
     stream_capture_do(s);
@@ -380,9 +434,31 @@ int stream_write_buffer(stream_t *s, unsigned char *buf, int len) {
   return rd;
 }
 
+/**
+ * Write buf, which is owned by ref, without copying it if the stream
+ * supports that. release(ref) is called once buf is not needed anymore,
+ * which may be right away.
+ */
+int stream_write_ref(stream_t *s, unsigned char *buf, int len,
+                     void (*release)(void *ref), void *ref) {
+  int rd;
+  if(!s->write_ref) {
+    rd = stream_write_buffer(s, buf, len);
+    release(ref);
+    return rd;
+  }
+  rd = s->write_ref(s, buf, len, release, ref);
+  if(rd < 0)
+    return -1;
+  s->pos += rd;
+  assert(rd == len && "stream_write_ref(): unexpected short write");
+  return rd;
+}
+
 int stream_seek_internal(stream_t *s, off_t newpos)
 {
 if(newpos==0 || newpos!=s->pos){
+  s->probe_synced = 0;
   switch(s->type){
   case STREAMTYPE_STREAM:
     //s->pos=newpos; // real seek
@@ -453,13 +529,42 @@ if( mp_msg_test(MSGT_STREAM,MSGL_DBG3) ){
 }
   pos-=newpos;
 
+  if (s->probe_buf) {
+    off_t end = s->probe_start + s->probe_len;
+    int inside = newpos >= s->probe_start && newpos <= end;
+    // a single seek to the end of the probe data instead of reading it again
+    if (inside && !s->probe_synced && s->seek &&
+        stream_seek_internal(s, end) < 0 && s->pos == end)
+      s->probe_synced = 1;
+    if (s->probe_synced) {
+      if (inside) {
+        s->pos = newpos; // read back from the probe data
+        goto fill;
+      }
+      s->pos = end; // the real position
+      // read short gaps into the probe data rather than seeking over them
+      if (s->probe_grow && newpos > end && newpos - end <= PROBE_MAX_GAP)
+        goto fill;
+    }
+  }
   res = stream_seek_internal(s, newpos);
   if (res >= 0)
     return res;
 
+fill:
+
   while(s->pos<newpos){
     if(stream_fill_buffer(s)<=0) break; // EOF
   }
+  // short reads may end past newpos, then the last buffer holds it
+  if(s->pos>newpos && s->buf_len){
+    pos += newpos - (s->pos - s->buf_len);
+    if(pos<=s->buf_len){
+      s->buf_pos=pos;
+      return 1;
+    }
+    pos -= s->buf_len;
+  }
 
 while(stream_fill_buffer(s) > 0 && pos >= 0) {
   if(pos<=s->buf_len){
@@ -481,18 +586,68 @@ void stream_reset(stream_t *s){
     s->pos=0;
     s->buf_pos=s->buf_len=0;
     s->eof=0;
+    s->probe_synced=0;
   }
   if(s->control) s->control(s,STREAM_CTRL_RESET,NULL);
   //stream_seek(s,0);
 }
 
+/**
+ * Keep what is read from now on, so the demuxers can each check the start
+ * of the stream without seeking back in it, which may take a round trip on
+ * network streams. Only streams read directly without sectors qualify.
+ */
+void stream_probe_start(stream_t *s){
+  if (s->probe_buf || s->cache_pid || s->sector_size ||
+      s->type == STREAMTYPE_DVDNAV || s->mode == STREAM_WRITE)
+    return;
+  s->probe_buf = malloc(64 * 1024);
+  if (!s->probe_buf)
+    return;
+  s->probe_size = 64 * 1024;
+  // the data in the buffer is the start of the probe data
+  s->probe_start = s->pos - s->buf_len;
+  s->probe_len = s->buf_len;
+  memcpy(s->probe_buf, s->buffer, s->buf_len);
+  s->probe_grow = 1;
+  s->probe_synced = 1;
+}
+
+/**
+ * Stop keeping what is read. The probe data is still read back until the
+ * demuxer leaves it.
+ */
+void stream_probe_end(stream_t *s){
+  s->probe_grow = 0;
+  if (s->probe_buf && (!s->probe_synced ||
+                       s->pos == s->probe_start + s->probe_len)) {
+    free(s->probe_buf);
+    s->probe_buf = NULL;
+  }
+}
+
 int stream_control(stream_t *s, int cmd, void *arg){
+  int res;
   if(!s->control) return STREAM_UNSUPPORTED;
 #ifdef CONFIG_STREAM_CACHE
   if (s->cache_pid)
     return cache_do_control(s, cmd, arg);
 #endif
-  return s->control(s, cmd, arg);
+  res = s->control(s, cmd, arg);
+  switch (cmd) {
+  case STREAM_CTRL_RESET:
+  case STREAM_CTRL_SEEK_TO_CHAPTER:
+  case STREAM_CTRL_SEEK_TO_TIME:
+  case STREAM_CTRL_SET_ANGLE:
+    // the stream moved, the probe data does not continue at its position
+    if (res == STREAM_OK && s->probe_buf) {
+      free(s->probe_buf);
+      s->probe_buf = NULL;
+      s->probe_grow = 0;
+      s->probe_synced = 0;
+    }
+  }
+  return res;
 }
 
 stream_t* new_memory_stream(unsigned char* data,int len){
@@ -560,6 +715,7 @@ void free_stream(stream_t *s){
   // Disabled atm, i don't like that. s->priv can be anything after all
   // streams should destroy their priv on close
   //free(s->priv);
+  free(s->probe_buf);
   free(s->url);
   free(s);
 }
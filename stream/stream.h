@@ -57,6 +57,7 @@
 
 #define STREAM_BUFFER_SIZE 2048
 #define STREAM_MAX_SECTOR_SIZE (8*1024)
+#define STREAM_PROBE_SIZE (1024*1024)
 
 #define VCD_SECTOR_SIZE 2352
 #define VCD_SECTOR_OFFS 24
@@ -154,6 +155,9 @@ typedef struct stream {
   int (*fill_buffer)(struct stream *s, char* buffer, int max_len);
   // Write
   int (*write_buffer)(struct stream *s, char* buffer, int len);
+  // Write without copying, release(ref) is called once buffer is written
+  int (*write_ref)(struct stream *s, char* buffer, int len,
+                   void (*release)(void *ref), void *ref);
   // Seek
   int (*seek)(struct stream *s,off_t pos);
   // Control
@@ -179,8 +183,15 @@ typedef struct stream {
 #ifdef CONFIG_NETWORKING
   streaming_ctrl_t *streaming_ctrl;
 #endif
-  unsigned char buffer[STREAM_BUFFER_SIZE>STREAM_MAX_SECTOR_SIZE?STREAM_BUFFER_SIZE:STREAM_MAX_SECTOR_SIZE];
   FILE *capture_file;
+  // data read while probing, replayed instead of seeking back
+  unsigned char *probe_buf;
+  off_t probe_start;
+  int probe_len, probe_size;
+  int probe_grow;   // append what is read at the end of the probe data
+  int probe_synced; // the real position is at the end of the probe data
+  // must be last, new_memory_stream() allocates it past the end
+  unsigned char buffer[STREAM_BUFFER_SIZE>STREAM_MAX_SECTOR_SIZE?STREAM_BUFFER_SIZE:STREAM_MAX_SECTOR_SIZE];
 } stream_t;
 
 #ifdef CONFIG_NETWORKING
@@ -202,6 +213,8 @@ int cache_stream_seek_long(stream_t *s,int64_t pos);
 #define stream_enable_cache(x,y,z,w) 1
 #endif
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len);
+int stream_write_ref(stream_t *s, unsigned char *buf, int len,
+                     void (*release)(void *ref), void *ref);
 
 static inline int stream_read_char(stream_t *s)
 {
@@ -359,6 +372,8 @@ static inline int stream_skip(stream_t *s, off_t len)
 }
 
 void stream_reset(stream_t *s);
+void stream_probe_start(stream_t *s);
+void stream_probe_end(stream_t *s);
 int stream_control(stream_t *s, int cmd, void *arg);
 stream_t* new_stream(int fd,int type);
 void free_stream(stream_t *s);
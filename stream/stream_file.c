@@ -19,6 +19,9 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -26,6 +29,12 @@
 #if HAVE_SETMODE
 #include <io.h>
 #endif
+#ifndef __MINGW32__
+#include <sys/uio.h>
+#endif
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #include "mp_msg.h"
 #include "stream.h"
@@ -59,20 +68,217 @@ static int fill_buffer(stream_t *s, char* buffer, int max_len){
   return (r <= 0) ? -1 : r;
 }
 
-static int write_buffer(stream_t *s, char* buffer, int len) {
+static int write_all(int fd, const void *buffer, int len) {
   int r;
   int wr = 0;
   while (wr < len) {
-    r = write(s->fd,buffer,len);
+    r = write(fd,(const char *)buffer + wr,len - wr);
     if (r <= 0)
       return -1;
     wr += r;
-    buffer += r;
   }
   return len;
 }
 
+/* Output files are written behind: write_buffer() only copies into a large
+   page aligned buffer, and full batches are written by a thread while the
+   muxer fills the other one. The writes stay big and aligned, which the
+   uncached (F_NOCACHE) file needs, and the encoder does not stall while the
+   disk is busy. Bigger blocks handed over with write_ref() are not copied,
+   they are written from where they are with writev() and released once
+   written. Seeks and closing wait for everything to be written. */
+#define WB_SIZE  (1 << 20)
+#define WB_ALIGN 4096
+#define WB_IOVS  64                // blocks per batch
+#define WB_MAX_REF (4 * WB_SIZE)   // referenced bytes held per batch
+#define WB_MIN_REF 4096            // smaller blocks are copied
+
+struct wb_batch {
+  void *mem;
+  unsigned char *buf;    // page aligned part of mem
+  int len;               // bytes used in buf
+  struct iovec iov[WB_IOVS];
+  int n_iov;
+  struct {
+    void (*release)(void *ref);
+    void *ref;
+  } refs[WB_IOVS];
+  int n_refs;
+  int ref_len;           // bytes referenced in refs
+};
+
+struct write_behind {
+  struct wb_batch batch[2];
+  int cur;               // batch the muxer writes into
+  int error;
+#if HAVE_PTHREADS
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int fd;
+  int busy;              // worker is writing batch[!cur]
+  int quit;
+#endif
+};
+
+static int write_batch(int fd, struct wb_batch *b) {
+  struct iovec *iov = b->iov;
+  int n = b->n_iov;
+  while (n > 0) {
+#ifndef __MINGW32__
+    ssize_t r = writev(fd, iov, n);
+#else
+    ssize_t r = write(fd, iov->iov_base, iov->iov_len);
+#endif
+    if (r <= 0)
+      return -1;
+    // skip what has been written, partly written blocks are adjusted
+    while (n > 0 && r >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++;
+      n--;
+    }
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+  return 0;
+}
+
+// Release the references of a written batch and empty it
+static void wb_reset(struct wb_batch *b) {
+  int i;
+  for (i = 0; i < b->n_refs; i++)
+    b->refs[i].release(b->refs[i].ref);
+  b->n_refs = b->ref_len = b->n_iov = b->len = 0;
+}
+
+#if HAVE_PTHREADS
+static void *wb_worker(void *arg) {
+  struct write_behind *wb = arg;
+
+  pthread_mutex_lock(&wb->lock);
+  while (1) {
+    while (!wb->busy && !wb->quit)
+      pthread_cond_wait(&wb->cond, &wb->lock);
+    if (wb->quit)
+      break;
+    pthread_mutex_unlock(&wb->lock);
+    if (write_batch(wb->fd, &wb->batch[!wb->cur]) < 0)
+      wb->error = errno;
+    pthread_mutex_lock(&wb->lock);
+    wb->busy = 0;
+    pthread_cond_broadcast(&wb->cond);
+  }
+  pthread_mutex_unlock(&wb->lock);
+  return NULL;
+}
+
+static void wb_wait(struct write_behind *wb) {
+  pthread_mutex_lock(&wb->lock);
+  while (wb->busy)
+    pthread_cond_wait(&wb->cond, &wb->lock);
+  pthread_mutex_unlock(&wb->lock);
+}
+#endif
+
+// Start writing out the current batch
+static void wb_submit(stream_t *s) {
+  struct write_behind *wb = s->priv;
+#if HAVE_PTHREADS
+  wb_wait(wb);
+  // references are released here, not on the worker, since the owner
+  // of the buffers is not thread safe
+  wb_reset(&wb->batch[!wb->cur]);
+  pthread_mutex_lock(&wb->lock);
+  wb->cur = !wb->cur;
+  wb->busy = 1;
+  pthread_cond_broadcast(&wb->cond);
+  pthread_mutex_unlock(&wb->lock);
+#else
+  if (write_batch(s->fd, &wb->batch[wb->cur]) < 0)
+    wb->error = errno;
+  wb_reset(&wb->batch[wb->cur]);
+#endif
+}
+
+// Write out everything, returns 0 on error
+static int wb_flush(stream_t *s) {
+  struct write_behind *wb = s->priv;
+  if (wb->batch[wb->cur].n_iov)
+    wb_submit(s);
+#if HAVE_PTHREADS
+  wb_wait(wb);
+  wb_reset(&wb->batch[!wb->cur]);
+#endif
+  return !wb->error;
+}
+
+static int wb_error(struct write_behind *wb) {
+  if (!wb->error)
+    return 0;
+  mp_msg(MSGT_STREAM, MSGL_ERR, "[file] Write error: %s\n", strerror(wb->error));
+  return 1;
+}
+
+static int write_buffer(stream_t *s, char* buffer, int len) {
+  struct write_behind *wb = s->priv;
+  int left = len;
+
+  if (!wb)
+    return write_all(s->fd, buffer, len);
+  while (left > 0) {
+    struct wb_batch *b = &wb->batch[wb->cur];
+    struct iovec *last = b->iov + b->n_iov - 1;
+    int l = left < WB_SIZE - b->len ? left : WB_SIZE - b->len;
+    // continue the last block if it is in buf, else start a new one
+    if (b->n_iov && (unsigned char *)last->iov_base + last->iov_len == b->buf + b->len) {
+      last->iov_len += l;
+    } else if (b->n_iov < WB_IOVS) {
+      b->iov[b->n_iov].iov_base = b->buf + b->len;
+      b->iov[b->n_iov++].iov_len = l;
+    } else {
+      wb_submit(s);
+      continue;
+    }
+    memcpy(b->buf + b->len, buffer, l);
+    b->len += l;
+    buffer  += l;
+    left    -= l;
+    if (b->len == WB_SIZE)
+      wb_submit(s);
+  }
+  return wb_error(wb) ? -1 : len;
+}
+
+static int write_ref(stream_t *s, char* buffer, int len,
+                     void (*release)(void *ref), void *ref) {
+  struct write_behind *wb = s->priv;
+  struct wb_batch *b = &wb->batch[wb->cur];
+
+  if (len < WB_MIN_REF) {
+    len = write_buffer(s, buffer, len);
+    release(ref);
+    return len;
+  }
+  if (b->n_iov == WB_IOVS) {
+    wb_submit(s);
+    b = &wb->batch[wb->cur];
+  }
+  b->iov[b->n_iov].iov_base = buffer;
+  b->iov[b->n_iov++].iov_len = len;
+  b->refs[b->n_refs].release = release;
+  b->refs[b->n_refs++].ref = ref;
+  b->ref_len += len;
+  if (b->n_iov == WB_IOVS || b->ref_len >= WB_MAX_REF)
+    wb_submit(s);
+  return wb_error(wb) ? -1 : len;
+}
+
 static int seek(stream_t *s,off_t newpos) {
+  if (s->priv && !wb_flush(s))
+    return 0;
   s->pos = newpos;
   if(lseek(s->fd,s->pos,SEEK_SET)<0) {
     s->eof=1;
@@ -81,6 +287,56 @@ static int seek(stream_t *s,off_t newpos) {
   return 1;
 }
 
+static void close_f(stream_t *s) {
+  struct write_behind *wb = s->priv;
+  int i;
+  if (!wb_flush(s))
+    wb_error(wb);
+#if HAVE_PTHREADS
+  pthread_mutex_lock(&wb->lock);
+  wb->quit = 1;
+  pthread_cond_broadcast(&wb->cond);
+  pthread_mutex_unlock(&wb->lock);
+  pthread_join(wb->thread, NULL);
+  pthread_cond_destroy(&wb->cond);
+  pthread_mutex_destroy(&wb->lock);
+#endif
+  for (i = 0; i < 2; i++)
+    free(wb->batch[i].mem);
+  free(wb);
+  s->priv = NULL;
+}
+
+static struct write_behind *wb_init(int fd) {
+  struct write_behind *wb = calloc(1, sizeof(*wb));
+  int i;
+  if (!wb)
+    return NULL;
+  for (i = 0; i < 2; i++) {
+    struct wb_batch *b = &wb->batch[i];
+    b->mem = malloc(WB_SIZE + WB_ALIGN);
+    if (!b->mem)
+      goto err_out;
+    b->buf = (unsigned char *)(((uintptr_t)b->mem + WB_ALIGN - 1) & ~(uintptr_t)(WB_ALIGN - 1));
+  }
+#if HAVE_PTHREADS
+  wb->fd = fd;
+  pthread_mutex_init(&wb->lock, NULL);
+  pthread_cond_init(&wb->cond, NULL);
+  if (pthread_create(&wb->thread, NULL, wb_worker, wb)) {
+    pthread_cond_destroy(&wb->cond);
+    pthread_mutex_destroy(&wb->lock);
+    goto err_out;
+  }
+#endif
+  return wb;
+err_out:
+  free(wb->batch[0].mem);
+  free(wb->batch[1].mem);
+  free(wb);
+  return NULL;
+}
+
 static int seek_forward(stream_t *s,off_t newpos) {
   if(newpos<s->pos){
     mp_msg(MSGT_STREAM,MSGL_INFO,"Cannot seek backward in linear streams!\n");
@@ -101,6 +357,8 @@ static int control(stream_t *s, int cmd, void *arg) {
     case STREAM_CTRL_GET_SIZE: {
       off_t size;
 
+      if (s->priv)
+        wb_flush(s);
       size = lseek(s->fd, 0, SEEK_END);
       lseek(s->fd, s->pos, SEEK_SET);
       if(size != (off_t)-1) {
@@ -204,6 +462,13 @@ static int open_f(stream_t *stream,int mode, void* opts, int* file_format) {
   stream->write_buffer = write_buffer;
   stream->control = control;
   stream->read_chunk = 64*1024;
+  if (mode == STREAM_WRITE) {
+    stream->priv = wb_init(f);
+    if (stream->priv) {
+      stream->write_ref = write_ref;
+      stream->close = close_f;
+    }
+  }
 
   m_struct_free(&stream_opts,opts);
   return STREAM_OK;
@@ -53,6 +53,11 @@ char* ass_color = NULL;
 char* ass_border_color = NULL;
 char* ass_styles_file = NULL;
 int ass_hinting = ASS_HINTING_NATIVE + 4; // native hinting for unscaled osd
+int ass_cache_size = 0; // bitmap cache limit in MB, 0 for libass default
+#ifdef CONFIG_ASS_INTERNAL
+int ass_threads = 1;
+int ass_fast_blur = 0;
+#endif
 float ass_bottom_margin_ratio = -1.0f;
 float ass_top_margin_ratio = -1.0f;
 
@@ -398,6 +403,11 @@ void eosd_ass_init(ASS_Library *ass_library)
 	if (!ass_renderer)
 		return;
 	ass_configure_fonts(ass_renderer);
+	ass_set_cache_limits(ass_renderer, 0, ass_cache_size);
+#ifdef CONFIG_ASS_INTERNAL
+	ass_set_threads(ass_renderer, ass_threads);
+	ass_set_fast_blur(ass_renderer, ass_fast_blur);
+#endif
 	if (!eosd_registered(&eosd_ass))
 		eosd_register(&eosd_ass);
 }
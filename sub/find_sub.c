@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "libvo/video_out.h"
 #include "sub.h"
@@ -67,20 +68,46 @@ void step_sub(sub_data *subd, float pts, int movement) {
     sub_delay = pts - subs[current_sub].start / (subd->sub_uses_time ? 100 : sub_fps);
 }
 
+/* max_end[i] is the latest end time of subtitles 0..i. Subtitles are
+   sorted by start time, so the ones running at some time are found by
+   searching the last one that started and walking back until max_end
+   shows that nothing earlier is still running. This also works when
+   subtitles overlap. The array is kept in the sub_data and freed with it. */
+static void build_max_end(sub_data *subd)
+{
+    int i;
+    free(subd->max_end);
+    subd->max_end_num = 0;
+    subd->max_end = malloc(subd->sub_num * sizeof(*subd->max_end));
+    if (!subd->max_end)
+        return;
+    for (i = 0; i < subd->sub_num; i++) {
+        subd->max_end[i] = subd->subtitles[i].end;
+        if (i && subd->max_end[i - 1] > subd->max_end[i])
+            subd->max_end[i] = subd->max_end[i - 1];
+    }
+    subd->max_end_num = subd->sub_num;
+}
+
 void find_sub(sub_data* subd,int key){
     subtitle *subs;
     subtitle *new_sub = NULL;
+    unsigned long *max_end;
     int i,j;
 
     if ( !subd || subd->sub_num == 0) return;
     subs = subd->subtitles;
 
-    if (last_sub_data != subd) {
+    if (last_sub_data != subd || subd->max_end_num != subd->sub_num) {
         // Sub data changed, reset nosub range.
         last_sub_data = subd;
         nosub_range_start = -1;
         nosub_range_end = -1;
+        if (subd->max_end_num != subd->sub_num)
+            build_max_end(subd);
+        if (!subd->max_end) return;
     }
+    max_end = subd->max_end;
 
     if(vo_sub){
       if(key>=vo_sub->start && key<=vo_sub->end) return; // OK!
@@ -97,80 +124,54 @@ void find_sub(sub_data* subd,int key){
       goto update;
     }
 
-//    printf("\r---- sub changed ----\n");
-
     // check next sub.
     if(current_sub>=0 && current_sub+1 < subd->sub_num){
-      if(key>subs[current_sub].end && key<subs[current_sub+1].start){
+      if(key>max_end[current_sub] && key<subs[current_sub+1].start){
           // no sub
-          nosub_range_start=subs[current_sub].end;
+          nosub_range_start=max_end[current_sub];
           nosub_range_end=subs[current_sub+1].start;
           goto update;
       }
-      // next sub?
-      ++current_sub;
-      new_sub=&subs[current_sub];
-      if(key>=new_sub->start && key<=new_sub->end) goto update; // OK!
+      // next sub, unless a later one started as well
+      new_sub=&subs[current_sub+1];
+      if(key>=new_sub->start && key<=new_sub->end &&
+         (current_sub+2 >= subd->sub_num || key<subs[current_sub+2].start)){
+          ++current_sub;
+          goto update;
+      }
+      new_sub=NULL;
     }
 
-//    printf("\r---- sub log search... ----\n");
-
-    // use logarithmic search:
+    // use logarithmic search for the last sub starting at or before key:
     i=0;
-    j = subd->sub_num - 1;
-//    printf("Searching %d in %d..%d\n",key,subs[i].start,subs[j].end);
-    while(j>=i){
-        current_sub=(i+j+1)/2;
-        new_sub=&subs[current_sub];
-        if(key<new_sub->start) j=current_sub-1;
-        else if(key>new_sub->end) i=current_sub+1;
-        else goto update; // found!
+    j=subd->sub_num;
+    while(i<j){
+        int mid=(i+j)/2;
+        if(key<subs[mid].start) j=mid;
+        else i=mid+1;
     }
-//    if(key>=new_sub->start && key<=new_sub->end) return; // OK!
-
-    // check where are we...
-    if(key<new_sub->start){
-      if(current_sub<=0){
-          // before the first sub
-          nosub_range_start=key-1; // tricky
-          nosub_range_end=new_sub->start;
-//          printf("FIRST...  key=%d  end=%d  \n",key,new_sub->start);
-          new_sub=NULL;
-          goto update;
-      }
-      --current_sub;
-      if(key>subs[current_sub].end && key<subs[current_sub+1].start){
-          // no sub
-          nosub_range_start=subs[current_sub].end;
-          nosub_range_end=subs[current_sub+1].start;
-//          printf("No sub... 1 \n");
-          new_sub=NULL;
-          goto update;
-      }
-      printf("HEH????  ");
-    } else {
-      if(key<=new_sub->end) printf("JAJJ!  "); else
-      if(current_sub+1 >= subd->sub_num){
-          // at the end?
-          nosub_range_start=new_sub->end;
-          nosub_range_end=0x7FFFFFFF; // MAXINT
-//          printf("END!?\n");
-          new_sub=NULL;
-          goto update;
-      } else
-      if(key>subs[current_sub].end && key<subs[current_sub+1].start){
-          // no sub
-          nosub_range_start=subs[current_sub].end;
-          nosub_range_end=subs[current_sub+1].start;
-//          printf("No sub... 2 \n");
-          new_sub=NULL;
-          goto update;
-      }
+    i--;
+
+    // the latest started sub that is still running
+    for(j=i; j>=0 && key<=max_end[j]; j--){
+        if(key<=subs[j].end){
+            current_sub=j;
+            new_sub=&subs[j];
+            goto update;
+        }
     }
 
-    mp_msg(MSGT_FIXME,MSGL_FIXME,"SUB ERROR:  %d  ?  %d --- %d  [%d]  \n",key,(int)new_sub->start,(int)new_sub->end,current_sub);
-
-    new_sub=NULL; // no sub here
+    // no sub here, remember until when
+    if(i<0){
+        // before the first sub
+        current_sub=0;
+        nosub_range_start=key-1; // tricky
+        nosub_range_end=subs[0].start;
+    } else {
+        current_sub=i;
+        nosub_range_start=max_end[i];
+        nosub_range_end=i+1 < subd->sub_num ? subs[i+1].start : 0x7FFFFFFF; // MAXINT
+    }
 update:
     set_osd_subtitle(new_sub);
 }
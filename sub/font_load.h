@@ -32,7 +32,7 @@ typedef struct {
     int w,h,c;
 #ifdef CONFIG_FREETYPE
     int charwidth,charheight,pen,baseline,padding;
-    int current_count, current_alloc;
+    int current_count, current_alloc; // atlas rows, pen is the x of the next glyph
 #endif
 } raw_file;
 
@@ -53,6 +53,7 @@ typedef struct font_desc {
     int start[65536];   // short is not enough for unicode fonts
     short width[65536];
     int freetype;
+    unsigned serial;    // tells this font from earlier ones at the same address
 
 #ifdef CONFIG_FREETYPE
     int face_cnt;
@@ -83,6 +84,7 @@ typedef struct font_desc {
 
 extern font_desc_t* vo_font;
 extern font_desc_t* sub_font;
+extern unsigned font_desc_serial;
 
 extern char *subtitle_font_encoding;
 extern float text_font_scale_factor;
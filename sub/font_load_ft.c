@@ -109,6 +109,10 @@ static const FT_ULong osd_charcodes[OSD_CHARSET_SIZE] =
 
 #define ALIGN(x)                (((x)+7)&~7)    // 8 byte align
 
+// The glyphs of a face are packed into the rows of an atlas that is wide
+// enough for this many of its widest glyphs. A row is charheight pixels high.
+#define ATLAS_COLUMNS 16
+
 #define WARNING(msg, args...)      mp_msg(MSGT_OSD, MSGL_WARN, msg "\n", ## args)
 
 #define DEBUG 0
@@ -116,18 +120,22 @@ static const FT_ULong osd_charcodes[OSD_CHARSET_SIZE] =
 //static double ttime;
 
 
-static void paste_bitmap(unsigned char *bbuffer, FT_Bitmap *bitmap, int x, int y, int width, int height, int bwidth) {
-    int drow = x+y*width;
-    int srow = 0;
-    int sp, dp, w, h;
-    if (bitmap->pixel_mode==ft_pixel_mode_mono)
-	for (h = bitmap->rows; h>0 && height > 0; --h, height--, drow+=width, srow+=bitmap->pitch)
-	    for (w = bwidth, sp=dp=0; w>0; --w, ++dp, ++sp)
-		    bbuffer[drow+dp] = (bitmap->buffer[srow+sp/8] & (0x80>>(sp%8))) ? 255:0;
-    else
-	for (h = bitmap->rows; h>0 && height > 0; --h, height--, drow+=width, srow+=bitmap->pitch)
-	    for (w = bwidth, sp=dp=0; w>0; --w, ++dp, ++sp)
-		    bbuffer[drow+dp] = bitmap->buffer[srow+sp];
+// paste into a cell of width x height pixels, clipping what is outside of it
+static void paste_bitmap(unsigned char *bbuffer, FT_Bitmap *bitmap, int x, int y, int stride, int width, int height) {
+    int x1 = FFMAX(-x, 0), x2 = FFMIN((int)bitmap->width, width - x);
+    int y1 = FFMAX(-y, 0), y2 = FFMIN((int)bitmap->rows, height - y);
+    int sx, sy;
+    if (x1 >= x2) return;
+    bbuffer += x + y*stride;
+    for (sy = y1; sy < y2; sy++) {
+	const unsigned char *src = bitmap->buffer + sy*bitmap->pitch;
+	unsigned char *dst = bbuffer + sy*stride;
+	if (bitmap->pixel_mode==ft_pixel_mode_mono)
+	    for (sx = x1; sx < x2; sx++)
+		dst[sx] = (src[sx/8] & (0x80>>(sx%8))) ? 255:0;
+	else
+	    memcpy(dst + x1, src + x1, x2 - x1);
+    }
 }
 
 
@@ -244,7 +252,7 @@ static int check_font(font_desc_t *desc, float ppem, int padding, int pic_idx,
 
     bbuffer = NULL;
 
-    desc->pic_b[pic_idx]->w = width;
+    desc->pic_b[pic_idx]->w = width * ATLAS_COLUMNS;
     desc->pic_b[pic_idx]->h = height;
     desc->pic_b[pic_idx]->c = colors;
     desc->pic_b[pic_idx]->bmp = bbuffer;
@@ -490,13 +498,14 @@ static void resample_alpha(unsigned char *abuf, unsigned char *bbuf, int width,
 	}
 }
 
-#define ALLOC_INCR 32
+#define ALLOC_INCR 2	// atlas rows
 void render_one_glyph(font_desc_t *desc, int c)
 {
     FT_GlyphSlot	slot;
     FT_UInt		glyph_index;
     FT_BitmapGlyph glyph;
-    int width, height, stride, maxw, off;
+    raw_file *pic;
+    int width, height, stride, maxw, off, row_size;
     unsigned char *abuffer, *bbuffer;
 
     int	const	load_flags = FT_LOAD_DEFAULT;
@@ -541,52 +550,57 @@ void render_one_glyph(font_desc_t *desc, int c)
 
 //    fprintf(stderr, "glyph generated\n");
 
-    maxw = desc->pic_b[font]->charwidth;
+    pic = desc->pic_b[font];
+    maxw = pic->charwidth;
 
     if (glyph->bitmap.width > maxw) {
 	fprintf(stderr, "glyph too wide!\n");
     }
 
-    // allocate new memory, if needed
-//    fprintf(stderr, "\n%d %d %d\n", desc->pic_b[font]->charwidth, desc->pic_b[font]->charheight, desc->pic_b[font]->current_alloc);
-    if (desc->pic_b[font]->current_count >= desc->pic_b[font]->current_alloc) {
-	int newsize = desc->pic_b[font]->charwidth*desc->pic_b[font]->charheight*(desc->pic_b[font]->current_alloc+ALLOC_INCR);
-	int increment = desc->pic_b[font]->charwidth*desc->pic_b[font]->charheight*ALLOC_INCR;
-	desc->pic_b[font]->current_alloc += ALLOC_INCR;
-
-//	fprintf(stderr, "\nns = %d inc = %d\n", newsize, increment);
-
-	desc->pic_b[font]->bmp = realloc(desc->pic_b[font]->bmp, newsize);
-	desc->pic_a[font]->bmp = realloc(desc->pic_a[font]->bmp, newsize);
+    /* advance pen */
+    pen_xa = f266ToInt(slot->advance.x) + 2*pic->padding;
+    if (pen_xa > maxw) pen_xa = maxw;
 
-	off = desc->pic_b[font]->current_count*desc->pic_b[font]->charwidth*desc->pic_b[font]->charheight;
-	memset(desc->pic_b[font]->bmp+off, 0, increment);
-	memset(desc->pic_a[font]->bmp+off, 0, increment);
+    // the glyph takes only its own width in the atlas, rounded up so that
+    // draw_alpha can work on multiples of 8 pixels; start a new row if the
+    // current one is full
+    row_size = pic->w*pic->charheight;
+    if (!pic->current_count || pic->pen + ALIGN(pen_xa) > pic->w) {
+	if (pic->current_count >= pic->current_alloc) {
+	    int newsize = row_size*(pic->current_alloc+ALLOC_INCR);
+	    int increment = row_size*ALLOC_INCR;
+
+	    off = pic->current_alloc*row_size;
+	    pic->current_alloc += ALLOC_INCR;
+	    pic->bmp = realloc(pic->bmp, newsize);
+	    desc->pic_a[font]->bmp = realloc(desc->pic_a[font]->bmp, newsize);
+	    memset(pic->bmp+off, 0, increment);
+	    memset(desc->pic_a[font]->bmp+off, 0, increment);
+	}
+	pic->current_count++;
+	pic->pen = 0;
     }
 
     abuffer = desc->pic_a[font]->bmp;
-    bbuffer = desc->pic_b[font]->bmp;
+    bbuffer = pic->bmp;
 
-    off = desc->pic_b[font]->current_count*desc->pic_b[font]->charwidth*desc->pic_b[font]->charheight;
+    off = (pic->current_count-1)*row_size + pic->pen;
+    pic->pen += ALIGN(pen_xa);
+
+    width = desc->width[c] = pen_xa;
+    height = pic->charheight;
+    stride = pic->w;
 
     paste_bitmap(bbuffer+off,
 		 &glyph->bitmap,
-		 desc->pic_b[font]->padding + glyph->left,
-		 desc->pic_b[font]->baseline - glyph->top,
-		 desc->pic_b[font]->charwidth, desc->pic_b[font]->charheight,
-		 glyph->bitmap.width <= maxw ? glyph->bitmap.width : maxw);
+		 pic->padding + glyph->left,
+		 pic->baseline - glyph->top,
+		 stride, width, height);
 
 //    fprintf(stderr, "glyph pasted\n");
     FT_Done_Glyph((FT_Glyph)glyph);
 
-    /* advance pen */
-    pen_xa = f266ToInt(slot->advance.x) + 2*desc->pic_b[font]->padding;
-    if (pen_xa > maxw) pen_xa = maxw;
-
     desc->start[c] = off;
-    width = desc->width[c] = pen_xa;
-    height = desc->pic_b[font]->charheight;
-    stride = desc->pic_b[font]->w;
 
     if (desc->tables.o_r == 0) {
 	outline0(bbuffer+off, abuffer+off, width, height, stride);
@@ -607,8 +621,6 @@ void render_one_glyph(font_desc_t *desc, int c)
     }
 
     resample_alpha(abuffer+off, bbuffer+off, width, height, stride, font_factor);
-
-    desc->pic_b[font]->current_count++;
 }
 
 
@@ -845,6 +857,7 @@ static font_desc_t* init_font_desc(void)
     if(!desc) return NULL;
 
     desc->dynamic = 1;
+    desc->serial = ++font_desc_serial;
 
     /* setup sane defaults */
     desc->freetype = 1;
@@ -133,7 +133,225 @@ static const unsigned long long mask24hl  __attribute__((aligned(8))) = 0x0000FF
 
 #endif /* ARCH_X86 */
 
+#if HAVE_SSE2 && !defined(FAST_OSD)
+/* SSE2 versions, bit exact to the C ones. Blocks whose alpha is 0 (fully
+   transparent) everywhere are skipped without touching the destination,
+   so large mostly empty OSD/subtitle areas are cheap. */
+
+static void vo_draw_alpha_yv12_SSE2(int w, int h, unsigned char *src, unsigned char *srca,
+                                    int srcstride, unsigned char *dstbase, int dststride)
+{
+    int y;
+    int w16 = w & ~15;
+    for (y = 0; y < h; y++) {
+        int x;
+        if (w16) {
+            intptr_t i = -w16;
+            __asm__ volatile(
+                "pxor          %%xmm7, %%xmm7 \n\t"
+                "1:                           \n\t"
+                "movdqu     (%2,%0), %%xmm1   \n\t" // srca
+                "movdqa        %%xmm1, %%xmm2 \n\t"
+                "pcmpeqb       %%xmm7, %%xmm2 \n\t" // transparent pixels
+                "pmovmskb      %%xmm2, %%eax  \n\t"
+                "cmpl         $0xFFFF, %%eax  \n\t"
+                "je 2f                        \n\t"
+                "movdqu     (%1,%0), %%xmm3   \n\t" // dst
+                "movdqa        %%xmm3, %%xmm4 \n\t"
+                "movdqa        %%xmm3, %%xmm5 \n\t"
+                "punpcklbw     %%xmm7, %%xmm4 \n\t"
+                "punpckhbw     %%xmm7, %%xmm5 \n\t"
+                "movdqa        %%xmm1, %%xmm6 \n\t"
+                "punpcklbw     %%xmm7, %%xmm1 \n\t"
+                "punpckhbw     %%xmm7, %%xmm6 \n\t"
+                "pmullw        %%xmm1, %%xmm4 \n\t"
+                "pmullw        %%xmm6, %%xmm5 \n\t"
+                "psrlw             $8, %%xmm4 \n\t"
+                "psrlw             $8, %%xmm5 \n\t"
+                "packuswb      %%xmm5, %%xmm4 \n\t"
+                "movdqu     (%3,%0), %%xmm5   \n\t" // src
+                "paddb         %%xmm5, %%xmm4 \n\t"
+                "pand          %%xmm2, %%xmm3 \n\t"
+                "pandn         %%xmm4, %%xmm2 \n\t"
+                "por           %%xmm3, %%xmm2 \n\t"
+                "movdqu        %%xmm2, (%1,%0)\n\t"
+                "2:                           \n\t"
+                "add              $16, %0     \n\t"
+                "jl 1b                        \n\t"
+                : "+&r"(i)
+                : "r"(dstbase + w16), "r"(srca + w16), "r"(src + w16)
+                : "%eax", "memory", "xmm1", "xmm2", "xmm3", "xmm4",
+                                    "xmm5", "xmm6", "xmm7");
+        }
+        for (x = w16; x < w; x++)
+            if (srca[x]) dstbase[x] = ((dstbase[x] * srca[x]) >> 8) + src[x];
+        src     += srcstride;
+        srca    += srcstride;
+        dstbase += dststride;
+    }
+}
+
+/* Packed YUV: luma is blended like above, chroma is faded towards 128.
+   YPOS is the byte of each 16 bit word that holds luma. */
+#define PACKED_YUV_SSE2(name, ylo, yhi, clo, chi) \
+static void name(int w, int h, unsigned char *src, unsigned char *srca, \
+                 int srcstride, unsigned char *dstbase, int dststride) \
+{ \
+    int y; \
+    int w8 = w & ~7; \
+    for (y = 0; y < h; y++) { \
+        int x; \
+        if (w8) { \
+            intptr_t i = -w8; \
+            __asm__ volatile( \
+                "pxor          %%xmm7, %%xmm7 \n\t" \
+                "pcmpeqw       %%xmm6, %%xmm6 \n\t" \
+                "psrlw             $8, %%xmm6 \n\t" /* 0x00FF */ \
+                "1:                           \n\t" \
+                "movq       (%2,%0), %%xmm1   \n\t" /* srca */ \
+                "punpcklbw     %%xmm7, %%xmm1 \n\t" \
+                "movdqa        %%xmm1, %%xmm2 \n\t" \
+                "pcmpeqw       %%xmm7, %%xmm2 \n\t" /* transparent pixels */ \
+                "pmovmskb      %%xmm2, %%eax  \n\t" \
+                "cmpl         $0xFFFF, %%eax  \n\t" \
+                "je 2f                        \n\t" \
+                "movdqu   (%1,%0,2), %%xmm3   \n\t" /* dst */ \
+                "movdqa        %%xmm3, %%xmm4 \n\t" \
+                "movdqa        %%xmm3, %%xmm5 \n\t" \
+                ylo \
+                "pmullw        %%xmm1, %%xmm4 \n\t" \
+                "psrlw             $8, %%xmm4 \n\t" \
+                "movq       (%3,%0), %%xmm0   \n\t" /* src */ \
+                "punpcklbw     %%xmm7, %%xmm0 \n\t" \
+                "paddw         %%xmm0, %%xmm4 \n\t" \
+                "pand          %%xmm6, %%xmm4 \n\t" \
+                clo \
+                "pcmpeqw       %%xmm0, %%xmm0 \n\t" \
+                "psrlw            $15, %%xmm0 \n\t" \
+                "psllw             $7, %%xmm0 \n\t" /* 128 */ \
+                "psubw         %%xmm0, %%xmm5 \n\t" \
+                "pmullw        %%xmm1, %%xmm5 \n\t" \
+                "psraw             $8, %%xmm5 \n\t" \
+                "paddw         %%xmm0, %%xmm5 \n\t" \
+                chi \
+                yhi \
+                "por           %%xmm5, %%xmm4 \n\t" \
+                "pand          %%xmm2, %%xmm3 \n\t" \
+                "pandn         %%xmm4, %%xmm2 \n\t" \
+                "por           %%xmm3, %%xmm2 \n\t" \
+                "movdqu        %%xmm2, (%1,%0,2)\n\t" \
+                "2:                           \n\t" \
+                "add               $8, %0     \n\t" \
+                "jl 1b                        \n\t" \
+                : "+&r"(i) \
+                : "r"(dstbase + 2 * w8), "r"(srca + w8), "r"(src + w8) \
+                : "%eax", "memory", "xmm0", "xmm1", "xmm2", "xmm3", \
+                                    "xmm4", "xmm5", "xmm6", "xmm7"); \
+        } \
+        for (x = w8; x < w; x++) \
+            if (srca[x]) { \
+                dstbase[2*x+YPOS] = ((dstbase[2*x+YPOS] * srca[x]) >> 8) + src[x]; \
+                dstbase[2*x+1-YPOS] = ((((signed)dstbase[2*x+1-YPOS] - 128) * srca[x]) >> 8) + 128; \
+            } \
+        src     += srcstride; \
+        srca    += srcstride; \
+        dstbase += dststride; \
+    } \
+}
+
+// YUY2: luma in the low byte of each word
+#define YPOS 0
+PACKED_YUV_SSE2(vo_draw_alpha_yuy2_SSE2,
+                "pand          %%xmm6, %%xmm4 \n\t",
+                "",
+                "psrlw             $8, %%xmm5 \n\t",
+                "psllw             $8, %%xmm5 \n\t")
+#undef YPOS
+// UYVY: luma in the high byte of each word
+#define YPOS 1
+PACKED_YUV_SSE2(vo_draw_alpha_uyvy_SSE2,
+                "psrlw             $8, %%xmm4 \n\t",
+                "psllw             $8, %%xmm4 \n\t",
+                "pand          %%xmm6, %%xmm5 \n\t",
+                "pand          %%xmm6, %%xmm5 \n\t")
+#undef YPOS
+#undef PACKED_YUV_SSE2
+
+static const uint32_t mask32_alpha[4] __attribute__((aligned(16))) =
+    { 0xFF000000, 0xFF000000, 0xFF000000, 0xFF000000 };
+
+static void vo_draw_alpha_rgb32_SSE2(int w, int h, unsigned char *src, unsigned char *srca,
+                                     int srcstride, unsigned char *dstbase, int dststride)
+{
+    int y;
+    int w4 = w & ~3;
+    for (y = 0; y < h; y++) {
+        int x;
+        if (w4) {
+            intptr_t i = -w4;
+            __asm__ volatile(
+                "pxor          %%xmm7, %%xmm7 \n\t"
+                "movdqa            %4, %%xmm6 \n\t" // byte 3 is left alone
+                "1:                           \n\t"
+                "movd       (%2,%0), %%xmm1   \n\t" // srca
+                "punpcklbw     %%xmm1, %%xmm1 \n\t"
+                "punpcklwd     %%xmm1, %%xmm1 \n\t" // srca AAAABBBBCCCCDDDD
+                "movdqa        %%xmm1, %%xmm2 \n\t"
+                "pcmpeqb       %%xmm7, %%xmm2 \n\t" // transparent pixels
+                "pmovmskb      %%xmm2, %%eax  \n\t"
+                "cmpl         $0xFFFF, %%eax  \n\t"
+                "je 2f                        \n\t"
+                "por           %%xmm6, %%xmm2 \n\t"
+                "movdqu   (%1,%0,4), %%xmm3   \n\t" // dst
+                "movdqa        %%xmm3, %%xmm4 \n\t"
+                "movdqa        %%xmm3, %%xmm5 \n\t"
+                "punpcklbw     %%xmm7, %%xmm4 \n\t"
+                "punpckhbw     %%xmm7, %%xmm5 \n\t"
+                "movdqa        %%xmm1, %%xmm0 \n\t"
+                "punpcklbw     %%xmm7, %%xmm1 \n\t"
+                "punpckhbw     %%xmm7, %%xmm0 \n\t"
+                "pmullw        %%xmm1, %%xmm4 \n\t"
+                "pmullw        %%xmm0, %%xmm5 \n\t"
+                "psrlw             $8, %%xmm4 \n\t"
+                "psrlw             $8, %%xmm5 \n\t"
+                "packuswb      %%xmm5, %%xmm4 \n\t"
+                "movd       (%3,%0), %%xmm0   \n\t" // src
+                "punpcklbw     %%xmm0, %%xmm0 \n\t"
+                "punpcklwd     %%xmm0, %%xmm0 \n\t"
+                "paddb         %%xmm0, %%xmm4 \n\t"
+                "pand          %%xmm2, %%xmm3 \n\t"
+                "pandn         %%xmm4, %%xmm2 \n\t"
+                "por           %%xmm3, %%xmm2 \n\t"
+                "movdqu        %%xmm2, (%1,%0,4)\n\t"
+                "2:                           \n\t"
+                "add               $4, %0     \n\t"
+                "jl 1b                        \n\t"
+                : "+&r"(i)
+                : "r"(dstbase + 4 * w4), "r"(srca + w4), "r"(src + w4),
+                  "m"(*mask32_alpha)
+                : "%eax", "memory", "xmm0", "xmm1", "xmm2", "xmm3",
+                                    "xmm4", "xmm5", "xmm6", "xmm7");
+        }
+        for (x = w4; x < w; x++)
+            if (srca[x]) {
+                dstbase[4*x+0] = ((dstbase[4*x+0] * srca[x]) >> 8) + src[x];
+                dstbase[4*x+1] = ((dstbase[4*x+1] * srca[x]) >> 8) + src[x];
+                dstbase[4*x+2] = ((dstbase[4*x+2] * srca[x]) >> 8) + src[x];
+            }
+        src     += srcstride;
+        srca    += srcstride;
+        dstbase += dststride;
+    }
+}
+#endif /* HAVE_SSE2 && !FAST_OSD */
+
 void vo_draw_alpha_yv12(int w,int h, unsigned char* src, unsigned char *srca, int srcstride, unsigned char* dstbase,int dststride){
+#if HAVE_SSE2 && !defined(FAST_OSD)
+	if(gCpuCaps.hasSSE2){
+		vo_draw_alpha_yv12_SSE2(w, h, src, srca, srcstride, dstbase, dststride);
+		return;
+	}
+#endif
 #if CONFIG_RUNTIME_CPUDETECT
 #if ARCH_X86
 	// ordered by speed / fastest first
@@ -164,6 +382,12 @@ void vo_draw_alpha_yv12(int w,int h, unsigned char* src, unsigned char *srca, in
 }
 
 void vo_draw_alpha_yuy2(int w,int h, unsigned char* src, unsigned char *srca, int srcstride, unsigned char* dstbase,int dststride){
+#if HAVE_SSE2 && !defined(FAST_OSD)
+	if(gCpuCaps.hasSSE2){
+		vo_draw_alpha_yuy2_SSE2(w, h, src, srca, srcstride, dstbase, dststride);
+		return;
+	}
+#endif
 #if CONFIG_RUNTIME_CPUDETECT
 #if ARCH_X86
 	// ordered by speed / fastest first
@@ -194,6 +418,12 @@ void vo_draw_alpha_yuy2(int w,int h, unsigned char* src, unsigned char *srca, in
 }
 
 void vo_draw_alpha_uyvy(int w,int h, unsigned char* src, unsigned char *srca, int srcstride, unsigned char* dstbase,int dststride){
+#if HAVE_SSE2 && !defined(FAST_OSD)
+	if(gCpuCaps.hasSSE2){
+		vo_draw_alpha_uyvy_SSE2(w, h, src, srca, srcstride, dstbase, dststride);
+		return;
+	}
+#endif
 #if CONFIG_RUNTIME_CPUDETECT
 #if ARCH_X86
 	// ordered by speed / fastest first
@@ -254,6 +484,12 @@ void vo_draw_alpha_rgb24(int w,int h, unsigned char* src, unsigned char *srca, i
 }
 
 void vo_draw_alpha_rgb32(int w,int h, unsigned char* src, unsigned char *srca, int srcstride, unsigned char* dstbase,int dststride){
+#if HAVE_SSE2 && !defined(FAST_OSD)
+	if(gCpuCaps.hasSSE2){
+		vo_draw_alpha_rgb32_SSE2(w, h, src, srca, srcstride, dstbase, dststride);
+		return;
+	}
+#endif
 #if CONFIG_RUNTIME_CPUDETECT
 #if ARCH_X86
 	// ordered by speed / fastest first
@@ -301,6 +537,11 @@ void vo_draw_alpha_init(void){
 //FIXME the optimized stuff is a lie for 15/16bpp as they aren't optimized yet
 	if( mp_msg_test(MSGT_OSD,MSGL_V) )
 	{
+#if HAVE_SSE2 && !defined(FAST_OSD)
+		if(gCpuCaps.hasSSE2)
+			mp_msg(MSGT_OSD,MSGL_INFO,"Using SSE2 Optimized OnScreenDisplay\n");
+		else
+#endif
 #if CONFIG_RUNTIME_CPUDETECT
 #if ARCH_X86
 		// ordered per speed fasterst first
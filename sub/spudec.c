@@ -44,6 +44,7 @@
 #include "libavutil/avutil.h"
 #include "libavutil/intreadwrite.h"
 #include "libswscale/swscale.h"
+#include "cpudetect.h"
 
 /* Valid values for spu_aamode:
    0: none (fastest, most ugly)
@@ -83,6 +84,30 @@ struct palette_crop_cache {
   int result;
 };
 
+/* Identifies the contents of image/aimage: the decoded packet and the
+   palette and crop applied to it */
+struct spu_image_key {
+  unsigned int serial;
+  uint32_t palette;
+  int sx, sy, ex, ey;
+};
+
+/* A scaled image together with everything it was made from, so going back
+   to a previous highlight or display size does not scale again */
+#define SCALED_CACHE_SIZE 4
+struct scaled_cache_entry {
+  struct spu_image_key key;
+  unsigned int frame_width, frame_height;
+  int aamode;
+  float gaussvar;
+  unsigned int start_col, start_row;
+  unsigned int width, height, stride;
+  size_t image_size;
+  unsigned char *image;
+  unsigned char *aimage;
+  unsigned int last_used;
+};
+
 typedef struct {
   packet_t *queue_head;
   packet_t *queue_tail;
@@ -111,9 +136,13 @@ typedef struct {
   unsigned int scaled_frame_width, scaled_frame_height;
   unsigned int scaled_start_col, scaled_start_row;
   unsigned int scaled_width, scaled_height, scaled_stride;
-  size_t scaled_image_size;
-  unsigned char *scaled_image;
+  unsigned char *scaled_image;	/* owned by one of scaled_cache */
   unsigned char *scaled_aimage;
+  struct scaled_cache_entry scaled_cache[SCALED_CACHE_SIZE];
+  unsigned int scaled_cache_clock;
+  unsigned int serial;		/* last serial handed out to an image */
+  unsigned int pal_serial;	/* serial of the current pal_image */
+  struct spu_image_key image_key;
   int auto_palette; /* 1 if we lack a palette and must use an heuristic. */
   int font_start_level;  /* Darkest value used for the computed font */
   const vo_functions_t *hw_spu;
@@ -265,6 +294,69 @@ static void pal2gray_alpha(const uint16_t *pal,
   }
 }
 
+#if HAVE_SSE2
+#define PAL_SELECT(n) \
+        "movdqu  "#n"*16(%4), %%xmm3  \n\t" \
+        "pcmpeqb       %%xmm0, %%xmm3 \n\t" \
+        "movdqu  "#n"*16+64(%4), %%xmm4 \n\t" \
+        "movdqu  "#n"*16+128(%4), %%xmm5 \n\t" \
+        "pand          %%xmm3, %%xmm4 \n\t" \
+        "pand          %%xmm3, %%xmm5 \n\t" \
+        "por           %%xmm4, %%xmm1 \n\t" \
+        "por           %%xmm5, %%xmm2 \n\t"
+
+/**
+ * pal2gray_alpha for the 4 entry palette of DVD subtitles, 16 pixels at
+ * a time. Each entry is selected with a compare.
+ */
+static void pal2gray_alpha_SSE2(const uint16_t *pal,
+                                const uint8_t *src, int src_stride,
+                                uint8_t *dst, uint8_t *dsta,
+                                int dst_stride, int w, int h)
+{
+  uint8_t tab[12][16]; /* index, gray and alpha of each entry */
+  int w16 = w & ~15;
+  int i, x, y;
+  for (i = 0; i < 4; i++) {
+    memset(tab[i],     i,          16);
+    memset(tab[i + 4], pal[i],      16);
+    memset(tab[i + 8], pal[i] >> 8, 16);
+  }
+  for (y = 0; y < h; y++) {
+    if (w16) {
+      intptr_t j = -w16;
+      __asm__ volatile(
+        "1:                           \n\t"
+        "movdqu     (%1,%0), %%xmm0   \n\t"
+        "pxor          %%xmm1, %%xmm1 \n\t"
+        "pxor          %%xmm2, %%xmm2 \n\t"
+        PAL_SELECT(0)
+        PAL_SELECT(1)
+        PAL_SELECT(2)
+        PAL_SELECT(3)
+        "movdqu        %%xmm1, (%2,%0)\n\t"
+        "movdqu        %%xmm2, (%3,%0)\n\t"
+        "add              $16, %0     \n\t"
+        "jl 1b                        \n\t"
+        : "+&r"(j)
+        : "r"(src + w16), "r"(dst + w16), "r"(dsta + w16), "r"(tab)
+        : "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5");
+    }
+    for (x = w16; x < w; x++) {
+      uint16_t pixel = pal[src[x] & 3];
+      dst[x]  = pixel;
+      dsta[x] = pixel >> 8;
+    }
+    for (; x < dst_stride; x++)
+      dsta[x] = dst[x] = 0;
+    src  += src_stride;
+    dst  += dst_stride;
+    dsta += dst_stride;
+  }
+}
+#undef PAL_SELECT
+#endif
+
 static int apply_palette_crop(spudec_handle_t *this,
                               unsigned crop_x, unsigned crop_y,
                               unsigned crop_w, unsigned crop_h)
@@ -300,6 +392,13 @@ static int apply_palette_crop(spudec_handle_t *this,
     pal[i] = (-alpha << 8) | color;
   }
   src = this->pal_image + crop_y * this->pal_width + crop_x;
+#if HAVE_SSE2
+  if (gCpuCaps.hasSSE2)
+    pal2gray_alpha_SSE2(pal, src, this->pal_width,
+                        this->image, this->aimage, stride,
+                        crop_w, crop_h);
+  else
+#endif
   pal2gray_alpha(pal, src, this->pal_width,
                  this->image, this->aimage, stride,
                  crop_w, crop_h);
@@ -311,6 +410,15 @@ static int apply_palette_crop(spudec_handle_t *this,
   spudec_cut_image(this);
 
 out:
+  memset(&this->image_key, 0, sizeof(this->image_key));
+  this->image_key.serial = this->pal_serial;
+  for (i = 0; i < 4; i++)
+    this->image_key.palette |= (this->palette[i] << (28 - 4 * i)) |
+                               (this->alpha[i]   << (12 - 4 * i));
+  this->image_key.sx = crop_x;
+  this->image_key.sy = crop_y;
+  this->image_key.ex = crop_x + crop_w;
+  this->image_key.ey = crop_y + crop_h;
   // reset scaled image
   this->scaled_frame_width = 0;
   this->scaled_frame_height = 0;
@@ -357,6 +465,7 @@ static void spudec_process_data(spudec_handle_t *this, packet_t *packet)
   this->pal_start_row = packet->start_row;
   this->pal_height = packet->height;
   this->pal_width  = packet->width;
+  this->pal_serial = ++this->serial;
   this->stride = packet->stride;
   memcpy(this->palette, packet->palette, sizeof(this->palette));
   memcpy(this->alpha,   packet->alpha,   sizeof(this->alpha));
@@ -706,6 +815,8 @@ void spudec_heartbeat(void *this, unsigned int pts100)
       spu->stride     = packet->stride;
       spu->start_col  = packet->start_col;
       spu->start_row  = packet->start_row;
+      memset(&spu->image_key, 0, sizeof(spu->image_key));
+      spu->image_key.serial = ++spu->serial;
 
       // reset scaled image
       spu->scaled_frame_width = 0;
@@ -832,6 +943,12 @@ static void scale_image(int x, int y, scale_pixel* table_x, scale_pixel* table_y
   unsigned int scale[4];
   int base = table_y[y].position * spu->stride + table_x[x].position;
   int scaled = y * spu->scaled_stride + x;
+  // most of a subtitle is transparent, the result is 0 there
+  if (!(spu->aimage[base] | spu->aimage[base + 1] |
+        spu->aimage[base + spu->stride] | spu->aimage[base + spu->stride + 1])) {
+    spu->scaled_image[scaled] = spu->scaled_aimage[scaled] = 0;
+    return;
+  }
   alpha[0] = canon_alpha(spu->aimage[base]);
   alpha[1] = canon_alpha(spu->aimage[base + 1]);
   alpha[2] = canon_alpha(spu->aimage[base + spu->stride]);
@@ -883,9 +1000,55 @@ static void sws_spu_image(unsigned char *d1, unsigned char *d2, int dw, int dh,
 	sws_freeContext(ctx);
 }
 
+/* Make the scaled image for the current image and display size current,
+   if it is in the cache */
+static int scaled_cache_find(spudec_handle_t *spu, unsigned int dxs, unsigned int dys)
+{
+  int i;
+  for (i = 0; i < SCALED_CACHE_SIZE; i++) {
+    struct scaled_cache_entry *e = spu->scaled_cache + i;
+    if (e->last_used && e->frame_width == dxs && e->frame_height == dys &&
+        e->aamode == spu_aamode && e->gaussvar == spu_gaussvar &&
+        !memcmp(&e->key, &spu->image_key, sizeof(e->key))) {
+      spu->scaled_start_col = e->start_col;
+      spu->scaled_start_row = e->start_row;
+      spu->scaled_width  = e->width;
+      spu->scaled_height = e->height;
+      spu->scaled_stride = e->stride;
+      spu->scaled_image  = e->image;
+      spu->scaled_aimage = e->aimage;
+      spu->scaled_frame_width  = dxs;
+      spu->scaled_frame_height = dys;
+      e->last_used = ++spu->scaled_cache_clock;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Take the least recently used entry to scale into, its image and aimage
+   buffers hold at least size bytes each */
+static struct scaled_cache_entry *scaled_cache_new(spudec_handle_t *spu, size_t size)
+{
+  struct scaled_cache_entry *e = spu->scaled_cache;
+  int i;
+  for (i = 1; i < SCALED_CACHE_SIZE; i++)
+    if (spu->scaled_cache[i].last_used < e->last_used)
+      e = spu->scaled_cache + i;
+  e->last_used = 0;
+  if (e->image_size < size) {
+    free(e->image);
+    e->image = malloc(2 * size);
+    e->image_size = e->image ? size : 0;
+  }
+  e->aimage = e->image + e->image_size;
+  return e;
+}
+
 void spudec_draw_scaled(void *me, unsigned int dxs, unsigned int dys, void (*draw_alpha)(int x0,int y0, int w,int h, unsigned char* src, unsigned char *srca, int stride))
 {
   spudec_handle_t *spu = me;
+  struct scaled_cache_entry *e;
   scale_pixel *table_x;
   scale_pixel *table_y;
 
@@ -901,7 +1064,8 @@ void spudec_draw_scaled(void *me, unsigned int dxs, unsigned int dys, void (*dra
       spudec_draw(spu, draw_alpha);
     }
     else {
-      if (spu->scaled_frame_width != dxs || spu->scaled_frame_height != dys) {	/* Resizing is needed */
+      if ((spu->scaled_frame_width != dxs || spu->scaled_frame_height != dys) &&
+	  !scaled_cache_find(spu, dxs, dys)) {	/* Resizing is needed */
 	/* scaled_x = scalex * x / 0x100
 	   scaled_y = scaley * y / 0x100
 	   order of operations is important because of rounding. */
@@ -913,23 +1077,15 @@ void spudec_draw_scaled(void *me, unsigned int dxs, unsigned int dys, void (*dra
 	spu->scaled_height = spu->height * scaley / 0x100;
 	/* Kludge: draw_alpha needs width multiple of 8 */
 	spu->scaled_stride = (spu->scaled_width + 7) & ~7;
-	if (spu->scaled_image_size < spu->scaled_stride * spu->scaled_height) {
-	  if (spu->scaled_image) {
-	    free(spu->scaled_image);
-	    spu->scaled_image_size = 0;
-	  }
-	  spu->scaled_image = malloc(2 * spu->scaled_stride * spu->scaled_height);
-	  if (spu->scaled_image) {
-	    spu->scaled_image_size = spu->scaled_stride * spu->scaled_height;
-	    spu->scaled_aimage = spu->scaled_image + spu->scaled_image_size;
-	  }
-	}
+	e = scaled_cache_new(spu, spu->scaled_stride * spu->scaled_height);
+	spu->scaled_image  = e->image;
+	spu->scaled_aimage = e->aimage;
 	if (spu->scaled_image) {
 	  unsigned int x, y;
 	  // needs to be 0-initialized because draw_alpha draws always a
 	  // multiple of 8 pixels. TODO: optimize
 	  if (spu->scaled_width & 7)
-	    memset(spu->scaled_image, 0, 2 * spu->scaled_image_size);
+	    memset(spu->scaled_image, 0, 2 * e->image_size);
 	  if (spu->scaled_width <= 1 || spu->scaled_height <= 1) {
 	    goto nothing_to_do;
 	  }
@@ -1182,6 +1338,17 @@ nothing_to_do:
 	    }
 	  spu->scaled_frame_width = dxs;
 	  spu->scaled_frame_height = dys;
+	  e->key = spu->image_key;
+	  e->frame_width  = dxs;
+	  e->frame_height = dys;
+	  e->aamode   = spu_aamode;
+	  e->gaussvar = spu_gaussvar;
+	  e->start_col = spu->scaled_start_col;
+	  e->start_row = spu->scaled_start_row;
+	  e->width  = spu->scaled_width;
+	  e->height = spu->scaled_height;
+	  e->stride = spu->scaled_stride;
+	  e->last_used = ++spu->scaled_cache_clock;
 	}
       }
       if (spu->scaled_image){
@@ -1218,6 +1385,8 @@ void spudec_update_palette(void * this, unsigned int *palette)
   spudec_handle_t *spu = this;
   if (spu && palette) {
     memcpy(spu->global_palette, palette, sizeof(spu->global_palette));
+    // images made with the old palette must not be found in the cache
+    spu->pal_serial = ++spu->serial;
     if(spu->hw_spu)
       spu->hw_spu->control(VOCTRL_SET_SPU_PALETTE,spu->global_palette);
   }
@@ -1320,12 +1489,14 @@ void *spudec_new(unsigned int *palette)
 void spudec_free(void *this)
 {
   spudec_handle_t *spu = this;
+  int i;
   if (spu) {
     while (spu->queue_head)
       spudec_free_packet(spudec_dequeue_packet(spu));
     free(spu->packet);
     spu->packet = NULL;
-    free(spu->scaled_image);
+    for (i = 0; i < SCALED_CACHE_SIZE; i++)
+      free(spu->scaled_cache[i].image);
     spu->scaled_image = NULL;
     free(spu->image);
     spu->image = NULL;
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "config.h"
 #if HAVE_MALLOC_H
@@ -84,6 +85,8 @@ char * sub_osd_names_short[] ={ "", "|>", "||", "[]", "<<" , ">>", "", "", "", "
 //static int vo_font_loaded=-1;
 font_desc_t* vo_font=NULL;
 font_desc_t* sub_font=NULL;
+unsigned font_desc_serial=0;
+void (*vo_font_loader)(void)=NULL;
 
 unsigned char* vo_osd_text=NULL;
 void* vo_osd_teletext_page=NULL;
@@ -164,6 +167,106 @@ static void alloc_buf(mp_osd_obj_t* obj)
     memset(obj->alpha_buffer, sub_bg_alpha, len);
 }
 
+// glyphs of the text being laid out, see draw_layout()
+static mp_osd_glyph_t *layout;
+static int layout_len, layout_max;
+
+static void layout_add(int c, int x)
+{
+    if (layout_len >= layout_max) {
+	mp_osd_glyph_t *l = realloc(layout, (layout_max + 64) * sizeof(*l));
+	if (!l)
+	    return;
+	layout = l;
+	layout_max += 64;
+    }
+    layout[layout_len].c = c;
+    layout[layout_len].x = x;
+    layout_len++;
+}
+
+static void draw_glyph(mp_osd_obj_t *obj, font_desc_t *desc, int c, int x, int y)
+{
+    int font = desc->font[c];
+    if (font >= 0)
+	draw_alpha_buf(obj, x, y,
+		       desc->width[c],
+		       desc->pic_a[font]->h,
+		       desc->pic_b[font]->bmp+desc->start[c],
+		       desc->pic_a[font]->bmp+desc->start[c],
+		       desc->pic_a[font]->w);
+}
+
+// extends [*x1,*x2) by the columns covered by the glyph
+static void glyph_extent(font_desc_t *desc, mp_osd_glyph_t *g, int *x1, int *x2)
+{
+    if (desc->font[g->c] < 0)
+	return;
+    if (*x1 > g->x) *x1 = g->x;
+    if (*x2 < g->x + desc->width[g->c]) *x2 = g->x + desc->width[g->c];
+}
+
+// Draws the glyphs in layout on one line at y, the bbox must be set.
+// If the buffers still hold glyphs of the same font, bbox and background,
+// only the columns covered by glyphs that changed are cleared and redrawn.
+// Glyphs overlap, but drawing one again over itself does not change the
+// result, so everything touching these columns is simply drawn again.
+static void draw_layout(mp_osd_obj_t *obj, font_desc_t *desc, int y)
+{
+    mp_osd_glyph_t *old = obj->glyphs;
+    int bg = sub_bg_color << 8 | sub_bg_alpha;
+    int n = layout_len, n_old = obj->n_glyphs;
+    int head = 0, tail = 0, x1 = INT_MAX, x2 = INT_MIN;
+    int i, j;
+
+    if (obj->allocated <= 0 || obj->glyphs_font != desc->serial ||
+	obj->glyphs_bg != bg ||
+	memcmp(&obj->glyphs_bbox, &obj->bbox, sizeof(obj->bbox))) {
+	alloc_buf(obj);
+	for (i = 0; i < n; i++)
+	    draw_glyph(obj, desc, layout[i].c, layout[i].x, y);
+    } else {
+	while (head < n && head < n_old &&
+	       layout[head].c == old[head].c && layout[head].x == old[head].x)
+	    head++;
+	while (tail < n - head && tail < n_old - head &&
+	       layout[n-1-tail].c == old[n_old-1-tail].c &&
+	       layout[n-1-tail].x == old[n_old-1-tail].x)
+	    tail++;
+	for (i = head; i < n - tail; i++)
+	    glyph_extent(desc, layout + i, &x1, &x2);
+	for (i = head; i < n_old - tail; i++)
+	    glyph_extent(desc, old + i, &x1, &x2);
+	x1 = FFMAX(x1, obj->bbox.x1);
+	x2 = FFMIN(x2, obj->bbox.x2);
+	if (x1 < x2) {
+	    int off = x1 - obj->bbox.x1;
+	    for (j = 0; j < obj->bbox.y2 - obj->bbox.y1; j++) {
+		memset(obj->bitmap_buffer + j*obj->stride + off, sub_bg_color, x2 - x1);
+		memset(obj->alpha_buffer  + j*obj->stride + off, sub_bg_alpha, x2 - x1);
+	    }
+	    for (i = 0; i < n; i++) {
+		int c = layout[i].c;
+		if (desc->font[c] >= 0 &&
+		    layout[i].x < x2 && layout[i].x + desc->width[c] > x1)
+		    draw_glyph(obj, desc, c, layout[i].x, y);
+	    }
+	}
+    }
+
+    // keep the layout, the old array becomes the next one to fill
+    obj->glyphs = layout;
+    obj->n_glyphs = n;
+    i = obj->max_glyphs;
+    obj->max_glyphs = layout_max;
+    layout = old;
+    layout_len = 0;
+    layout_max = i;
+    obj->glyphs_font = desc->serial;
+    obj->glyphs_bg = bg;
+    obj->glyphs_bbox = obj->bbox;
+}
+
 // renders the buffer
 static inline void vo_draw_text_from_buffer(mp_osd_obj_t* obj,
                                             void (*draw_alpha)(int x0, int y0,
@@ -201,14 +304,15 @@ static inline void vo_update_text_osd(mp_osd_obj_t *obj, int dxs, int dys)
 	const char *cp=vo_osd_text;
 	int x=20;
 	int h=0;
-	int font;
 
+        layout_len=0;
         obj->bbox.x1=obj->x=x;
         obj->bbox.y1=obj->y=10;
 
         while (*cp){
           uint16_t c=utf8_get_char(&cp);
 	  render_one_glyph(vo_font, c);
+	  layout_add(c, x);
 	  x+=vo_font->width[c]+vo_font->charspace;
 	  h=get_height(c,h);
         }
@@ -217,21 +321,7 @@ static inline void vo_update_text_osd(mp_osd_obj_t *obj, int dxs, int dys)
 	obj->bbox.y2=obj->bbox.y1+h;
 	obj->flags|=OSDFLAG_BBOX;
 
-	alloc_buf(obj);
-
-	cp=vo_osd_text;
-	x = obj->x;
-        while (*cp){
-          uint16_t c=utf8_get_char(&cp);
-          if ((font=vo_font->font[c])>=0)
-            draw_alpha_buf(obj,x,obj->y,
-			   vo_font->width[c],
-			   vo_font->pic_a[font]->h,
-			   vo_font->pic_b[font]->bmp+vo_font->start[c],
-			   vo_font->pic_a[font]->bmp+vo_font->start[c],
-			   vo_font->pic_a[font]->w);
-          x+=vo_font->width[c]+vo_font->charspace;
-        }
+	draw_layout(obj, vo_font, obj->y);
 }
 
 #ifdef CONFIG_DVDNAV
@@ -583,23 +673,24 @@ static inline void vo_update_text_progbar(mp_osd_obj_t *obj, int dxs, int dys)
 	obj->bbox.x1-=delta; // space for an icon
     }
 
-    alloc_buf(obj);
-
+    layout_len=0;
     {
 	int minw = vo_font->width[OSD_PB_START]+vo_font->width[OSD_PB_END]+vo_font->width[OSD_PB_0];
 	if (vo_osd_progbar_type>0 && vo_font->font[vo_osd_progbar_type]>=0){
 	    minw += vo_font->width[vo_osd_progbar_type]+vo_font->charspace+vo_font->spacewidth;
 	}
-	if (obj->bbox.x2 - obj->bbox.x1 < minw) return; // space too small, don't render anything
+	if (obj->bbox.x2 - obj->bbox.x1 < minw) { // space too small, don't render anything
+	    draw_layout(obj, vo_font, obj->y);
+	    return;
+	}
     }
 
-    // render it:
-    {	unsigned char *s;
-   	unsigned char *sa;
-        int i,w,h,st,mark;
+    // lay it out, only the elements that changed since the last update
+    // are drawn again
+    {
+        int i,mark;
    	int x=obj->x;
-        int y=obj->y;
-        int c,font;
+        int c;
    	int charw=vo_font->width[OSD_PB_0]+vo_font->charspace;
         int elems=obj->params.progbar.elems;
 
@@ -616,62 +707,32 @@ static inline void vo_update_text_progbar(mp_osd_obj_t *obj, int dxs, int dys)
 //        printf("osd.progbar  width=%d  xpos=%d\n",width,x);
 
         c=vo_osd_progbar_type;
-        if(vo_osd_progbar_type>0 && (font=vo_font->font[c])>=0) {
+        if(vo_osd_progbar_type>0 && vo_font->font[c]>=0) {
 	    int xp=x-vo_font->width[c]-vo_font->spacewidth;
-	   draw_alpha_buf(obj,(xp<0?0:xp),y,
-              vo_font->width[c],
-              vo_font->pic_a[font]->h,
-              vo_font->pic_b[font]->bmp+vo_font->start[c],
-              vo_font->pic_a[font]->bmp+vo_font->start[c],
-              vo_font->pic_a[font]->w);
+	    layout_add(c, xp<0?0:xp);
 	}
 
         c=OSD_PB_START;
-        if ((font=vo_font->font[c])>=0)
-            draw_alpha_buf(obj,x,y,
-              vo_font->width[c],
-              vo_font->pic_a[font]->h,
-              vo_font->pic_b[font]->bmp+vo_font->start[c],
-              vo_font->pic_a[font]->bmp+vo_font->start[c],
-              vo_font->pic_a[font]->w);
+        layout_add(c, x);
         x+=vo_font->width[c]+vo_font->charspace;
 
    	c=OSD_PB_0;
-   	if ((font=vo_font->font[c])>=0){
-	   w=vo_font->width[c];
-	   h=vo_font->pic_a[font]->h;
-	   s=vo_font->pic_b[font]->bmp+vo_font->start[c];
-	   sa=vo_font->pic_a[font]->bmp+vo_font->start[c];
-	   st=vo_font->pic_a[font]->w;
-	   if ((i=mark)) do {
-	       draw_alpha_buf(obj,x,y,w,h,s,sa,st);
+   	if (vo_font->font[c]>=0)
+	   for (i=0; i<mark; i++) {
+	       layout_add(c, x);
 	       x+=charw;
-	   } while(--i);
-	}
+	   }
 
    	c=OSD_PB_1;
-	if ((font=vo_font->font[c])>=0){
-	   w=vo_font->width[c];
-	   h=vo_font->pic_a[font]->h;
-	   s =vo_font->pic_b[font]->bmp+vo_font->start[c];
-	   sa=vo_font->pic_a[font]->bmp+vo_font->start[c];
-	   st=vo_font->pic_a[font]->w;
-	   if ((i=elems-mark)) do {
-	       draw_alpha_buf(obj,x,y,w,h,s,sa,st);
+	if (vo_font->font[c]>=0)
+	   for (i=mark; i<elems; i++) {
+	       layout_add(c, x);
 	       x+=charw;
-	   } while(--i);
-	}
+	   }
 
-        c=OSD_PB_END;
-        if ((font=vo_font->font[c])>=0)
-            draw_alpha_buf(obj,x,y,
-              vo_font->width[c],
-              vo_font->pic_a[font]->h,
-              vo_font->pic_b[font]->bmp+vo_font->start[c],
-              vo_font->pic_a[font]->bmp+vo_font->start[c],
-              vo_font->pic_a[font]->w);
-//        x+=vo_font->width[c]+vo_font->charspace;
+        layout_add(OSD_PB_END, x);
 
+	draw_layout(obj, vo_font, obj->y);
     }
 //        vo_osd_progbar_value=(vo_osd_progbar_value+1)&0xFF;
 
@@ -1098,6 +1159,7 @@ void free_osd_list(void){
 	mp_osd_obj_t* next=obj->next;
 	free(obj->alpha_buffer);
 	free(obj->bitmap_buffer);
+	free(obj->glyphs);
 	free(obj);
 	obj=next;
     }
@@ -1116,6 +1178,12 @@ static int vo_update_osd_ext(int dxs,int dys, int left_border, int top_border,
     static int defer_counter = 0, prev_dxs = 0, prev_dys = 0;
 #endif
 
+    // only load deferred fonts once there is text to draw
+    if (vo_font_loader &&
+        ((vo_osd_text && vo_osd_text[0]) || vo_sub ||
+         vo_osd_progbar_type >= 0 || vo_osd_teletext_page))
+        vo_load_deferred_fonts();
+
 #ifdef CONFIG_FREETYPE
     // here is the right place to get screen dimensions
     if (((dxs != vo_image_width)
@@ -1226,6 +1294,14 @@ static int vo_update_osd_ext(int dxs,int dys, int left_border, int top_border,
     return chg;
 }
 
+void vo_load_deferred_fonts(void) {
+    void (*loader)(void) = vo_font_loader;
+    if (loader) {
+        vo_font_loader = NULL;
+        loader();
+    }
+}
+
 int vo_update_osd(int dxs, int dys) {
     return vo_update_osd_ext(dxs, dys, 0, 0, 0, 0, dxs, dys);
 }
@@ -39,6 +39,11 @@ typedef struct mp_osd_bbox_s {
 #define MAX_UCS 1600
 #define MAX_UCSLINES 16
 
+typedef struct mp_osd_glyph_s {
+    int c;
+    int x;
+} mp_osd_glyph_t;
+
 typedef struct mp_osd_obj_s {
     struct mp_osd_obj_s* next;
     unsigned char type;
@@ -64,6 +69,14 @@ typedef struct mp_osd_obj_s {
     int allocated;
     unsigned char *alpha_buffer;
     unsigned char *bitmap_buffer;
+
+    // glyphs drawn into the buffers, so that an update only redraws
+    // the ones that changed
+    unsigned glyphs_font;	// serial of their font, 0 if none
+    int glyphs_bg;		// background they were drawn on
+    mp_osd_bbox_t glyphs_bbox;	// bbox the buffers were allocated for
+    int n_glyphs, max_glyphs;
+    mp_osd_glyph_t *glyphs;
 } mp_osd_obj_t;
 
 
@@ -132,6 +145,9 @@ void vo_draw_text_ext(int dxs, int dys, int left_border, int top_border,
 void vo_remove_text(int dxs,int dys,void (*remove)(int x0,int y0, int w,int h));
 
 void vo_init_osd(void);
+// If set it is called once the fonts are first needed, to load them late.
+extern void (*vo_font_loader)(void);
+void vo_load_deferred_fonts(void);
 int vo_update_osd(int dxs,int dys);
 int vo_osd_changed(int new_value);
 int vo_osd_check_range_update(int,int,int,int);
@@ -1232,8 +1232,82 @@ subtitle* subcp_recode (subtitle *sub)
 	}
 	return sub;
 }
+
+/**
+ * \brief Recode a whole buffer with the descriptor opened by subcp_open.
+ * \param buf buffer to recode, replaced by the recoded one on success
+ * \param len length of buf, updated on success
+ * \return 1 if the buffer was recoded, 0 otherwise
+ */
+static int subcp_recode_buffer(char **buf, int *len)
+{
+	size_t ileft = *len, oleft = 4 * (size_t)*len;
+	char *ip = *buf, *op, *ot;
+	if(icdsc == (iconv_t)(-1)) return 0;
+
+	if (!(ot = malloc(oleft + 1)))
+		return 0;
+	op = ot;
+	if (iconv(icdsc, &ip, &ileft, &op, &oleft) == (size_t)(-1) ||
+	    iconv(icdsc, NULL, NULL, &op, &oleft) == (size_t)(-1)) {
+		mp_msg(MSGT_SUBREADER,MSGL_V,"SUB: could not recode file at once, recoding line by line.\n");
+		iconv(icdsc, NULL, NULL, NULL, NULL);
+		free(ot);
+		return 0;
+	}
+	free(*buf);
+	*buf = ot;
+	*len = op - ot;
+	return 1;
+}
 #endif
 
+#define MAX_SUB_MEMORY_SIZE (64*1024*1024)
+/**
+ * \brief Read a subtitle file into memory for parsing.
+ * \param st stream positioned at the start of the file, freed on success
+ * \param recoded set to 1 if the contents were recoded to UTF-8 at once
+ * \return memory stream with the file contents, or st if it cannot be read
+ *
+ * Parsing from memory saves refilling the stream buffer for every few
+ * lines, and recoding the whole file at once saves calling iconv for
+ * every single line.
+ */
+static stream_t *sub_load_memory(stream_t *st, int recode, int *recoded)
+{
+    stream_t *mem;
+    char *buf;
+    int len, size = st->end_pos - st->start_pos;
+
+    *recoded = 0;
+    if (st->type == STREAMTYPE_MEMORY || size <= 0 || size > MAX_SUB_MEMORY_SIZE)
+        return st;
+    if (!(buf = malloc(size)))
+        return st;
+    len = stream_read(st, buf, size);
+    if (len != size) {
+        free(buf);
+        stream_reset(st);
+        stream_seek(st, 0);
+        return st;
+    }
+#ifdef CONFIG_ICONV
+    if (recode)
+        *recoded = subcp_recode_buffer(&buf, &len);
+#endif
+    mem = new_memory_stream((unsigned char *)buf, len);
+    free(buf);
+    if (!mem) {
+        *recoded = 0;
+        stream_reset(st);
+        stream_seek(st, 0);
+        return st;
+    }
+    free_stream(st);
+    return mem;
+}
+#undef MAX_SUB_MEMORY_SIZE
+
 #ifdef CONFIG_FRIBIDI
 /**
  * Helper function to share code between subreader and libmenu/menu.c
@@ -1431,10 +1505,10 @@ const char* guess_cp(stream_t *st, const char *preferred_language, const char *f
 sub_data* sub_read_file (const char *filename, float fps) {
     int utf16;
     stream_t* fd;
-    int n_max, n_first, i, j, sub_first, sub_orig;
+    int n_max, n_first, i, j, sub_first, sub_orig, second_max;
     subtitle *first, *second, *sub, *return_sub, *alloced_sub = NULL;
     sub_data *subt_data;
-    int uses_time = 0, sub_num = 0, sub_errs = 0;
+    int uses_time = 0, sub_num = 0, sub_errs = 0, recoded = 0;
     static const struct subreader sr[]=
     {
 	    { sub_read_line_microdvd, NULL, "microdvd" },
@@ -1488,6 +1562,8 @@ sub_data* sub_read_file (const char *filename, float fps) {
     }
 #endif
 
+    fd = sub_load_memory(fd, sub_utf8 == 2 && utf16 == 0, &recoded);
+
     sub_num=0;n_max=32;
     first=malloc(n_max*sizeof(subtitle));
     if(!first){
@@ -1507,7 +1583,7 @@ sub_data* sub_read_file (const char *filename, float fps) {
 #endif
     while(1){
         if(sub_num>=n_max){
-            n_max+=16;
+            n_max*=2;
             first=realloc(first,n_max*sizeof(subtitle));
         }
 #ifndef CONFIG_SORTSUB
@@ -1517,7 +1593,7 @@ sub_data* sub_read_file (const char *filename, float fps) {
         sub=srp->read(fd,sub,utf16);
         if(!sub) break;   // EOF
 #ifdef CONFIG_ICONV
-	if ((sub!=ERR) && sub_utf8 == 2 && utf16 == 0) sub=subcp_recode(sub);
+	if ((sub!=ERR) && sub_utf8 == 2 && utf16 == 0 && !recoded) sub=subcp_recode(sub);
 #endif
 #ifdef CONFIG_FRIBIDI
 	if (sub!=ERR) sub=sub_fribidi(sub,sub_utf8,0);
@@ -1604,6 +1680,7 @@ if ((suboverlap_enabled == 2) ||
     n_first = sub_num;
     sub_num = 0;
     second = NULL;
+    second_max = 0;
     // for each subtitle in first[] we deal with its 'block' of
     // bonded subtitles
     for (sub_first = 0; sub_first < n_first; ++sub_first) {
@@ -1739,7 +1816,10 @@ if ((suboverlap_enabled == 2) ||
 	    if (higher_line >= SUB_MAX_TEXT) {
 		// the 'block' has too much lines, so we don't overlap the
 		// subtitles
-		second = realloc(second, (sub_num + sub_to_add + 1) * sizeof(subtitle));
+		if (sub_num + sub_to_add + 1 > second_max) {
+		    second_max = 2 * (sub_num + sub_to_add + 1);
+		    second = realloc(second, second_max * sizeof(subtitle));
+		}
 		for (j = 0; j <= sub_to_add; ++j) {
 		    int ls;
 		    memset(&second[sub_num + j], '\0', sizeof(subtitle));
@@ -1759,7 +1839,10 @@ if ((suboverlap_enabled == 2) ||
 
 	    // we read the placeholder structure and create the new
 	    // subs.
-	    second = realloc(second, (sub_num + 1) * sizeof(subtitle));
+	    if (sub_num + 1 > second_max) {
+		second_max = 2 * (sub_num + 1);
+		second = realloc(second, second_max * sizeof(subtitle));
+	    }
 	    memset(&second[sub_num], '\0', sizeof(subtitle));
 	    second[sub_num].start = local_start;
 	    second[sub_num].end   = local_end;
@@ -1810,6 +1893,8 @@ if ((suboverlap_enabled == 2) ||
     subt_data->sub_num = sub_num;
     subt_data->sub_errs = sub_errs;
     subt_data->subtitles = return_sub;
+    subt_data->max_end = NULL;
+    subt_data->max_end_num = 0;
     return subt_data;
 }
 
@@ -2091,14 +2176,29 @@ static void append_dir_subtitles(struct sub_list *slist, const char *path,
 void load_subtitles(const char *fname, float fps, open_sub_func add_f)
 {
     int i;
-    char *mp_subdir, *path = NULL;
-    struct sub_list slist;
 
     // Load subtitles specified by sub option first
     if (sub_name)
         for (i = 0; sub_name[i]; i++)
             add_f(sub_name[i], fps, 0);
 
+    load_auto_subtitles(fname, fps, add_f);
+}
+
+/**
+ * @brief Load the subtitles found next to the file and in the sub paths
+ *
+ * @param fname Path to subtitle filename
+ * @param fps FPS parameter for the add subtitle function
+ * @param add_f Add subtitle function to call for each sub
+ * @note This is the automatic part of load_subtitles().
+ */
+void load_auto_subtitles(const char *fname, float fps, open_sub_func add_f)
+{
+    int i;
+    char *mp_subdir, *path = NULL;
+    struct sub_list slist;
+
     // Stop here if automatic detection disabled
     if (!sub_auto || !fname)
         return;
@@ -2485,6 +2585,7 @@ void sub_free( sub_data * subd )
             free( subd->subtitles[i].text[j] );
     free( subd->subtitles );
     free( subd->filename );
+    free( subd->max_end );
     free( subd );
 }
 
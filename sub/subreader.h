@@ -83,6 +83,8 @@ typedef struct {
     int sub_uses_time;
     int sub_num;          // number of subtitle structs
     int sub_errs;
+    unsigned long *max_end; // running maximum of the end times, see find_sub()
+    int max_end_num;        // sub_num when max_end was built
 } sub_data;
 
 extern char *fribidi_charset;
@@ -102,6 +104,7 @@ void subcp_close (void); /* for demux_ogg.c */
 const char* guess_buffer_cp(unsigned char* buffer, int buflen, const char *preferred_language, const char *fallback);
 const char* guess_cp(struct stream *st, const char *preferred_language, const char *fallback);
 void load_subtitles(const char *fname, float fps, open_sub_func add_f);
+void load_auto_subtitles(const char *fname, float fps, open_sub_func add_f);
 void load_vob_subtitle(const char *fname, const char * const spudec_ifo, void **spu, open_vob_func add_f);
 void list_sub_file(sub_data* subd);
 void dump_srt(sub_data* subd, float fps);
@@ -583,6 +583,9 @@ static int packet_queue_insert(packet_queue_t *queue)
  * Vobsub
  **********************************************************************/
 
+/* Number of packets kept in memory when reading packets on demand */
+#define VOBSUB_CACHE_SIZE 16
+
 typedef struct {
     unsigned int palette[16];
     int delay;
@@ -594,6 +597,12 @@ typedef struct {
     unsigned int spu_streams_size;
     unsigned int spu_streams_current;
     unsigned int spu_valid_streams_size;
+    /* .sub file when packets are read on demand, NULL if all packets
+       were read at open time */
+    mpeg_t *mpeg;
+    /* packets read on demand, the oldest one is dropped first */
+    packet_t *cache[VOBSUB_CACHE_SIZE];
+    unsigned int cache_pos;
 } vobsub_t;
 
 /* Make sure that the spu stream idx exists. */
@@ -665,6 +674,82 @@ static int vobsub_add_timestamp(vobsub_t *vob, off_t filepos, int ms)
     return -1;
 }
 
+/* Check if the index has timestamps to read the packets on demand. */
+static int vobsub_has_index(vobsub_t *vob)
+{
+    unsigned int i;
+    for (i = 0; i < vob->spu_streams_size; ++i)
+        if (vob->spu_streams[i].packets_size > 0)
+            return 1;
+    return 0;
+}
+
+static void vobsub_count_valid_streams(vobsub_t *vob)
+{
+    vob->spu_streams_current = vob->spu_streams_size;
+    while (vob->spu_streams_current-- > 0) {
+        vob->spu_streams[vob->spu_streams_current].current_index = 0;
+        if (vobsubid == vob->spu_streams_current ||
+            vob->spu_streams[vob->spu_streams_current].packets_size > 0)
+            ++vob->spu_valid_streams_size;
+    }
+}
+
+/* Read the data of an indexed packet from the .sub file if that has not
+   been done yet. The SPU may be split over several PES packets, they are
+   merged so that the packet holds the whole SPU. */
+static void vobsub_load_packet(vobsub_t *vob, unsigned int sid, packet_t *pkt)
+{
+    packet_queue_t *queue = vob->spu_streams + sid;
+    mpeg_t *mpg = vob->mpeg;
+    off_t limit = 0;
+    unsigned char *data = NULL;
+    unsigned int size = 0, wanted = 0;
+
+    if (!mpg || pkt->data)
+        return;
+    /* the next SPU of this stream starts after the end of this one */
+    if (pkt + 1 < queue->packets + queue->packets_size)
+        limit = pkt[1].filepos;
+    if (rar_seek(mpg->stream, pkt->filepos, SEEK_SET))
+        return;
+    while (!wanted || size < wanted) {
+        if (limit > pkt->filepos && mpeg_tell(mpg) >= limit)
+            break;
+        if (mpeg_run(mpg) < 0)
+            break;
+        if (mpg->packet_size && (mpg->aid & 0xe0) == 0x20 &&
+            (mpg->aid & 0x1f) == sid) {
+            unsigned char *tmp = realloc(data, size + mpg->packet_size);
+            if (!tmp) {
+                mp_msg(MSGT_VOBSUB, MSGL_FATAL, "vobsub_load_packet: realloc failure");
+                break;
+            }
+            data = tmp;
+            memcpy(data + size, mpg->packet, mpg->packet_size);
+            size += mpg->packet_size;
+            if (size >= 2)
+                wanted = data[0] << 8 | data[1];
+        }
+    }
+    if (!size) {
+        mp_msg(MSGT_VOBSUB, MSGL_WARN, "VobSub: no packet for stream %u at 0x%"PRIx64"\n",
+               sid, (int64_t)pkt->filepos);
+        return;
+    }
+
+    if (vob->cache[vob->cache_pos]) {
+        packet_t *old = vob->cache[vob->cache_pos];
+        free(old->data);
+        old->data = NULL;
+        old->size = 0;
+    }
+    vob->cache[vob->cache_pos] = pkt;
+    vob->cache_pos = (vob->cache_pos + 1) % VOBSUB_CACHE_SIZE;
+    pkt->data = data;
+    pkt->size = size;
+}
+
 static int vobsub_parse_id(vobsub_t *vob, const char *line)
 {
     // id: xx, index: n
@@ -943,6 +1028,11 @@ void *vobsub_open(const char *const name, const char *const ifo,
                     free(vob);
                     return NULL;
                 }
+            } else if (vobsub_has_index(vob)) {
+                /* The index tells where each packet is, so only read
+                   them from the .sub file once they are needed. */
+                vob->mpeg = mpg;
+                vobsub_count_valid_streams(vob);
             } else {
                 long last_pts_diff = 0;
                 while (!mpeg_eof(mpg)) {
@@ -995,13 +1085,7 @@ void *vobsub_open(const char *const name, const char *const ifo,
                         }
                     }
                 }
-                vob->spu_streams_current = vob->spu_streams_size;
-                while (vob->spu_streams_current-- > 0) {
-                    vob->spu_streams[vob->spu_streams_current].current_index = 0;
-                    if (vobsubid == vob->spu_streams_current ||
-                        vob->spu_streams[vob->spu_streams_current].packets_size > 0)
-                        ++vob->spu_valid_streams_size;
-                }
+                vobsub_count_valid_streams(vob);
                 mpeg_free(mpg);
             }
             free(buf);
@@ -1018,6 +1102,8 @@ void vobsub_close(void *this)
             packet_queue_destroy(vob->spu_streams + vob->spu_streams_size);
         free(vob->spu_streams);
     }
+    if (vob->mpeg)
+        mpeg_free(vob->mpeg);
     free(vob);
 }
 
@@ -1126,6 +1212,7 @@ int vobsub_get_packet(void *vobhandle, float pts, void** data, int* timestamp)
             if (pkt->pts100 != UINT_MAX)
                 if (pkt->pts100 <= pts100) {
                     ++queue->current_index;
+                    vobsub_load_packet(vob, vobsub_id, pkt);
                     *data = pkt->data;
                     *timestamp = pkt->pts100;
                     return pkt->size;
@@ -1146,6 +1233,7 @@ int vobsub_get_next_packet(void *vobhandle, void** data, int* timestamp)
         if (queue->current_index < queue->packets_size) {
             packet_t *pkt = queue->packets + queue->current_index;
             ++queue->current_index;
+            vobsub_load_packet(vob, vobsub_id, pkt);
             *data = pkt->data;
             *timestamp = pkt->pts100;
             return pkt->size;